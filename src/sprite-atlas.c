@@ -0,0 +1,660 @@
+/*
+ * Copyright (C) 2012 by Joseph A. Marrero.  http://www.manvscode.com/
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libutility/utility.h>
+#include "sprite.h"
+#include "sprite-mem.h"
+#include "sprite-private.h"
+
+static void sprite_atlas_release_pixels( sprite_atlas_t* p_atlas );
+static void sprite_atlas_forget_source( sprite_atlas_t* p_atlas );
+
+/*
+ * An atlas holds the pixels that sprite frames are cut from. Sprites
+ * either own a private atlas, created by sprite_set_texture(), or
+ * reference an atlas that is shared with other sprites so that their
+ * frames can be drawn with a single texture bind.
+ */
+sprite_atlas_t* sprite_atlas_create( const char* name, uint16_t w, uint16_t h, uint16_t bytes_per_pixel, const void* pixels )
+{
+	sprite_atlas_t* p_atlas = sprite_alloc( sizeof(sprite_atlas_t) );
+
+	if( p_atlas )
+	{
+		if( !name || *name == '\0' )
+		{
+			name = "unknown";
+		}
+
+		p_atlas->marker_and_bom[ 0 ] = 'S';
+		p_atlas->marker_and_bom[ 1 ] = 'P';
+		p_atlas->marker_and_bom[ 2 ] = 'A';
+		p_atlas->marker_and_bom[ 3 ] = sprite_file_bom( SPRITE_ATLAS_FILE_VERSION, false ); /* use little endian encoding */
+
+		p_atlas->name            = sprite_strdup( name );
+		p_atlas->name_length     = strlen( name );
+		p_atlas->width           = 0;
+		p_atlas->height          = 0;
+		p_atlas->bytes_per_pixel = bytes_per_pixel;
+		p_atlas->pixels          = NULL;
+		p_atlas->pitch           = 0;
+		p_atlas->alignment       = 0;
+		p_atlas->release         = NULL;
+		p_atlas->dirty_count     = 0;
+
+		p_atlas->source_offset        = -1;
+		p_atlas->source_is_big_endian = false;
+		p_atlas->source               = NULL;
+		p_atlas->pins                 = 0;
+		p_atlas->cache                = NULL;
+		p_atlas->cache_prev           = NULL;
+		p_atlas->cache_next           = NULL;
+
+		if( w > 0 && h > 0 )
+		{
+			sprite_atlas_set_texture( p_atlas, w, h, bytes_per_pixel, pixels );
+		}
+	}
+
+	return p_atlas;
+}
+
+void sprite_atlas_destroy( sprite_atlas_t** p_atlas )
+{
+	if( *p_atlas )
+	{
+		sprite_cache_unlink( *p_atlas );
+		sprite_free( (*p_atlas)->source );
+		sprite_free( (*p_atlas)->name );
+		sprite_atlas_release_pixels( *p_atlas );
+		sprite_free( *p_atlas );
+		*p_atlas = NULL;
+	}
+}
+
+void sprite_atlas_set_texture( sprite_atlas_t* p_atlas, uint16_t w, uint16_t h, uint16_t bytes_per_pixel, const void* pixels )
+{
+	sprite_atlas_copy_pixels( p_atlas, w, h, bytes_per_pixel, pixels, (uint32_t) w * bytes_per_pixel, 1 );
+}
+
+/*
+ * Pixel storage records the row pitch and the alignment that every
+ * row is guaranteed to have, so that SIMD code and texture uploads
+ * can work on the pixels in place.
+ */
+static inline uint16_t sprite_pixels_alignment( const void* pixels, uint32_t pitch, uint16_t h )
+{
+	uintptr_t bits = (uintptr_t) pixels | (h > 1 ? pitch : 0);
+	uintptr_t alignment = bits & (~bits + 1); /* lowest set bit */
+
+	return bits == 0 || alignment > 4096 ? 4096 : (uint16_t) alignment;
+}
+
+static void sprite_atlas_release_pixels( sprite_atlas_t* p_atlas )
+{
+	if( p_atlas->pixels && p_atlas->release )
+	{
+		p_atlas->release( p_atlas->pixels );
+	}
+
+	p_atlas->pixels    = NULL;
+	p_atlas->pitch     = 0;
+	p_atlas->alignment = 0;
+	p_atlas->release   = NULL;
+}
+
+/*
+ * Pixels that are replaced by the caller can no longer be read back
+ * from the file they were loaded from.
+ */
+static void sprite_atlas_forget_source( sprite_atlas_t* p_atlas )
+{
+	sprite_cache_unlink( p_atlas );
+	sprite_free( p_atlas->source );
+	p_atlas->source        = NULL;
+	p_atlas->source_offset = -1;
+}
+
+static inline void sprite_atlas_set_layout( sprite_atlas_t* p_atlas, uint16_t w, uint16_t h, uint16_t bytes_per_pixel, void* pixels, uint32_t pitch, sprite_free_fxn_t release )
+{
+	p_atlas->width           = w;
+	p_atlas->height          = h;
+	p_atlas->bytes_per_pixel = bytes_per_pixel;
+	p_atlas->pixels          = pixels;
+	p_atlas->pitch           = pitch;
+	p_atlas->alignment       = sprite_pixels_alignment( pixels, pitch, h );
+	p_atlas->release         = release;
+}
+
+/*
+ * Pixels replaced by the caller have to be uploaded in full, so the
+ * whole atlas becomes a single dirty region. Reloading evicted pixels
+ * doesn't change them and leaves the dirty regions alone.
+ */
+static inline void sprite_atlas_mark_replaced( sprite_atlas_t* p_atlas )
+{
+	p_atlas->dirty_count = 0;
+
+	if( p_atlas->width > 0 && p_atlas->height > 0 )
+	{
+		p_atlas->dirty[ 0 ]   = (sprite_rect_t) { 0, 0, p_atlas->width, p_atlas->height };
+		p_atlas->dirty_count = 1;
+	}
+}
+
+/*
+ * Allocates uninitialized, library owned storage. The first row is
+ * aligned to SPRITE_PIXEL_ALIGNMENT and the pitch is rounded up to a
+ * multiple of row_alignment, which must be a power of 2.
+ */
+bool sprite_atlas_allocate_pixels( sprite_atlas_t* p_atlas, uint16_t w, uint16_t h, uint16_t bytes_per_pixel, uint16_t row_alignment )
+{
+	assert( p_atlas );
+	assert( row_alignment > 0 && (row_alignment & (row_alignment - 1)) == 0 );
+
+	sprite_atlas_release_pixels( p_atlas );
+
+	uint32_t pitch = ((uint32_t) w * bytes_per_pixel + row_alignment - 1) & ~((uint32_t) row_alignment - 1);
+	size_t alignment = row_alignment > SPRITE_PIXEL_ALIGNMENT ? row_alignment : SPRITE_PIXEL_ALIGNMENT;
+	void* pixels = sprite_alloc_aligned( (size_t) pitch * h, alignment );
+
+	if( !pixels && pitch > 0 && h > 0 )
+	{
+		sprite_atlas_set_layout( p_atlas, 0, 0, bytes_per_pixel, NULL, 0, NULL );
+		p_atlas->dirty_count = 0;
+		return false;
+	}
+
+	sprite_atlas_set_layout( p_atlas, w, h, bytes_per_pixel, pixels, pitch, sprite_free_aligned );
+	return true;
+}
+
+/*
+ * Copies pixels with the given source pitch into library owned
+ * storage. A row_alignment of 1 keeps the rows tightly packed.
+ */
+bool sprite_atlas_copy_pixels( sprite_atlas_t* p_atlas, uint16_t w, uint16_t h, uint16_t bytes_per_pixel, const void* pixels, uint32_t pitch, uint16_t row_alignment )
+{
+	sprite_atlas_forget_source( p_atlas );
+
+	if( !sprite_atlas_allocate_pixels( p_atlas, w, h, bytes_per_pixel, row_alignment ) )
+	{
+		return false;
+	}
+
+	if( pixels )
+	{
+		size_t row_size = (size_t) w * bytes_per_pixel;
+
+		if( pitch == p_atlas->pitch )
+		{
+			memcpy( p_atlas->pixels, pixels, (size_t) pitch * h );
+		}
+		else
+		{
+			for( uint16_t y = 0; y < h; y++ )
+			{
+				memcpy( (uint8_t*) p_atlas->pixels + (size_t) y * p_atlas->pitch, (const uint8_t*) pixels + (size_t) y * pitch, row_size );
+			}
+		}
+	}
+
+	sprite_atlas_mark_replaced( p_atlas );
+	return true;
+}
+
+/*
+ * The atlas takes ownership of the pixels without copying them. They
+ * are passed to release when the atlas no longer needs them.
+ */
+bool sprite_atlas_take_pixels( sprite_atlas_t* p_atlas, uint16_t w, uint16_t h, uint16_t bytes_per_pixel, void* pixels, uint32_t pitch, sprite_free_fxn_t release )
+{
+	assert( p_atlas );
+	assert( pitch >= (uint32_t) w * bytes_per_pixel );
+
+	sprite_atlas_forget_source( p_atlas );
+	sprite_atlas_release_pixels( p_atlas );
+	sprite_atlas_set_layout( p_atlas, w, h, bytes_per_pixel, pixels, pitch, release );
+	sprite_atlas_mark_replaced( p_atlas );
+	return true;
+}
+
+/*
+ * The atlas uses the pixels without copying them. The caller must keep
+ * them alive for as long as the atlas uses them.
+ */
+bool sprite_atlas_borrow_pixels( sprite_atlas_t* p_atlas, uint16_t w, uint16_t h, uint16_t bytes_per_pixel, const void* pixels, uint32_t pitch )
+{
+	return sprite_atlas_take_pixels( p_atlas, w, h, bytes_per_pixel, (void*) pixels, pitch, NULL );
+}
+
+static inline uint32_t sprite_rect_area( const sprite_rect_t* r )
+{
+	return (uint32_t) r->width * r->height;
+}
+
+static inline sprite_rect_t sprite_rect_union( const sprite_rect_t* a, const sprite_rect_t* b )
+{
+	uint16_t x0 = a->x < b->x ? a->x : b->x;
+	uint16_t y0 = a->y < b->y ? a->y : b->y;
+	uint32_t x1 = (uint32_t) a->x + a->width > (uint32_t) b->x + b->width ? (uint32_t) a->x + a->width : (uint32_t) b->x + b->width;
+	uint32_t y1 = (uint32_t) a->y + a->height > (uint32_t) b->y + b->height ? (uint32_t) a->y + a->height : (uint32_t) b->y + b->height;
+
+	return (sprite_rect_t) { x0, y0, (uint16_t) (x1 - x0), (uint16_t) (y1 - y0) };
+}
+
+/* True if the rectangles overlap or share an edge. */
+static inline bool sprite_rect_touches( const sprite_rect_t* a, const sprite_rect_t* b )
+{
+	return (uint32_t) a->x <= (uint32_t) b->x + b->width  && (uint32_t) b->x <= (uint32_t) a->x + a->width &&
+	       (uint32_t) a->y <= (uint32_t) b->y + b->height && (uint32_t) b->y <= (uint32_t) a->y + a->height;
+}
+
+/*
+ * Adds a region to the dirty list. Regions that touch it are merged
+ * into it. When the list is full the new region is merged with the
+ * region whose bounds grow the least, so the list never holds more
+ * than SPRITE_MAX_DIRTY_RECTS regions and never misses a change.
+ */
+static void sprite_atlas_add_dirty( sprite_atlas_t* p_atlas, sprite_rect_t rect )
+{
+	uint8_t i = 0;
+
+	while( i < p_atlas->dirty_count )
+	{
+		if( sprite_rect_touches( &rect, &p_atlas->dirty[ i ] ) )
+		{
+			rect = sprite_rect_union( &rect, &p_atlas->dirty[ i ] );
+			p_atlas->dirty[ i ] = p_atlas->dirty[ --p_atlas->dirty_count ];
+			i = 0; /* the grown region may now touch regions already checked */
+		}
+		else
+		{
+			i++;
+		}
+	}
+
+	if( p_atlas->dirty_count == SPRITE_MAX_DIRTY_RECTS )
+	{
+		uint8_t best = 0;
+		uint32_t best_growth = UINT32_MAX;
+
+		for( i = 0; i < p_atlas->dirty_count; i++ )
+		{
+			sprite_rect_t merged = sprite_rect_union( &rect, &p_atlas->dirty[ i ] );
+			uint32_t growth = sprite_rect_area( &merged ) - sprite_rect_area( &p_atlas->dirty[ i ] );
+
+			if( growth < best_growth )
+			{
+				best        = i;
+				best_growth = growth;
+			}
+		}
+
+		rect = sprite_rect_union( &rect, &p_atlas->dirty[ best ] );
+		p_atlas->dirty[ best ] = p_atlas->dirty[ --p_atlas->dirty_count ];
+		sprite_atlas_add_dirty( p_atlas, rect );
+		return;
+	}
+
+	p_atlas->dirty[ p_atlas->dirty_count++ ] = rect;
+}
+
+/*
+ * Copies pixels into a region of the atlas and records the region as
+ * dirty, so that only the changed regions need to be uploaded. The
+ * pixels must have the atlas' bytes per pixel. Borrowed pixels cannot
+ * be written to.
+ */
+bool sprite_atlas_update_pixels( sprite_atlas_t* p_atlas, uint16_t x, uint16_t y, uint16_t w, uint16_t h, const void* pixels, uint32_t pitch )
+{
+	assert( p_atlas );
+	assert( pixels );
+
+	if( (uint32_t) x + w > p_atlas->width || (uint32_t) y + h > p_atlas->height || !p_atlas->release )
+	{
+		return false;
+	}
+
+	if( w == 0 || h == 0 )
+	{
+		return true;
+	}
+
+	/* changed pixels can no longer be evicted and read back */
+	if( p_atlas->cache && !sprite_cache_touch( p_atlas ) )
+	{
+		return false;
+	}
+	sprite_atlas_forget_source( p_atlas );
+
+	size_t row_size = (size_t) w * p_atlas->bytes_per_pixel;
+	uint8_t* dst = (uint8_t*) p_atlas->pixels + (size_t) y * p_atlas->pitch + (size_t) x * p_atlas->bytes_per_pixel;
+
+	for( uint16_t row = 0; row < h; row++ )
+	{
+		memcpy( dst + (size_t) row * p_atlas->pitch, (const uint8_t*) pixels + (size_t) row * pitch, row_size );
+	}
+
+	sprite_atlas_add_dirty( p_atlas, (sprite_rect_t) { x, y, w, h } );
+	return true;
+}
+
+uint8_t sprite_atlas_dirty_count( const sprite_atlas_t* p_atlas )
+{
+	return p_atlas ? p_atlas->dirty_count : 0;
+}
+
+/* The regions do not overlap each other. */
+const sprite_rect_t* sprite_atlas_dirty_rects( const sprite_atlas_t* p_atlas )
+{
+	return p_atlas ? p_atlas->dirty : NULL;
+}
+
+void sprite_atlas_clear_dirty( sprite_atlas_t* p_atlas )
+{
+	assert( p_atlas );
+	p_atlas->dirty_count = 0;
+}
+
+/*
+ * Pixel data is stored as if the tightly packed image had been written
+ * by a single sprite_write, which byte swaps the whole image at once.
+ * On hosts that swap, the file therefore starts with the last row, so
+ * rows are visited in the order the swapped image holds them.
+ */
+static inline bool sprite_atlas_rows_are_reversed( void )
+{
+	uint8_t probe[ 2 ] = { 1, 0 };
+	hton( probe, sizeof(probe) );
+	return probe[ 0 ] == 0;
+}
+
+bool sprite_atlas_read_pixels( sprite_atlas_t* p_atlas, FILE* file, bool is_big_endian )
+{
+	size_t row_size = sprite_atlas_tight_pitch( p_atlas );
+
+	if( row_size == 0 || p_atlas->height == 0 )
+	{
+		return true;
+	}
+
+	if( p_atlas->pitch == row_size )
+	{
+		sprite_read( p_atlas->pixels, row_size * p_atlas->height, file, is_big_endian );
+	}
+	else
+	{
+		bool reversed = sprite_atlas_rows_are_reversed( );
+
+		for( uint16_t row = 0; row < p_atlas->height; row++ )
+		{
+			uint16_t y = reversed ? p_atlas->height - 1 - row : row;
+			sprite_read( (uint8_t*) p_atlas->pixels + (size_t) y * p_atlas->pitch, row_size, file, is_big_endian );
+		}
+	}
+
+	return true;
+
+failure:
+	return false;
+}
+
+/*
+ * Rows are swapped in a scratch row, so pixels that are borrowed from
+ * the caller are never modified, not even temporarily.
+ */
+bool sprite_atlas_write_pixels( const sprite_atlas_t* p_atlas, FILE* file, bool is_big_endian )
+{
+	size_t row_size = sprite_atlas_tight_pitch( p_atlas );
+	uint8_t* scratch = NULL;
+
+	if( row_size == 0 || p_atlas->height == 0 )
+	{
+		return true;
+	}
+
+	scratch = sprite_alloc( row_size );
+
+	if( !scratch )
+	{
+		goto failure;
+	}
+
+	bool reversed = sprite_atlas_rows_are_reversed( );
+
+	for( uint16_t row = 0; row < p_atlas->height; row++ )
+	{
+		uint16_t y = reversed ? p_atlas->height - 1 - row : row;
+		memcpy( scratch, (const uint8_t*) p_atlas->pixels + (size_t) y * p_atlas->pitch, row_size );
+		sprite_write( scratch, row_size, file, is_big_endian );
+	}
+
+	sprite_free( scratch );
+	return true;
+
+failure:
+	sprite_free( scratch );
+	return false;
+}
+
+const char* sprite_atlas_name( const sprite_atlas_t* p_atlas )
+{
+	return p_atlas && p_atlas->name ? p_atlas->name : "<unknown>";
+}
+
+uint16_t sprite_atlas_width( const sprite_atlas_t* p_atlas )
+{
+	return p_atlas ? p_atlas->width : 0;
+}
+
+uint16_t sprite_atlas_height( const sprite_atlas_t* p_atlas )
+{
+	return p_atlas ? p_atlas->height : 0;
+}
+
+uint16_t sprite_atlas_bytes_per_pixel( const sprite_atlas_t* p_atlas )
+{
+	return p_atlas ? p_atlas->bytes_per_pixel : 0;
+}
+
+/*
+ * Returns NULL while the pixels of an atlas in a cache are evicted.
+ * Pin the pixels to read them back and to keep the pointer valid.
+ */
+const void* sprite_atlas_pixels( const sprite_atlas_t* p_atlas )
+{
+	return p_atlas ? p_atlas->pixels : NULL;
+}
+
+/*
+ * Makes the pixels resident, reading them back from their file if a
+ * cache evicted them, and keeps the cache from evicting them until
+ * every pin is released. Pinning and unpinning change the cache, so
+ * like the other cache calls they must not run concurrently with each
+ * other. The getters have no side effects and can be called from any
+ * thread while the atlas is pinned.
+ */
+const void* sprite_atlas_pin_pixels( sprite_atlas_t* p_atlas )
+{
+	assert( p_atlas );
+	const void* pixels = p_atlas->cache ? sprite_cache_touch( p_atlas ) : p_atlas->pixels;
+
+	if( pixels )
+	{
+		p_atlas->pins++;
+	}
+
+	return pixels;
+}
+
+/* The cache is brought back within its budget once nothing pins the atlas. */
+void sprite_atlas_unpin_pixels( sprite_atlas_t* p_atlas )
+{
+	assert( p_atlas );
+	assert( p_atlas->pins > 0 );
+
+	if( p_atlas->pins > 0 && --p_atlas->pins == 0 && p_atlas->cache )
+	{
+		sprite_cache_trim( p_atlas->cache );
+	}
+}
+
+uint32_t sprite_atlas_pitch( const sprite_atlas_t* p_atlas )
+{
+	return p_atlas ? p_atlas->pitch : 0;
+}
+
+uint16_t sprite_atlas_alignment( const sprite_atlas_t* p_atlas )
+{
+	return p_atlas ? p_atlas->alignment : 0;
+}
+
+sprite_atlas_t* sprite_atlas_from_file( const char* filename )
+{
+	sprite_atlas_t* p_atlas = NULL;
+	FILE* file = fopen( filename, "rb" );
+
+	if( !file )
+	{
+		goto failure;
+	}
+
+	char marker_and_bom[ 4 ] = { 0 };
+	if( fread( marker_and_bom, sizeof(char), sizeof(marker_and_bom), file ) != sizeof(marker_and_bom) )
+	{
+		goto failure;
+	}
+
+	if( marker_and_bom[ 0 ] != 'S' || marker_and_bom[ 1 ] != 'P' || marker_and_bom[ 2 ] != 'A' )
+	{
+		goto failure;
+	}
+
+	if( sprite_file_version( marker_and_bom[ 3 ] ) > SPRITE_ATLAS_FILE_VERSION )
+	{
+		goto failure; /* written by a newer version of the library */
+	}
+
+	bool is_big_endian = sprite_file_is_big_endian( marker_and_bom[ 3 ] );
+	p_atlas = sprite_atlas_create( NULL, 0, 0, 4, NULL );
+
+	if( !p_atlas )
+	{
+		goto failure;
+	}
+
+	sprite_free( p_atlas->name );
+	p_atlas->name = NULL;
+
+	sprite_read( &p_atlas->name_length, sizeof(p_atlas->name_length), file, is_big_endian );
+	p_atlas->name = sprite_alloc( sizeof(char) * (p_atlas->name_length + 1) );
+	if( !p_atlas->name || fread( p_atlas->name, sizeof(char), p_atlas->name_length + 1, file ) != p_atlas->name_length + 1u )
+	{
+		goto failure;
+	}
+	p_atlas->name[ p_atlas->name_length ] = '\0';
+
+	uint16_t width          = 0;
+	uint16_t height         = 0;
+	uint8_t bytes_per_pixel = 0;
+
+	sprite_read( &width, sizeof(width), file, is_big_endian );
+	sprite_read( &height, sizeof(height), file, is_big_endian );
+	if( fread( &bytes_per_pixel, sizeof(uint8_t), 1, file ) != 1 )
+	{
+		goto failure;
+	}
+
+	p_atlas->source               = sprite_strdup( filename );
+	p_atlas->source_offset        = ftell( file );
+	p_atlas->source_is_big_endian = is_big_endian;
+
+	if( !p_atlas->source ||
+	    !sprite_atlas_allocate_pixels( p_atlas, width, height, bytes_per_pixel, 1 ) ||
+	    !sprite_atlas_read_pixels( p_atlas, file, is_big_endian ) )
+	{
+		goto failure;
+	}
+
+	sprite_atlas_mark_replaced( p_atlas );
+
+	#ifdef DEBUG_SPRITE
+	printf( "[Sprite Atlas] Loaded: %s\n", sprite_atlas_name( p_atlas ) );
+	#endif
+
+	fclose( file );
+	return p_atlas;
+
+failure:
+	if( p_atlas ) sprite_atlas_destroy( &p_atlas );
+	if( file ) fclose( file );
+	return NULL;
+}
+
+bool sprite_atlas_save( const sprite_atlas_t* p_atlas, const char* filename )
+{
+	FILE* file = fopen( filename, "w+b" );
+
+	if( !file )
+	{
+		return false;
+	}
+
+	sprite_atlas_t* atlas = (sprite_atlas_t*) p_atlas; /* sprite_write() needs mutable pointers */
+	bool is_big_endian = sprite_file_is_big_endian( atlas->marker_and_bom[ 3 ] );
+
+	fwrite( atlas->marker_and_bom, sizeof(char), sizeof(atlas->marker_and_bom), file );
+
+	sprite_write( &atlas->name_length, sizeof(atlas->name_length), file, is_big_endian );
+	fwrite( atlas->name, sizeof(char), atlas->name_length + 1, file );
+	sprite_write( &atlas->width, sizeof(atlas->width), file, is_big_endian );
+	sprite_write( &atlas->height, sizeof(atlas->height), file, is_big_endian );
+	fwrite( &atlas->bytes_per_pixel, sizeof(uint8_t), 1, file );
+
+	/* evicted pixels are read back for as long as they are written */
+	const void* pixels = sprite_atlas_pin_pixels( atlas );
+	bool written       = (pixels || atlas->width == 0 || atlas->height == 0) && sprite_atlas_write_pixels( atlas, file, is_big_endian );
+
+	if( pixels )
+	{
+		sprite_atlas_unpin_pixels( atlas );
+	}
+
+	if( !written )
+	{
+		goto failure;
+	}
+
+	#ifdef DEBUG_SPRITE
+	printf( "[Sprite Atlas] Saved: %s\n", sprite_atlas_name( atlas ) );
+	#endif
+
+	fclose( file );
+	return true;
+
+failure:
+	if( file ) fclose( file );
+	return false;
+}
@@ -0,0 +1,312 @@
+/*
+ * Copyright (C) 2012 by Joseph A. Marrero.  http://www.manvscode.com/
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sprite.h"
+#include "sprite-mem.h"
+#include "sprite-private.h"
+
+/*
+ * A cache keeps the pixels of the atlases added to it within a byte
+ * budget. When the budget is exceeded the pixels of the least recently
+ * used atlases that aren't pinned are freed. They are read back from
+ * the atlas' file by the next sprite_atlas_pin_pixels().
+ *
+ * Atlases are kept in a list ordered from the most to the least
+ * recently used; only resident atlases count against the budget.
+ */
+struct sprite_cache {
+	size_t          budget;
+	size_t          resident_bytes;
+	sprite_atlas_t* head; /* most recently used */
+	sprite_atlas_t* tail; /* least recently used */
+};
+
+static inline size_t sprite_cache_pixel_size( const sprite_atlas_t* p_atlas )
+{
+	return (size_t) p_atlas->pitch * p_atlas->height;
+}
+
+static void sprite_cache_link_front( sprite_cache_t* p_cache, sprite_atlas_t* p_atlas )
+{
+	p_atlas->cache_prev = NULL;
+	p_atlas->cache_next = p_cache->head;
+
+	if( p_cache->head )
+	{
+		p_cache->head->cache_prev = p_atlas;
+	}
+	else
+	{
+		p_cache->tail = p_atlas;
+	}
+
+	p_cache->head = p_atlas;
+}
+
+static void sprite_cache_unlink_list( sprite_cache_t* p_cache, sprite_atlas_t* p_atlas )
+{
+	if( p_atlas->cache_prev ) p_atlas->cache_prev->cache_next = p_atlas->cache_next;
+	else p_cache->head = p_atlas->cache_next;
+
+	if( p_atlas->cache_next ) p_atlas->cache_next->cache_prev = p_atlas->cache_prev;
+	else p_cache->tail = p_atlas->cache_prev;
+
+	p_atlas->cache_prev = NULL;
+	p_atlas->cache_next = NULL;
+}
+
+/*
+ * Frees the pixels but keeps the layout, so that the size of the atlas
+ * can still be queried while it is evicted.
+ */
+static void sprite_cache_evict_atlas( sprite_cache_t* p_cache, sprite_atlas_t* p_atlas )
+{
+	if( p_atlas->pixels )
+	{
+		p_cache->resident_bytes -= sprite_cache_pixel_size( p_atlas );
+		p_atlas->release( p_atlas->pixels );
+		p_atlas->pixels = NULL;
+	}
+}
+
+/* Evicts from the least recently used end, never touching keep or pinned atlases. */
+static void sprite_cache_evict( sprite_cache_t* p_cache, const sprite_atlas_t* keep )
+{
+	sprite_atlas_t* p_atlas = p_cache->tail;
+
+	while( p_cache->resident_bytes > p_cache->budget && p_atlas )
+	{
+		if( p_atlas != keep && p_atlas->pins == 0 )
+		{
+			sprite_cache_evict_atlas( p_cache, p_atlas );
+		}
+
+		p_atlas = p_atlas->cache_prev;
+	}
+}
+
+static bool sprite_cache_load( sprite_cache_t* p_cache, sprite_atlas_t* p_atlas )
+{
+	FILE* file = fopen( p_atlas->source, "rb" );
+
+	if( !file )
+	{
+		return false;
+	}
+
+	if( fseek( file, p_atlas->source_offset, SEEK_SET ) != 0 ||
+	    !sprite_atlas_allocate_pixels( p_atlas, p_atlas->width, p_atlas->height, p_atlas->bytes_per_pixel, 1 ) )
+	{
+		goto failure;
+	}
+
+	if( !sprite_atlas_read_pixels( p_atlas, file, p_atlas->source_is_big_endian ) )
+	{
+		p_atlas->release( p_atlas->pixels );
+		p_atlas->pixels = NULL;
+		goto failure;
+	}
+
+	#ifdef DEBUG_SPRITE
+	printf( "[Sprite Cache] Reloaded: %s\n", sprite_atlas_name( p_atlas ) );
+	#endif
+
+	p_cache->resident_bytes += sprite_cache_pixel_size( p_atlas );
+	fclose( file );
+	return true;
+
+failure:
+	fclose( file );
+	return false;
+}
+
+sprite_cache_t* sprite_cache_create( size_t budget )
+{
+	sprite_cache_t* p_cache = sprite_alloc( sizeof(sprite_cache_t) );
+
+	if( p_cache )
+	{
+		p_cache->budget         = budget;
+		p_cache->resident_bytes = 0;
+		p_cache->head           = NULL;
+		p_cache->tail           = NULL;
+	}
+
+	return p_cache;
+}
+
+/*
+ * Atlases that are still in the cache get their pixels back, since
+ * nothing could reload them once the cache is gone.
+ */
+void sprite_cache_destroy( sprite_cache_t** p_cache )
+{
+	if( *p_cache )
+	{
+		while( (*p_cache)->head )
+		{
+			sprite_cache_remove( *p_cache, (*p_cache)->head );
+		}
+
+		sprite_free( *p_cache );
+		*p_cache = NULL;
+	}
+}
+
+void sprite_cache_set_budget( sprite_cache_t* p_cache, size_t budget )
+{
+	assert( p_cache );
+	p_cache->budget = budget;
+	sprite_cache_evict( p_cache, NULL );
+}
+
+size_t sprite_cache_budget( const sprite_cache_t* p_cache )
+{
+	return p_cache ? p_cache->budget : 0;
+}
+
+size_t sprite_cache_resident_bytes( const sprite_cache_t* p_cache )
+{
+	return p_cache ? p_cache->resident_bytes : 0;
+}
+
+/*
+ * Only atlases whose pixels were loaded with sprite_from_file() or
+ * sprite_atlas_from_file() can be added, since their pixels are read
+ * back from the same file. Replacing the pixels of an atlas removes it
+ * from its cache.
+ */
+bool sprite_cache_add( sprite_cache_t* p_cache, sprite_atlas_t* p_atlas )
+{
+	assert( p_cache );
+	assert( p_atlas );
+
+	if( p_atlas->cache == p_cache )
+	{
+		return true;
+	}
+
+	if( p_atlas->cache || p_atlas->source_offset < 0 || !p_atlas->source || !p_atlas->release )
+	{
+		return false;
+	}
+
+	p_atlas->cache = p_cache;
+	sprite_cache_link_front( p_cache, p_atlas );
+
+	if( p_atlas->pixels )
+	{
+		p_cache->resident_bytes += sprite_cache_pixel_size( p_atlas );
+		sprite_cache_evict( p_cache, p_atlas );
+	}
+
+	return true;
+}
+
+/* The atlas leaves the cache with its pixels resident. */
+void sprite_cache_remove( sprite_cache_t* p_cache, sprite_atlas_t* p_atlas )
+{
+	assert( p_cache );
+	assert( p_atlas );
+
+	if( p_atlas->cache != p_cache )
+	{
+		return;
+	}
+
+	if( !p_atlas->pixels )
+	{
+		sprite_cache_load( p_cache, p_atlas );
+	}
+
+	sprite_cache_unlink( p_atlas );
+}
+
+/*
+ * Hints that the sprite is about to be drawn, for instance because one
+ * of its states is about to be played, so that its pixels are read
+ * before they are needed instead of on first access.
+ */
+bool sprite_cache_prefetch( sprite_cache_t* p_cache, const sprite_t* sprite )
+{
+	sprite_atlas_t* atlas = sprite_atlas( sprite );
+
+	if( !atlas || atlas->cache != p_cache )
+	{
+		return false;
+	}
+
+	return sprite_cache_touch( atlas ) != NULL;
+}
+
+/* Evicts every atlas that is over the budget, e.g. after a level change. */
+void sprite_cache_trim( sprite_cache_t* p_cache )
+{
+	assert( p_cache );
+	sprite_cache_evict( p_cache, NULL );
+}
+
+/*
+ * Marks the atlas as the most recently used, reading its pixels back
+ * if they were evicted.
+ */
+const void* sprite_cache_touch( sprite_atlas_t* p_atlas )
+{
+	sprite_cache_t* p_cache = p_atlas->cache;
+
+	if( p_cache->head != p_atlas )
+	{
+		sprite_cache_unlink_list( p_cache, p_atlas );
+		sprite_cache_link_front( p_cache, p_atlas );
+	}
+
+	if( !p_atlas->pixels )
+	{
+		if( !sprite_cache_load( p_cache, p_atlas ) )
+		{
+			return NULL;
+		}
+
+		sprite_cache_evict( p_cache, p_atlas );
+	}
+
+	return p_atlas->pixels;
+}
+
+/* Removes the atlas from its cache without reloading its pixels. */
+void sprite_cache_unlink( sprite_atlas_t* p_atlas )
+{
+	sprite_cache_t* p_cache = p_atlas->cache;
+
+	if( p_cache )
+	{
+		if( p_atlas->pixels )
+		{
+			p_cache->resident_bytes -= sprite_cache_pixel_size( p_atlas );
+		}
+
+		sprite_cache_unlink_list( p_cache, p_atlas );
+		p_atlas->cache = NULL;
+	}
+}
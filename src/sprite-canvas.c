@@ -0,0 +1,362 @@
+/*
+ * Copyright (C) 2012 by Joseph A. Marrero.  http://www.manvscode.com/
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#include "sprite.h"
+#include "sprite-private.h"
+
+/*
+ * Frames are drawn a row at a time. A row of the frame is first
+ * fetched into a span of RGBA pixels, flipped and scaled as needed,
+ * and the span is then copied or blended into each canvas row it
+ * covers. A frame row that is already a span, which is the case for
+ * 32-bit atlases drawn at their own size, is used in place.
+ */
+#define SPRITE_CANVAS_SPAN    1024 /* pixels */
+
+/*
+ * Blending uses straight alpha: every channel becomes
+ * (s * a + d * (255 - a)) / 255, rounded, where the source alpha is
+ * taken to be 255 for the alpha channel itself. The vector kernels
+ * give the same results as the scalar one, bit for bit.
+ */
+static inline uint8_t sprite_canvas_blend_channel( uint32_t s, uint32_t d, uint32_t a )
+{
+	uint32_t x = s * a + d * (255 - a) + 128;
+	return (uint8_t) ((x + (x >> 8)) >> 8);
+}
+
+static inline void sprite_canvas_blend_pixel( uint8_t* restrict dst, const uint8_t* restrict src )
+{
+	uint32_t a = src[ 3 ];
+
+	if( a == 255 )
+	{
+		memcpy( dst, src, 4 );
+	}
+	else if( a > 0 )
+	{
+		dst[ 0 ] = sprite_canvas_blend_channel( src[ 0 ], dst[ 0 ], a );
+		dst[ 1 ] = sprite_canvas_blend_channel( src[ 1 ], dst[ 1 ], a );
+		dst[ 2 ] = sprite_canvas_blend_channel( src[ 2 ], dst[ 2 ], a );
+		dst[ 3 ] = sprite_canvas_blend_channel( 255, dst[ 3 ], a );
+	}
+}
+
+#ifdef __SSE2__
+/* Blends 2 pixels, unpacked to 16 bits per channel. */
+static inline __m128i sprite_canvas_blend2( __m128i s, __m128i d, __m128i a )
+{
+	const __m128i round = _mm_set1_epi16( 128 );
+	__m128i x = _mm_add_epi16( _mm_mullo_epi16( s, a ), _mm_mullo_epi16( d, _mm_sub_epi16( _mm_set1_epi16( 255 ), a ) ) );
+
+	x = _mm_add_epi16( x, round );
+	return _mm_srli_epi16( _mm_add_epi16( x, _mm_srli_epi16( x, 8 ) ), 8 );
+}
+
+/* Blends 4 pixels. */
+static inline void sprite_canvas_blend4( uint8_t* dst, const uint8_t* src )
+{
+	const __m128i alpha = _mm_set1_epi32( (int) 0xFF000000 );
+	const __m128i zero  = _mm_setzero_si128( );
+	__m128i s = _mm_loadu_si128( (const __m128i*) src );
+	int opaque = _mm_movemask_epi8( _mm_cmpeq_epi32( _mm_and_si128( s, alpha ), alpha ) );
+
+	if( opaque == 0xFFFF )
+	{
+		_mm_storeu_si128( (__m128i*) dst, s );
+	}
+	else if( opaque != 0 || _mm_movemask_epi8( _mm_cmpeq_epi32( _mm_and_si128( s, alpha ), zero ) ) != 0xFFFF )
+	{
+		__m128i d = _mm_loadu_si128( (const __m128i*) dst );
+		__m128i a = _mm_srli_epi32( s, 24 );
+
+		a = _mm_or_si128( a, _mm_slli_epi32( a, 16 ) );
+		a = _mm_or_si128( a, _mm_slli_epi32( a, 8 ) );
+		s = _mm_or_si128( s, alpha );
+
+		__m128i lo = sprite_canvas_blend2( _mm_unpacklo_epi8( s, zero ), _mm_unpacklo_epi8( d, zero ), _mm_unpacklo_epi8( a, zero ) );
+		__m128i hi = sprite_canvas_blend2( _mm_unpackhi_epi8( s, zero ), _mm_unpackhi_epi8( d, zero ), _mm_unpackhi_epi8( a, zero ) );
+
+		_mm_storeu_si128( (__m128i*) dst, _mm_packus_epi16( lo, hi ) );
+	}
+}
+#endif
+
+#ifdef __AVX2__
+static inline __m256i sprite_canvas_blend4_avx2( __m256i s, __m256i d, __m256i a )
+{
+	const __m256i round = _mm256_set1_epi16( 128 );
+	__m256i x = _mm256_add_epi16( _mm256_mullo_epi16( s, a ), _mm256_mullo_epi16( d, _mm256_sub_epi16( _mm256_set1_epi16( 255 ), a ) ) );
+
+	x = _mm256_add_epi16( x, round );
+	return _mm256_srli_epi16( _mm256_add_epi16( x, _mm256_srli_epi16( x, 8 ) ), 8 );
+}
+
+/* Blends 8 pixels. */
+static inline void sprite_canvas_blend8( uint8_t* dst, const uint8_t* src )
+{
+	const __m256i alpha = _mm256_set1_epi32( (int) 0xFF000000 );
+	const __m256i zero  = _mm256_setzero_si256( );
+	__m256i s = _mm256_loadu_si256( (const __m256i*) src );
+	uint32_t opaque = (uint32_t) _mm256_movemask_epi8( _mm256_cmpeq_epi32( _mm256_and_si256( s, alpha ), alpha ) );
+
+	if( opaque == 0xFFFFFFFF )
+	{
+		_mm256_storeu_si256( (__m256i*) dst, s );
+	}
+	else if( opaque != 0 || (uint32_t) _mm256_movemask_epi8( _mm256_cmpeq_epi32( _mm256_and_si256( s, alpha ), zero ) ) != 0xFFFFFFFF )
+	{
+		__m256i d = _mm256_loadu_si256( (const __m256i*) dst );
+		__m256i a = _mm256_srli_epi32( s, 24 );
+
+		a = _mm256_or_si256( a, _mm256_slli_epi32( a, 16 ) );
+		a = _mm256_or_si256( a, _mm256_slli_epi32( a, 8 ) );
+		s = _mm256_or_si256( s, alpha );
+
+		__m256i lo = sprite_canvas_blend4_avx2( _mm256_unpacklo_epi8( s, zero ), _mm256_unpacklo_epi8( d, zero ), _mm256_unpacklo_epi8( a, zero ) );
+		__m256i hi = sprite_canvas_blend4_avx2( _mm256_unpackhi_epi8( s, zero ), _mm256_unpackhi_epi8( d, zero ), _mm256_unpackhi_epi8( a, zero ) );
+
+		_mm256_storeu_si256( (__m256i*) dst, _mm256_packus_epi16( lo, hi ) );
+	}
+}
+#endif
+
+static void sprite_canvas_blend_span_scalar( uint8_t* restrict dst, const uint8_t* restrict src, uint32_t count )
+{
+	for( uint32_t i = 0; i < count; i++ )
+	{
+		sprite_canvas_blend_pixel( dst + 4 * i, src + 4 * i );
+	}
+}
+
+#ifdef __SSE2__
+static void sprite_canvas_blend_span_sse2( uint8_t* restrict dst, const uint8_t* restrict src, uint32_t count )
+{
+	uint32_t i = 0;
+
+	for( ; i + 4 <= count; i += 4 )
+	{
+		sprite_canvas_blend4( dst + 4 * i, src + 4 * i );
+	}
+
+	sprite_canvas_blend_span_scalar( dst + 4 * i, src + 4 * i, count - i );
+}
+#endif
+
+#ifdef __AVX2__
+static void sprite_canvas_blend_span_avx2( uint8_t* restrict dst, const uint8_t* restrict src, uint32_t count )
+{
+	uint32_t i = 0;
+
+	for( ; i + 8 <= count; i += 8 )
+	{
+		sprite_canvas_blend8( dst + 4 * i, src + 4 * i );
+	}
+
+	sprite_canvas_blend_span_sse2( dst + 4 * i, src + 4 * i, count - i );
+}
+#endif
+
+/* The kernels that were compiled in, the fastest last. */
+static const sprite_blend_kernel_t sprite_canvas_kernels[] = {
+	{ "scalar", sprite_canvas_blend_span_scalar },
+	#ifdef __SSE2__
+	{ "sse2", sprite_canvas_blend_span_sse2 },
+	#endif
+	#ifdef __AVX2__
+	{ "avx2", sprite_canvas_blend_span_avx2 },
+	#endif
+};
+
+#define SPRITE_CANVAS_KERNEL_COUNT    (sizeof(sprite_canvas_kernels) / sizeof(sprite_canvas_kernels[ 0 ]))
+
+#if defined(__AVX2__)
+#define sprite_canvas_blend_span    sprite_canvas_blend_span_avx2
+#elif defined(__SSE2__)
+#define sprite_canvas_blend_span    sprite_canvas_blend_span_sse2
+#else
+#define sprite_canvas_blend_span    sprite_canvas_blend_span_scalar
+#endif
+
+/* Lists the blend kernels that were compiled in, so tests can compare them. */
+uint32_t sprite_canvas_blend_kernels( const sprite_blend_kernel_t** kernels )
+{
+	assert( kernels );
+	*kernels = sprite_canvas_kernels;
+	return SPRITE_CANVAS_KERNEL_COUNT;
+}
+
+/*
+ * Fetches count pixels of a frame row into span, starting at column
+ * u of the scaled frame. Columns run backwards if the frame is
+ * flipped. 24-bit pixels become opaque.
+ */
+static void sprite_canvas_fetch( uint8_t* restrict span, const uint8_t* restrict row, uint16_t bytes_per_pixel, uint16_t width, uint32_t u, uint32_t count, uint32_t scale, bool flip )
+{
+	for( uint32_t i = 0; i < count; i++, u++ )
+	{
+		uint32_t column = u / scale;
+		const uint8_t* pixel = row + (flip ? width - 1 - column : column) * bytes_per_pixel;
+
+		span[ 4 * i + 0 ] = pixel[ 0 ];
+		span[ 4 * i + 1 ] = pixel[ 1 ];
+		span[ 4 * i + 2 ] = pixel[ 2 ];
+		span[ 4 * i + 3 ] = bytes_per_pixel == 4 ? pixel[ 3 ] : 255;
+	}
+}
+
+/*
+ * Sets up a canvas over width by height RGBA pixels, with rows pitch
+ * bytes apart, that clips to its bounds.
+ */
+void sprite_canvas_initialize( sprite_canvas_t* canvas, void* pixels, uint16_t width, uint16_t height, uint32_t pitch )
+{
+	assert( canvas );
+	assert( pixels || width == 0 || height == 0 );
+	assert( pitch >= 4u * width );
+
+	canvas->pixels      = pixels;
+	canvas->width       = width;
+	canvas->height      = height;
+	canvas->pitch       = pitch;
+	canvas->clip.x      = 0;
+	canvas->clip.y      = 0;
+	canvas->clip.width  = width;
+	canvas->clip.height = height;
+}
+
+/*
+ * Draws a frame of a sprite whose pixels are 24 or 32 bits. The frame
+ * is placed as if it were untrimmed, so trimmed and untrimmed frames
+ * line up, and a flipped frame is mirrored within its untrimmed
+ * bounds. Returns false if the sprite has no pixels that can be drawn,
+ * which includes pixels evicted by a cache, so atlases in a cache are
+ * pinned while they are drawn. A frame that lies outside of the clip
+ * rectangle is not an error.
+ */
+bool sprite_canvas_draw( const sprite_canvas_t* canvas, const sprite_draw_t* draw )
+{
+	assert( canvas );
+	assert( draw );
+	assert( draw->sprite );
+	assert( draw->frame );
+	const sprite_frame_t* frame = draw->frame;
+	const uint8_t* pixels       = sprite_pixels( draw->sprite );
+	uint16_t bytes_per_pixel    = sprite_bytes_per_pixel( draw->sprite );
+	uint32_t pitch              = sprite_pitch( draw->sprite );
+	uint32_t scale              = draw->scale > 1 ? draw->scale : 1;
+	bool flip                   = (draw->flags & SPRITE_DRAW_FLIP_X) != 0;
+	bool blend                  = (draw->flags & SPRITE_DRAW_BLEND) != 0;
+	uint8_t span[ 4 * SPRITE_CANVAS_SPAN ];
+
+	if( !pixels || (bytes_per_pixel != 3 && bytes_per_pixel != 4) )
+	{
+		return false;
+	}
+
+	/* canvas area of the trimmed frame */
+	int64_t left   = draw->x + (int64_t) scale * (flip ? frame->source_width - frame->offset_x - frame->width : frame->offset_x);
+	int64_t top    = draw->y + (int64_t) scale * frame->offset_y;
+	int64_t right  = left + (int64_t) scale * frame->width;
+	int64_t bottom = top + (int64_t) scale * frame->height;
+
+	int64_t x0 = left > canvas->clip.x ? left : canvas->clip.x;
+	int64_t y0 = top > canvas->clip.y ? top : canvas->clip.y;
+	int64_t x1 = canvas->clip.x + canvas->clip.width;
+	int64_t y1 = canvas->clip.y + canvas->clip.height;
+
+	x1 = x1 < canvas->width ? x1 : canvas->width;
+	y1 = y1 < canvas->height ? y1 : canvas->height;
+	x1 = x1 < right ? x1 : right;
+	y1 = y1 < bottom ? y1 : bottom;
+
+	if( x0 >= x1 || y0 >= y1 )
+	{
+		return true;
+	}
+
+	const uint8_t* frame_pixels = pixels + (size_t) frame->y * pitch + (size_t) frame->x * bytes_per_pixel;
+	bool in_place = bytes_per_pixel == 4 && scale == 1 && !flip;
+
+	for( int64_t x = x0; x < x1; x += SPRITE_CANVAS_SPAN )
+	{
+		uint32_t count   = x1 - x < SPRITE_CANVAS_SPAN ? (uint32_t) (x1 - x) : SPRITE_CANVAS_SPAN;
+		uint32_t u       = (uint32_t) (x - left);
+		uint32_t fetched = UINT32_MAX;
+
+		for( int64_t y = y0; y < y1; y++ )
+		{
+			uint32_t v        = (uint32_t) (y - top) / scale;
+			const uint8_t* row = frame_pixels + (size_t) v * pitch;
+			const uint8_t* src = span;
+			uint8_t* dst       = canvas->pixels + (size_t) y * canvas->pitch + (size_t) x * 4;
+
+			if( in_place )
+			{
+				src = row + (size_t) u * 4;
+			}
+			else if( v != fetched )
+			{
+				/* rows of a scaled frame repeat */
+				sprite_canvas_fetch( span, row, bytes_per_pixel, frame->width, u, count, scale, flip );
+				fetched = v;
+			}
+
+			if( blend )
+			{
+				sprite_canvas_blend_span( dst, src, count );
+			}
+			else
+			{
+				memcpy( dst, src, (size_t) count * 4 );
+			}
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Draws a list of frames in order, later frames over earlier ones.
+ * Returns how many of them could be drawn.
+ */
+uint32_t sprite_canvas_draw_list( const sprite_canvas_t* canvas, const sprite_draw_t* draws, uint32_t count )
+{
+	assert( canvas );
+	assert( draws || count == 0 );
+	uint32_t drawn = 0;
+
+	for( uint32_t i = 0; i < count; i++ )
+	{
+		drawn += sprite_canvas_draw( canvas, &draws[ i ] );
+	}
+
+	return drawn;
+}
@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2012 by Joseph A. Marrero.  http://www.manvscode.com/
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#define _POSIX_C_SOURCE 200112L /* clock_gettime() */
+#include <stdlib.h>
+#include <assert.h>
+#include <time.h>
+#include "sprite.h"
+#include "sprite-mem.h"
+#include "sprite-private.h"
+
+/*
+ * A clock is read once per tick and shared by every player bound to
+ * it, so players do not read a timer themselves. Each clock has its
+ * own time scale and can be paused, which makes it a natural group for
+ * things such as slow motion gameplay or a paused UI layer.
+ */
+struct sprite_clock {
+	sprite_timer_fxn_t source;   /* NULL for the monotonic clock */
+	sprite_time_t      last_raw; /* source reading of the last tick */
+	sprite_time_t      now;      /* scaled time */
+	sprite_time_t      delta;    /* scaled time that passed in the last tick */
+	uint32_t           scale;    /* 16.16 fixed point */
+	bool               is_paused;
+};
+
+#define SPRITE_CLOCK_SCALE_ONE    (1u << 16)
+
+/* Wall time that never jumps, unlike clock() which measures CPU time. */
+sprite_time_t sprite_monotonic_time( void )
+{
+	#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
+
+	if( clock_gettime( CLOCK_MONOTONIC, &ts ) == 0 )
+	{
+		return sprite_time_from_ms( (uint64_t) ts.tv_sec * 1000 ) +
+		       (((uint64_t) ts.tv_nsec << SPRITE_TIME_FRACTION_BITS) / 1000000);
+	}
+	#endif
+
+	return ((sprite_time_t) clock() << SPRITE_TIME_FRACTION_BITS) * 1000 / CLOCKS_PER_SEC;
+}
+
+static inline sprite_time_t sprite_clock_read( const sprite_clock_t* clock )
+{
+	return clock->source ? sprite_time_from_ms( clock->source( ) ) : sprite_monotonic_time( );
+}
+
+/*
+ * Creates a clock that reads the given timer, or the monotonic clock
+ * if source is NULL. The clock starts at time zero.
+ */
+sprite_clock_t* sprite_clock_create( sprite_timer_fxn_t source )
+{
+	sprite_clock_t* clock = sprite_alloc( sizeof(sprite_clock_t) );
+
+	if( clock )
+	{
+		clock->source    = source;
+		clock->last_raw  = sprite_clock_read( clock );
+		clock->now       = 0;
+		clock->delta     = 0;
+		clock->scale     = SPRITE_CLOCK_SCALE_ONE;
+		clock->is_paused = false;
+	}
+
+	return clock;
+}
+
+void sprite_clock_destroy( sprite_clock_t** clock )
+{
+	if( *clock )
+	{
+		sprite_free( *clock );
+		*clock = NULL;
+	}
+}
+
+/*
+ * Reads the source once and advances the clock by the scaled time
+ * that passed since the last tick. Call it once per frame, before
+ * the players bound to the clock are updated.
+ */
+void sprite_clock_tick( sprite_clock_t* clock )
+{
+	assert( clock );
+	sprite_time_t raw = sprite_clock_read( clock );
+
+	if( clock->source )
+	{
+		/* timers count milliseconds in 32 bits and may wrap */
+		clock->delta = sprite_time_from_ms( (uint32_t) (sprite_time_to_ms( raw ) - sprite_time_to_ms( clock->last_raw )) );
+	}
+	else
+	{
+		clock->delta = raw - clock->last_raw;
+	}
+
+	clock->last_raw = raw;
+
+	if( clock->is_paused )
+	{
+		clock->delta = 0;
+	}
+	else if( clock->scale != SPRITE_CLOCK_SCALE_ONE )
+	{
+		clock->delta = (clock->delta * clock->scale) >> 16;
+	}
+
+	clock->now += clock->delta;
+}
+
+/* Advances the clock by dt instead of reading its source, e.g. for fixed time steps. */
+void sprite_clock_advance( sprite_clock_t* clock, sprite_time_t dt )
+{
+	assert( clock );
+	clock->delta = clock->is_paused ? 0 : (dt * clock->scale) >> 16;
+	clock->now  += clock->delta;
+}
+
+sprite_time_t sprite_clock_now( const sprite_clock_t* clock )
+{
+	assert( clock );
+	return clock->now;
+}
+
+sprite_time_t sprite_clock_delta( const sprite_clock_t* clock )
+{
+	assert( clock );
+	return clock->delta;
+}
+
+/*
+ * A scale of 0.5 plays animations at half speed. The scale is stored
+ * with 16 fractional bits so that scaled time stays deterministic.
+ */
+void sprite_clock_set_scale( sprite_clock_t* clock, float scale )
+{
+	assert( clock );
+	assert( scale >= 0.0f );
+	clock->scale = (uint32_t) (scale * SPRITE_CLOCK_SCALE_ONE + 0.5f);
+}
+
+float sprite_clock_scale( const sprite_clock_t* clock )
+{
+	assert( clock );
+	return (float) clock->scale / SPRITE_CLOCK_SCALE_ONE;
+}
+
+void sprite_clock_pause( sprite_clock_t* clock )
+{
+	assert( clock );
+	clock->is_paused = true;
+}
+
+void sprite_clock_unpause( sprite_clock_t* clock )
+{
+	assert( clock );
+	clock->is_paused = false;
+}
+
+bool sprite_clock_is_paused( const sprite_clock_t* clock )
+{
+	assert( clock );
+	return clock->is_paused;
+}
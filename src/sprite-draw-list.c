@@ -0,0 +1,353 @@
+/*
+ * Copyright (C) 2012 by Joseph A. Marrero.  http://www.manvscode.com/
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "sprite.h"
+#include "sprite-mem.h"
+
+/*
+ * Draws are recorded in any order and submitted grouped by layer, then
+ * by atlas, then by depth, so a renderer binds each atlas once per
+ * layer. Each record gets a 64-bit key,
+ *
+ *   layer (8 bits) | atlas (16 bits) | depth (32 bits) | 0 (8 bits)
+ *
+ * and the keys are put in order with a least significant digit radix
+ * sort, one byte per pass. The sort is stable, so records with equal
+ * keys keep the order they were added in. Passes over bytes that are
+ * the same in every key, such as the layer when only one is used, are
+ * skipped.
+ *
+ * Atlases are numbered in the order they first appear in the list, so
+ * the groups of a layer follow that order.
+ */
+#define SPRITE_DRAW_LIST_MAX_ATLASES    4096
+#define SPRITE_DRAW_LIST_ATLAS_SLOTS    (2 * SPRITE_DRAW_LIST_MAX_ATLASES) /* a power of two */
+#define SPRITE_DRAW_LIST_RADIX          256
+
+struct sprite_draw_list {
+	uint32_t capacity;
+	uint32_t count;
+	bool     is_sorted;
+
+	sprite_render_item_t* items;
+	uint64_t*             keys;         /* of the records, in the order they were added */
+	uint64_t*             keys_sorted;
+	uint64_t*             keys_scratch;
+	uint32_t*             order;        /* records in submission order */
+	uint32_t*             order_scratch;
+
+	/* open addressed table of the atlases in the list */
+	uint32_t              atlas_count;
+	const sprite_atlas_t* atlases[ SPRITE_DRAW_LIST_ATLAS_SLOTS ];
+	uint16_t              atlas_ids[ SPRITE_DRAW_LIST_ATLAS_SLOTS ]; /* id + 1, 0 for an empty slot */
+	uint16_t              atlas_slots[ SPRITE_DRAW_LIST_MAX_ATLASES ]; /* slot of each id */
+};
+
+sprite_draw_list_t* sprite_draw_list_create( uint32_t capacity )
+{
+	sprite_draw_list_t* list = sprite_alloc( sizeof(sprite_draw_list_t) );
+
+	if( list )
+	{
+		memset( list, 0, sizeof(sprite_draw_list_t) );
+		list->capacity  = capacity;
+		list->is_sorted = true;
+
+		if( !(list->items = sprite_alloc( sizeof(sprite_render_item_t) * capacity )) ||
+		    !(list->keys = sprite_alloc( sizeof(uint64_t) * capacity )) ||
+		    !(list->keys_sorted = sprite_alloc( sizeof(uint64_t) * capacity )) ||
+		    !(list->keys_scratch = sprite_alloc( sizeof(uint64_t) * capacity )) ||
+		    !(list->order = sprite_alloc( sizeof(uint32_t) * capacity )) ||
+		    !(list->order_scratch = sprite_alloc( sizeof(uint32_t) * capacity )) )
+		{
+			sprite_draw_list_destroy( &list );
+		}
+	}
+
+	return list;
+}
+
+void sprite_draw_list_destroy( sprite_draw_list_t** list )
+{
+	if( *list )
+	{
+		sprite_free( (*list)->items );
+		sprite_free( (*list)->keys );
+		sprite_free( (*list)->keys_sorted );
+		sprite_free( (*list)->keys_scratch );
+		sprite_free( (*list)->order );
+		sprite_free( (*list)->order_scratch );
+		sprite_free( *list );
+		*list = NULL;
+	}
+}
+
+/* Call once the draws of a frame have been submitted. */
+void sprite_draw_list_clear( sprite_draw_list_t* list )
+{
+	assert( list );
+
+	for( uint32_t id = 0; id < list->atlas_count; id++ )
+	{
+		list->atlas_ids[ list->atlas_slots[ id ] ] = 0;
+	}
+
+	list->atlas_count = 0;
+	list->count       = 0;
+	list->is_sorted   = true;
+}
+
+uint32_t sprite_draw_list_count( const sprite_draw_list_t* list )
+{
+	return list ? list->count : 0;
+}
+
+/* Returns the atlas' number, or -1 if the list has too many atlases. */
+static int32_t sprite_draw_list_atlas( sprite_draw_list_t* list, const sprite_atlas_t* atlas )
+{
+	uint32_t slot = (uint32_t) (((uintptr_t) atlas >> 4) * 2654435761u) & (SPRITE_DRAW_LIST_ATLAS_SLOTS - 1);
+
+	while( list->atlas_ids[ slot ] )
+	{
+		if( list->atlases[ slot ] == atlas )
+		{
+			return list->atlas_ids[ slot ] - 1;
+		}
+
+		slot = (slot + 1) & (SPRITE_DRAW_LIST_ATLAS_SLOTS - 1);
+	}
+
+	if( list->atlas_count >= SPRITE_DRAW_LIST_MAX_ATLASES )
+	{
+		return -1;
+	}
+
+	list->atlases[ slot ]                   = atlas;
+	list->atlas_ids[ slot ]                 = (uint16_t) (list->atlas_count + 1);
+	list->atlas_slots[ list->atlas_count ]  = (uint16_t) slot;
+	return (int32_t) list->atlas_count++;
+}
+
+/*
+ * Maps a float to an integer that sorts in the same order. -0 becomes
+ * +0 first, so that depths that compare equal get equal keys.
+ */
+static inline uint32_t sprite_draw_list_depth( float depth )
+{
+	uint32_t bits;
+
+	if( depth == 0.0f )
+	{
+		depth = 0.0f;
+	}
+
+	memcpy( &bits, &depth, sizeof(bits) );
+	return bits & 0x80000000u ? ~bits : bits | 0x80000000u;
+}
+
+/*
+ * Records a frame to draw. Lower layers are submitted first, and
+ * within a layer and atlas, lower depths are. Returns false if the
+ * list is full or holds frames from too many atlases.
+ */
+bool sprite_draw_list_add( sprite_draw_list_t* list, const sprite_t* sprite, const sprite_frame_t* frame, const void* user_data, uint8_t layer, float depth )
+{
+	assert( list );
+	assert( sprite );
+
+	if( list->count >= list->capacity )
+	{
+		return false;
+	}
+
+	int32_t atlas = sprite_draw_list_atlas( list, sprite_atlas( sprite ) );
+
+	if( atlas < 0 )
+	{
+		return false;
+	}
+
+	uint32_t index = list->count++;
+
+	list->items[ index ].user_data = user_data;
+	list->items[ index ].sprite    = sprite;
+	list->items[ index ].frame     = frame;
+	list->keys[ index ]            = ((uint64_t) layer << 56) | ((uint64_t) atlas << 40) | ((uint64_t) sprite_draw_list_depth( depth ) << 8);
+	list->is_sorted                = false;
+
+	return true;
+}
+
+/* Puts the records in submission order. */
+void sprite_draw_list_sort( sprite_draw_list_t* list )
+{
+	assert( list );
+	uint32_t counts[ 8 ][ SPRITE_DRAW_LIST_RADIX ];
+	uint32_t count = list->count;
+
+	if( list->is_sorted )
+	{
+		return;
+	}
+
+	/* every pass' histogram in one read of the keys */
+	memset( counts, 0, sizeof(counts) );
+
+	for( uint32_t i = 0; i < count; i++ )
+	{
+		uint64_t key = list->keys[ i ];
+
+		for( uint32_t pass = 0; pass < 8; pass++ )
+		{
+			counts[ pass ][ (key >> (8 * pass)) & 0xFF ]++;
+		}
+	}
+
+	/* the first pass reads the keys in the order they were added */
+	const uint64_t* keys  = list->keys;
+	const uint32_t* order = NULL;
+	uint64_t* keys_out    = list->keys_sorted;
+	uint32_t* order_out   = list->order;
+
+	for( uint32_t pass = 0; pass < 8; pass++ )
+	{
+		uint32_t* histogram = counts[ pass ];
+		uint32_t shift      = 8 * pass;
+
+		if( count == 0 || histogram[ (keys[ 0 ] >> shift) & 0xFF ] == count )
+		{
+			continue;
+		}
+
+		uint32_t offset = 0;
+
+		for( uint32_t digit = 0; digit < SPRITE_DRAW_LIST_RADIX; digit++ )
+		{
+			uint32_t n = histogram[ digit ];
+			histogram[ digit ] = offset;
+			offset += n;
+		}
+
+		for( uint32_t i = 0; i < count; i++ )
+		{
+			uint32_t position = histogram[ (keys[ i ] >> shift) & 0xFF ]++;
+
+			keys_out[ position ]  = keys[ i ];
+			order_out[ position ] = order ? order[ i ] : i;
+		}
+
+		uint64_t* next_keys  = keys_out == list->keys_sorted ? list->keys_scratch : list->keys_sorted;
+		uint32_t* next_order = order_out == list->order ? list->order_scratch : list->order;
+		keys      = keys_out;
+		order     = order_out;
+		keys_out  = next_keys;
+		order_out = next_order;
+	}
+
+	if( !order )
+	{
+		/* every key is the same */
+		for( uint32_t i = 0; i < count; i++ )
+		{
+			list->order[ i ] = i;
+		}
+	}
+	else if( order != list->order )
+	{
+		list->order_scratch = list->order;
+		list->order         = (uint32_t*) order;
+	}
+
+	list->is_sorted = true;
+}
+
+/*
+ * Indices of the records, in the order they were added, in submission
+ * order. Sorts the list first if needed.
+ */
+const uint32_t* sprite_draw_list_order( sprite_draw_list_t* list )
+{
+	sprite_draw_list_sort( list );
+	return list->order;
+}
+
+/* The record that was added index-th. */
+const sprite_render_item_t* sprite_draw_list_item( const sprite_draw_list_t* list, uint32_t index )
+{
+	assert( list );
+	assert( index < list->count );
+	return &list->items[ index ];
+}
+
+/*
+ * Sorts the list and hands its records to render in submission order,
+ * in batches of up to capacity items, using items as the batch buffer.
+ * A batch never mixes layers or atlases, so each can be drawn with its
+ * atlas bound once.
+ */
+void sprite_draw_list_render( sprite_draw_list_t* list, sprite_render_item_t* items, uint32_t capacity, sprite_render_batch_fxn_t render, void* context )
+{
+	assert( list );
+	assert( items );
+	assert( capacity > 0 );
+	assert( render );
+	uint32_t size = 0;
+
+	sprite_draw_list_sort( list );
+
+	for( uint32_t i = 0; i < list->count; i++ )
+	{
+		uint32_t index = list->order[ i ];
+
+		if( size > 0 && (list->keys[ index ] >> 40) != (list->keys[ list->order[ i - 1 ] ] >> 40) )
+		{
+			render( context, items, size );
+			size = 0;
+		}
+
+		items[ size ] = list->items[ index ];
+
+		if( ++size == capacity )
+		{
+			render( context, items, size );
+			size = 0;
+		}
+	}
+
+	if( size > 0 )
+	{
+		render( context, items, size );
+	}
+}
+
+void sprite_draw_list_memory_usage( const sprite_draw_list_t* list, sprite_memory_t* usage )
+{
+	assert( list );
+	assert( usage );
+
+	memset( usage, 0, sizeof(sprite_memory_t) );
+	usage->players     = sizeof(sprite_draw_list_t) + (sizeof(sprite_render_item_t) + 3 * sizeof(uint64_t) + 2 * sizeof(uint32_t)) * list->capacity;
+	usage->total       = usage->players;
+	usage->allocations = 7;
+}
@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2012 by Joseph A. Marrero.  http://www.manvscode.com/
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include "sprite.h"
+#include "sprite-mem.h"
+#include "sprite-private.h"
+
+/*
+ * Players append events to a buffer instead of being polled. The
+ * buffer has a fixed capacity so that appending never allocates;
+ * events that do not fit are counted as dropped.
+ */
+struct sprite_events {
+	uint32_t       capacity;
+	uint32_t       count;
+	uint32_t       dropped;
+	sprite_event_t events[];
+};
+
+sprite_events_t* sprite_events_create( uint32_t capacity )
+{
+	sprite_events_t* events = sprite_alloc( sizeof(sprite_events_t) + sizeof(sprite_event_t) * capacity );
+
+	if( events )
+	{
+		events->capacity = capacity;
+		events->count    = 0;
+		events->dropped  = 0;
+	}
+
+	return events;
+}
+
+void sprite_events_destroy( sprite_events_t** events )
+{
+	if( *events )
+	{
+		sprite_free( *events );
+		*events = NULL;
+	}
+}
+
+/* Call once the events of a tick have been handled. */
+void sprite_events_clear( sprite_events_t* events )
+{
+	assert( events );
+	events->count   = 0;
+	events->dropped = 0;
+}
+
+uint32_t sprite_events_count( const sprite_events_t* events )
+{
+	return events ? events->count : 0;
+}
+
+const sprite_event_t* sprite_events_get( const sprite_events_t* events )
+{
+	return events ? events->events : NULL;
+}
+
+uint32_t sprite_events_dropped( const sprite_events_t* events )
+{
+	return events ? events->dropped : 0;
+}
+
+static inline void sprite_events_push( sprite_events_t* events, uint8_t type, uint16_t frame, uint32_t player, uint32_t value, const void* user_data )
+{
+	if( events->count < events->capacity )
+	{
+		sprite_event_t* e = &events->events[ events->count++ ];
+
+		e->type      = type;
+		e->frame     = frame;
+		e->player    = player;
+		e->value     = value;
+		e->user_data = user_data;
+	}
+	else
+	{
+		events->dropped++;
+	}
+}
+
+/*
+ * Reports a player moving from frame from to frame to after wrapping
+ * around loops times. A from of -1 reports a state that just started.
+ * Every tagged frame passed on the way is reported once, even when
+ * several loops passed in one update.
+ */
+void sprite_events_emit( sprite_events_t* events, const sprite_state_t* state, uint32_t player, const void* user_data,
+                         int32_t from, uint16_t to, uint32_t loops, bool finished )
+{
+	uint16_t frame_count = sprite_state_frame_count( state );
+	const uint32_t* tags = sprite_state_tags( state );
+	uint64_t passed      = (uint64_t) loops * frame_count + to - from;
+
+	if( loops > 0 )
+	{
+		sprite_events_push( events, SPRITE_EVENT_LOOP, to, player, loops, user_data );
+	}
+
+	if( tags )
+	{
+		int32_t frame = from;
+
+		for( uint64_t i = 0; i < passed && i < frame_count; i++ )
+		{
+			frame = frame + 1 < frame_count ? frame + 1 : 0;
+
+			if( tags[ frame ] )
+			{
+				sprite_events_push( events, SPRITE_EVENT_TAG, frame, player, tags[ frame ], user_data );
+			}
+		}
+	}
+
+	if( passed > 0 )
+	{
+		sprite_events_push( events, SPRITE_EVENT_FRAME, to, player, 0, user_data );
+	}
+
+	if( finished )
+	{
+		sprite_events_push( events, SPRITE_EVENT_FINISHED, to, player, 0, user_data );
+	}
+}
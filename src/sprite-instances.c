@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2012 by Joseph A. Marrero.  http://www.manvscode.com/
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include "sprite.h"
+
+/*
+ * Instances are written a block at a time. The frame of each instance
+ * is looked up first, with mirroring resolved into the trim offset and
+ * the order of the texture coordinates. The quads of the whole block
+ * are then computed in one pass over plain float arrays, which the
+ * compiler vectorizes, and finally stored in the caller's format.
+ */
+#define SPRITE_INSTANCES_BLOCK    256
+#define SPRITE_INSTANCES_CHUNK    4096 /* instances per chunk of a parallel write, a multiple of the block */
+
+typedef struct sprite_instances_block {
+	/* from the frames */
+	float offset_x[ SPRITE_INSTANCES_BLOCK ];
+	float offset_y[ SPRITE_INSTANCES_BLOCK ];
+	float width[ SPRITE_INSTANCES_BLOCK ];
+	float height[ SPRITE_INSTANCES_BLOCK ];
+
+	/* attributes */
+	float position[ 2 ][ SPRITE_INSTANCES_BLOCK ];
+	float size[ 2 ][ SPRITE_INSTANCES_BLOCK ];
+	float uv[ 4 ][ SPRITE_INSTANCES_BLOCK ];
+} sprite_instances_block_t;
+
+typedef struct sprite_instances_job {
+	const sprite_instance_format_t* format;
+	const sprite_instances_t*       instances;
+	uint32_t                        count;
+	uint8_t*                        buffer;
+	uint32_t                        chunk_size;
+} sprite_instances_job_t;
+
+static void sprite_instances_fetch( sprite_instances_block_t* block, const sprite_instances_t* instances, uint32_t first, uint32_t count )
+{
+	for( uint32_t i = 0; i < count; i++ )
+	{
+		const sprite_frame_t* frame = instances->frames[ first + i ];
+
+		if( !frame )
+		{
+			block->offset_x[ i ] = 0.0f;
+			block->offset_y[ i ] = 0.0f;
+			block->width[ i ]    = 0.0f;
+			block->height[ i ]   = 0.0f;
+			block->uv[ 0 ][ i ]  = 0.0f;
+			block->uv[ 1 ][ i ]  = 0.0f;
+			block->uv[ 2 ][ i ]  = 0.0f;
+			block->uv[ 3 ][ i ]  = 0.0f;
+			continue;
+		}
+
+		const sprite_t* sprite = instances->sprites[ first + i ];
+		uint16_t texture_width  = sprite_width( sprite );
+		uint16_t texture_height = sprite_height( sprite );
+		float inverse_width     = texture_width > 0 ? 1.0f / texture_width : 0.0f;
+		float inverse_height    = texture_height > 0 ? 1.0f / texture_height : 0.0f;
+		float left              = frame->x * inverse_width;
+		float right             = (frame->x + frame->width) * inverse_width;
+		bool mirrored           = instances->orientation && instances->orientation[ first + i ] < 1;
+
+		block->offset_x[ i ] = mirrored ? frame->source_width - frame->offset_x - frame->width : frame->offset_x;
+		block->offset_y[ i ] = frame->offset_y;
+		block->width[ i ]    = frame->width;
+		block->height[ i ]   = frame->height;
+		block->uv[ 0 ][ i ]  = mirrored ? right : left;
+		block->uv[ 1 ][ i ]  = frame->y * inverse_height;
+		block->uv[ 2 ][ i ]  = mirrored ? left : right;
+		block->uv[ 3 ][ i ]  = (frame->y + frame->height) * inverse_height;
+	}
+}
+
+static void sprite_instances_compute( sprite_instances_block_t* restrict block, const float* restrict x, const float* restrict y, const float* restrict scale, uint32_t count )
+{
+	if( scale )
+	{
+		for( uint32_t i = 0; i < count; i++ )
+		{
+			block->position[ 0 ][ i ] = x[ i ] + scale[ i ] * block->offset_x[ i ];
+			block->position[ 1 ][ i ] = y[ i ] + scale[ i ] * block->offset_y[ i ];
+			block->size[ 0 ][ i ]     = scale[ i ] * block->width[ i ];
+			block->size[ 1 ][ i ]     = scale[ i ] * block->height[ i ];
+		}
+	}
+	else
+	{
+		for( uint32_t i = 0; i < count; i++ )
+		{
+			block->position[ 0 ][ i ] = x[ i ] + block->offset_x[ i ];
+			block->position[ 1 ][ i ] = y[ i ] + block->offset_y[ i ];
+			block->size[ 0 ][ i ]     = block->width[ i ];
+			block->size[ 1 ][ i ]     = block->height[ i ];
+		}
+	}
+}
+
+/* Stores component i of count instances, whose values are values[ component ][ i ]. */
+static void sprite_instances_store( uint8_t* buffer, uint32_t stride, uint8_t type, float (*values)[ SPRITE_INSTANCES_BLOCK ], uint32_t components, uint32_t count )
+{
+	switch( type )
+	{
+		case SPRITE_COMPONENT_FLOAT:
+			for( uint32_t i = 0; i < count; i++, buffer += stride )
+			{
+				for( uint32_t c = 0; c < components; c++ )
+				{
+					memcpy( buffer + c * sizeof(float), &values[ c ][ i ], sizeof(float) );
+				}
+			}
+			break;
+		case SPRITE_COMPONENT_INT16:
+			for( uint32_t i = 0; i < count; i++, buffer += stride )
+			{
+				for( uint32_t c = 0; c < components; c++ )
+				{
+					float value   = values[ c ][ i ];
+					int16_t store = value <= INT16_MIN ? INT16_MIN : value >= INT16_MAX ? INT16_MAX : (int16_t) lrintf( value );
+					memcpy( buffer + c * sizeof(int16_t), &store, sizeof(int16_t) );
+				}
+			}
+			break;
+		case SPRITE_COMPONENT_UNORM16:
+			for( uint32_t i = 0; i < count; i++, buffer += stride )
+			{
+				for( uint32_t c = 0; c < components; c++ )
+				{
+					float value    = values[ c ][ i ];
+					uint16_t store = value <= 0.0f ? 0 : value >= 1.0f ? UINT16_MAX : (uint16_t) (value * UINT16_MAX + 0.5f);
+					memcpy( buffer + c * sizeof(uint16_t), &store, sizeof(uint16_t) );
+				}
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+static void sprite_instances_write_range( const sprite_instance_format_t* format, const sprite_instances_t* instances, uint32_t first, uint32_t end, uint8_t* buffer )
+{
+	sprite_instances_block_t block;
+
+	for( ; first < end; first += SPRITE_INSTANCES_BLOCK )
+	{
+		uint32_t count = end - first < SPRITE_INSTANCES_BLOCK ? end - first : SPRITE_INSTANCES_BLOCK;
+		uint8_t* out   = buffer + (size_t) first * format->stride;
+
+		sprite_instances_fetch( &block, instances, first, count );
+		sprite_instances_compute( &block, instances->x + first, instances->y + first, instances->scale ? instances->scale + first : NULL, count );
+
+		sprite_instances_store( out + format->attributes[ SPRITE_ATTRIBUTE_POSITION ].offset, format->stride, format->attributes[ SPRITE_ATTRIBUTE_POSITION ].component, block.position, 2, count );
+		sprite_instances_store( out + format->attributes[ SPRITE_ATTRIBUTE_SIZE ].offset, format->stride, format->attributes[ SPRITE_ATTRIBUTE_SIZE ].component, block.size, 2, count );
+		sprite_instances_store( out + format->attributes[ SPRITE_ATTRIBUTE_UV ].offset, format->stride, format->attributes[ SPRITE_ATTRIBUTE_UV ].component, block.uv, 4, count );
+	}
+}
+
+/*
+ * Writes one instance per sprite into buffer, format->stride bytes
+ * apart, with the attributes the format asks for. The buffer can be
+ * uploaded as is and drawn with one instanced draw of a unit quad for
+ * each texture.
+ */
+void sprite_instances_write( const sprite_instance_format_t* format, const sprite_instances_t* instances, uint32_t count, void* buffer )
+{
+	assert( format );
+	assert( instances );
+	assert( buffer || count == 0 );
+	sprite_instances_write_range( format, instances, 0, count, buffer );
+}
+
+static void sprite_instances_write_chunk( void* job, uint32_t chunk )
+{
+	const sprite_instances_job_t* write = job;
+	uint32_t first = chunk * write->chunk_size;
+	uint32_t end   = write->count - first < write->chunk_size ? write->count : first + write->chunk_size;
+
+	sprite_instances_write_range( write->format, write->instances, first, end, write->buffer );
+}
+
+/*
+ * Like sprite_instances_write, but the instances are split into chunks
+ * of chunk_size instances (0 for a default) and dispatched, for example
+ * with sprite_workers_dispatch. A NULL dispatch writes the chunks in
+ * turn.
+ */
+void sprite_instances_write_parallel( const sprite_instance_format_t* format, const sprite_instances_t* instances, uint32_t count, void* buffer,
+                                      uint32_t chunk_size, sprite_dispatch_fxn_t dispatch, void* context )
+{
+	assert( format );
+	assert( instances );
+	assert( buffer || count == 0 );
+	sprite_instances_job_t job;
+
+	if( chunk_size == 0 )
+	{
+		chunk_size = SPRITE_INSTANCES_CHUNK;
+	}
+
+	job.format     = format;
+	job.instances  = instances;
+	job.count      = count;
+	job.buffer     = buffer;
+	job.chunk_size = (chunk_size + SPRITE_INSTANCES_BLOCK - 1) & ~(SPRITE_INSTANCES_BLOCK - 1);
+
+	uint32_t chunk_count = (uint32_t) (((uint64_t) count + job.chunk_size - 1) / job.chunk_size);
+
+	if( dispatch )
+	{
+		dispatch( context, sprite_instances_write_chunk, &job, chunk_count );
+	}
+	else
+	{
+		for( uint32_t chunk = 0; chunk < chunk_count; chunk++ )
+		{
+			sprite_instances_write_chunk( &job, chunk );
+		}
+	}
+}
@@ -20,14 +20,110 @@
  * THE SOFTWARE.
  */
 #include <stdlib.h>
+#include <string.h>
 #include "sprite.h"
+#include "sprite-mem.h"
 
-sprite_alloc_fxn_t sprite_alloc = malloc;
-sprite_free_fxn_t  sprite_free  = free;
+/*
+ * Every allocation is prefixed with a small header that remembers the
+ * requested size so that frees can be accounted for. The header is
+ * large enough to keep the returned pointer suitably aligned.
+ */
+#define SPRITE_MEM_HEADER_SIZE   (16)
+
+static sprite_alloc_fxn_t alloc_fxn = malloc;
+static sprite_free_fxn_t  free_fxn  = free;
+
+static sprite_mem_stats_t stats = { 0, 0, 0, 0 };
 
 void sprite_mem_set_fxns( sprite_alloc_fxn_t alloc, sprite_free_fxn_t free )
 {
-	sprite_alloc = alloc;
-	sprite_free  = free;
+	alloc_fxn = alloc;
+	free_fxn  = free;
+}
+
+void sprite_mem_stats( sprite_mem_stats_t* s )
+{
+	*s = stats;
+}
+
+void* sprite_alloc( size_t size )
+{
+	unsigned char* block = alloc_fxn( size + SPRITE_MEM_HEADER_SIZE );
+
+	if( !block )
+	{
+		return NULL;
+	}
+
+	*(size_t*) block = size;
+
+	stats.bytes_in_use += size;
+	stats.allocations++;
+
+	if( stats.bytes_in_use > stats.peak_bytes )
+	{
+		stats.peak_bytes = stats.bytes_in_use;
+	}
+
+	return block + SPRITE_MEM_HEADER_SIZE;
+}
+
+void sprite_free( void* ptr )
+{
+	if( ptr )
+	{
+		unsigned char* block = (unsigned char*) ptr - SPRITE_MEM_HEADER_SIZE;
+
+		stats.bytes_in_use -= *(size_t*) block;
+		stats.frees++;
+
+		free_fxn( block );
+	}
+}
+
+/*
+ * Aligned blocks keep a pointer to the underlying allocation just
+ * before the aligned address. The alignment must be a power of 2.
+ */
+void* sprite_alloc_aligned( size_t size, size_t alignment )
+{
+	if( alignment < sizeof(void*) )
+	{
+		alignment = sizeof(void*);
+	}
+
+	unsigned char* block = sprite_alloc( size + alignment + sizeof(void*) );
+
+	if( !block )
+	{
+		return NULL;
+	}
+
+	uintptr_t aligned = ((uintptr_t) (block + sizeof(void*)) + alignment - 1) & ~((uintptr_t) alignment - 1);
+	((void**) aligned)[ -1 ] = block;
+
+	return (void*) aligned;
+}
+
+void sprite_free_aligned( void* ptr )
+{
+	if( ptr )
+	{
+		sprite_free( ((void**) ptr)[ -1 ] );
+	}
+}
+
+char* sprite_strdup( const char* s )
+{
+	size_t size = strlen( s ) + 1;
+	char* copy  = sprite_alloc( size );
+
+	if( copy )
+	{
+		memcpy( copy, s, size );
+	}
+
+	return copy;
 }
 
@@ -29,8 +29,12 @@ extern "C" {
 #include "sprite.h"
 
 
-extern sprite_alloc_fxn_t sprite_alloc;
-extern sprite_free_fxn_t  sprite_free;
+void* sprite_alloc  ( size_t size );
+void  sprite_free   ( void* ptr );
+char* sprite_strdup ( const char* s );
+
+void* sprite_alloc_aligned ( size_t size, size_t alignment );
+void  sprite_free_aligned  ( void* ptr );
 
 
 #ifdef __cplusplus
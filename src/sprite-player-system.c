@@ -0,0 +1,1030 @@
+/*
+ * Copyright (C) 2012 by Joseph A. Marrero.  http://www.manvscode.com/
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include "sprite.h"
+#include "sprite-mem.h"
+#include "sprite-private.h"
+
+/*
+ * A player system advances many animations in one call. Every
+ * player's state lives in parallel arrays indexed by the player's
+ * index, so that an update only streams through the arrays it needs:
+ * the expiry times and play flags are scanned for every player, while
+ * states and frames are only touched for players whose frame changes.
+ *
+ * Players are referred to by handles. A handle names a slot and the
+ * slot's generation, which changes every time the slot is freed, so a
+ * handle to a removed player is detected instead of reaching whichever
+ * player reused the slot. Slots map to the dense index of their player;
+ * free slots form a list, so adding and removing players is O(1) and
+ * never allocates.
+ *
+ * Playing players are also filed in a timing wheel under the
+ * millisecond at which their frame expires, one bucket per millisecond
+ * of the wheel's span. An update only walks the buckets of the time
+ * that passed, so its cost follows the number of frame changes rather
+ * than the number of players. Players that expire further ahead than
+ * the span share buckets with nearer ones and are passed over until
+ * they are due.
+ */
+#define SPRITE_PLAYER_HANDLE_SLOT_BITS      20
+#define SPRITE_PLAYER_HANDLE_SLOT_MASK      ((1u << SPRITE_PLAYER_HANDLE_SLOT_BITS) - 1)
+#define SPRITE_PLAYER_HANDLE_GENERATIONS    (1u << (32 - SPRITE_PLAYER_HANDLE_SLOT_BITS))
+
+#define sprite_player_handle( slot, generation )   (((uint32_t) (generation) << SPRITE_PLAYER_HANDLE_SLOT_BITS) | (slot))
+#define sprite_player_handle_slot( handle )        ((handle) & SPRITE_PLAYER_HANDLE_SLOT_MASK)
+#define sprite_player_handle_generation( handle )  ((handle) >> SPRITE_PLAYER_HANDLE_SLOT_BITS)
+
+#define SPRITE_PLAYER_WHEEL_SIZE    1024 /* milliseconds, a power of two */
+#define SPRITE_PLAYER_WHEEL_MASK    (SPRITE_PLAYER_WHEEL_SIZE - 1)
+#define SPRITE_PLAYER_NONE          UINT32_MAX
+
+struct sprite_player_system {
+	uint32_t capacity;
+	uint32_t count;
+	uint32_t now;         /* time of the last update, in milliseconds */
+	sprite_events_t* events;
+
+	/* handles */
+	uint32_t  free_slot;   /* head of the free list, capacity if empty */
+	uint32_t* slots;       /* dense index of a live slot, next free slot otherwise */
+	uint16_t* generation;  /* per slot, never 0 */
+	uint32_t* dense_slot;  /* slot of each player */
+
+	/* timing wheel, linked by slot */
+	uint32_t* wheel;       /* first slot of each bucket */
+	uint32_t* wheel_next;
+	uint32_t* wheel_prev;  /* capacity + bucket for the first slot, NONE if not filed */
+
+	/* read by every update */
+	uint32_t* frame_end;  /* time at which the current frame expires */
+	uint8_t*  playing;
+	uint8_t*  due;        /* scratch, players whose frame expired */
+
+	/* scratch, events of the last update */
+	uint16_t* from_frame;
+	uint32_t* loops_passed;
+
+	/* touched when a frame changes */
+	uint16_t*              frame_index;
+	uint16_t*              loops_left; /* 0 if the state loops forever */
+	uint32_t*              loop_start; /* time at which the current loop started */
+	const sprite_state_t** state;
+	const sprite_state_t** next_state; /* waiting for the end of the loop, NULL if none */
+	const sprite_t**       sprite;
+	void**                 user_data;
+
+	#ifdef SPRITE_TELEMETRY
+	sprite_telemetry_t telemetry;
+	uint32_t*          shown_at; /* time at which the current frame appeared */
+	#endif
+};
+
+#define sprite_player_system_array( sys, name )   ((sys)->name = sprite_alloc_aligned( sizeof(*(sys)->name) * (sys)->capacity, SPRITE_PIXEL_ALIGNMENT ))
+
+static void sprite_player_system_locate( sprite_player_system_t* sys, uint32_t index, uint32_t now, int32_t from );
+static void sprite_player_system_start( sprite_player_system_t* sys, uint32_t index, const sprite_state_t* state );
+
+/*
+ * Updates are split into chunks of players whose size is a multiple
+ * of the array alignment, so no two chunks share a cache line.
+ */
+#define SPRITE_PLAYER_SYSTEM_CHUNK    4096
+
+typedef struct sprite_player_system_job {
+	sprite_player_system_t* sys;
+	uint32_t now;
+	uint32_t chunk_size;
+} sprite_player_system_job_t;
+
+enum sprite_player_system_due {
+	SPRITE_PLAYER_NOT_DUE  = 0,
+	SPRITE_PLAYER_CHANGED  = 1,
+	SPRITE_PLAYER_FINISHED = 2,
+	SPRITE_PLAYER_MOVED    = 3, /* nothing to report */
+};
+
+#define SPRITE_PLAYER_STARTED    UINT16_MAX /* from_frame of a player that started a new state */
+
+
+sprite_player_system_t* sprite_player_system_create( uint32_t capacity )
+{
+	if( capacity > SPRITE_PLAYER_HANDLE_SLOT_MASK )
+	{
+		return NULL;
+	}
+
+	sprite_player_system_t* sys = sprite_alloc( sizeof(sprite_player_system_t) );
+
+	if( sys )
+	{
+		memset( sys, 0, sizeof(sprite_player_system_t) );
+		sys->capacity = capacity;
+
+		if( !sprite_player_system_array( sys, slots ) ||
+		    !sprite_player_system_array( sys, generation ) ||
+		    !sprite_player_system_array( sys, dense_slot ) ||
+		    !sprite_player_system_array( sys, wheel_next ) ||
+		    !sprite_player_system_array( sys, wheel_prev ) ||
+		    !(sys->wheel = sprite_alloc_aligned( sizeof(uint32_t) * SPRITE_PLAYER_WHEEL_SIZE, SPRITE_PIXEL_ALIGNMENT )) ||
+		    !sprite_player_system_array( sys, frame_end ) ||
+		    !sprite_player_system_array( sys, playing ) ||
+		    !sprite_player_system_array( sys, due ) ||
+		    !sprite_player_system_array( sys, from_frame ) ||
+		    !sprite_player_system_array( sys, loops_passed ) ||
+		    !sprite_player_system_array( sys, frame_index ) ||
+		    !sprite_player_system_array( sys, loops_left ) ||
+		    !sprite_player_system_array( sys, loop_start ) ||
+		    !sprite_player_system_array( sys, state ) ||
+		    !sprite_player_system_array( sys, next_state ) ||
+		    !sprite_player_system_array( sys, sprite ) ||
+		    !sprite_player_system_array( sys, user_data )
+		    #ifdef SPRITE_TELEMETRY
+		    || !sprite_player_system_array( sys, shown_at )
+		    #endif
+		  )
+		{
+			sprite_player_system_destroy( &sys );
+			return NULL;
+		}
+
+		for( uint32_t slot = 0; slot < capacity; slot++ )
+		{
+			sys->slots[ slot ]      = slot + 1;
+			sys->generation[ slot ] = 1;
+			sys->wheel_prev[ slot ] = SPRITE_PLAYER_NONE;
+		}
+
+		for( uint32_t bucket = 0; bucket < SPRITE_PLAYER_WHEEL_SIZE; bucket++ )
+		{
+			sys->wheel[ bucket ] = SPRITE_PLAYER_NONE;
+		}
+
+		sys->free_slot = 0;
+	}
+
+	return sys;
+}
+
+void sprite_player_system_destroy( sprite_player_system_t** sys )
+{
+	if( *sys )
+	{
+		sprite_free_aligned( (*sys)->slots );
+		sprite_free_aligned( (*sys)->generation );
+		sprite_free_aligned( (*sys)->dense_slot );
+		sprite_free_aligned( (*sys)->wheel );
+		sprite_free_aligned( (*sys)->wheel_next );
+		sprite_free_aligned( (*sys)->wheel_prev );
+		sprite_free_aligned( (*sys)->frame_end );
+		sprite_free_aligned( (*sys)->playing );
+		sprite_free_aligned( (*sys)->due );
+		sprite_free_aligned( (*sys)->from_frame );
+		sprite_free_aligned( (*sys)->loops_passed );
+		sprite_free_aligned( (*sys)->frame_index );
+		sprite_free_aligned( (*sys)->loops_left );
+		sprite_free_aligned( (*sys)->loop_start );
+		sprite_free_aligned( (void*) (*sys)->state );
+		sprite_free_aligned( (void*) (*sys)->next_state );
+		sprite_free_aligned( (void*) (*sys)->sprite );
+		sprite_free_aligned( (*sys)->user_data );
+		#ifdef SPRITE_TELEMETRY
+		sprite_free_aligned( (*sys)->shown_at );
+		#endif
+		sprite_free( *sys );
+		*sys = NULL;
+	}
+}
+
+/*
+ * Returns the dense index of a player, or -1 if the handle is stale.
+ * A free slot holds a free list link rather than an index, so the
+ * slot must also be the one the index points back to.
+ */
+int32_t sprite_player_system_index( const sprite_player_system_t* sys, sprite_player_handle_t handle )
+{
+	assert( sys );
+	uint32_t slot = sprite_player_handle_slot( handle );
+
+	if( slot >= sys->capacity || sys->generation[ slot ] != sprite_player_handle_generation( handle ) )
+	{
+		return -1;
+	}
+
+	uint32_t index = sys->slots[ slot ];
+
+	if( index >= sys->count || sys->dense_slot[ index ] != slot )
+	{
+		return -1;
+	}
+
+	return (int32_t) index;
+}
+
+/* Returns the handle of the player at a dense index. */
+sprite_player_handle_t sprite_player_system_handle( const sprite_player_system_t* sys, uint32_t index )
+{
+	assert( sys );
+	assert( index < sys->count );
+	uint32_t slot = sys->dense_slot[ index ];
+	return sprite_player_handle( slot, sys->generation[ slot ] );
+}
+
+bool sprite_player_system_is_valid( const sprite_player_system_t* sys, sprite_player_handle_t handle )
+{
+	return sprite_player_system_index( sys, handle ) >= 0;
+}
+
+static void sprite_player_system_unschedule( sprite_player_system_t* sys, uint32_t slot )
+{
+	uint32_t prev = sys->wheel_prev[ slot ];
+
+	if( prev == SPRITE_PLAYER_NONE )
+	{
+		return;
+	}
+
+	uint32_t next = sys->wheel_next[ slot ];
+
+	if( prev >= sys->capacity )
+	{
+		sys->wheel[ prev - sys->capacity ] = next;
+	}
+	else
+	{
+		sys->wheel_next[ prev ] = next;
+	}
+
+	if( next != SPRITE_PLAYER_NONE )
+	{
+		sys->wheel_prev[ next ] = prev;
+	}
+
+	sys->wheel_prev[ slot ] = SPRITE_PLAYER_NONE;
+}
+
+/* Files a player under the time its frame expires, if it is playing. */
+static void sprite_player_system_schedule( sprite_player_system_t* sys, uint32_t index )
+{
+	uint32_t slot = sys->dense_slot[ index ];
+
+	sprite_player_system_unschedule( sys, slot );
+
+	if( sys->playing[ index ] )
+	{
+		uint32_t bucket = sys->frame_end[ index ] & SPRITE_PLAYER_WHEEL_MASK;
+		uint32_t first  = sys->wheel[ bucket ];
+
+		sys->wheel_next[ slot ] = first;
+		sys->wheel_prev[ slot ] = sys->capacity + bucket;
+
+		if( first != SPRITE_PLAYER_NONE )
+		{
+			sys->wheel_prev[ first ] = slot;
+		}
+
+		sys->wheel[ bucket ] = slot;
+	}
+}
+
+/*
+ * Returns the handle of the new player, or SPRITE_PLAYER_INVALID_HANDLE
+ * if the system is full.
+ */
+sprite_player_handle_t sprite_player_system_add( sprite_player_system_t* sys, const sprite_t* sprite, const void* user_data )
+{
+	assert( sys );
+	assert( sprite );
+
+	if( sys->count >= sys->capacity )
+	{
+		return SPRITE_PLAYER_INVALID_HANDLE;
+	}
+
+	uint32_t index = sys->count++;
+	uint32_t slot  = sys->free_slot;
+
+	sys->free_slot           = sys->slots[ slot ];
+	sys->slots[ slot ]       = index;
+	sys->dense_slot[ index ] = slot;
+
+	sys->frame_end[ index ]   = sys->now;
+	sys->playing[ index ]     = false;
+	sys->frame_index[ index ] = 0;
+	sys->loops_left[ index ]  = 0;
+	sys->loop_start[ index ]  = sys->now;
+	sys->state[ index ]       = NULL;
+	sys->next_state[ index ]  = NULL;
+	sys->sprite[ index ]      = sprite;
+	sys->user_data[ index ]   = (void*) user_data;
+	#ifdef SPRITE_TELEMETRY
+	sys->shown_at[ index ]    = sys->now;
+	#endif
+
+	return sprite_player_handle( slot, sys->generation[ slot ] );
+}
+
+/*
+ * The last player is moved into the removed player's index, which
+ * keeps the arrays dense. Handles to the removed player become stale.
+ */
+bool sprite_player_system_remove( sprite_player_system_t* sys, sprite_player_handle_t handle )
+{
+	int32_t found = sprite_player_system_index( sys, handle );
+
+	if( found < 0 )
+	{
+		return false;
+	}
+
+	uint32_t index = (uint32_t) found;
+	uint32_t slot  = sprite_player_handle_slot( handle );
+	uint32_t last  = --sys->count;
+
+	sprite_player_system_unschedule( sys, slot );
+	sys->generation[ slot ] = sys->generation[ slot ] + 1 < SPRITE_PLAYER_HANDLE_GENERATIONS ? sys->generation[ slot ] + 1 : 1;
+	sys->slots[ slot ]      = sys->free_slot;
+	sys->free_slot          = slot;
+
+	if( index != last )
+	{
+		sys->dense_slot[ index ]                  = sys->dense_slot[ last ];
+		sys->slots[ sys->dense_slot[ index ] ]    = index;
+
+		sys->frame_end[ index ]   = sys->frame_end[ last ];
+		sys->playing[ index ]     = sys->playing[ last ];
+		sys->frame_index[ index ] = sys->frame_index[ last ];
+		sys->loops_left[ index ]  = sys->loops_left[ last ];
+		sys->loop_start[ index ]  = sys->loop_start[ last ];
+		sys->state[ index ]       = sys->state[ last ];
+		sys->next_state[ index ]  = sys->next_state[ last ];
+		sys->sprite[ index ]      = sys->sprite[ last ];
+		sys->user_data[ index ]   = sys->user_data[ last ];
+		#ifdef SPRITE_TELEMETRY
+		sys->shown_at[ index ]    = sys->shown_at[ last ];
+		#endif
+	}
+
+	return true;
+}
+
+uint32_t sprite_player_system_count( const sprite_player_system_t* sys )
+{
+	return sys ? sys->count : 0;
+}
+
+bool sprite_player_system_play( sprite_player_system_t* sys, sprite_player_handle_t player, const char* name )
+{
+	int32_t index = sprite_player_system_index( sys, player );
+	const sprite_state_t* state = index >= 0 ? sprite_state( sys->sprite[ index ], name ) : NULL;
+
+	return state ? sprite_player_system_play_state( sys, player, state ) : false;
+}
+
+/*
+ * Playback starts at the time of the last update. Playing the state
+ * that is already playing does not restart it.
+ */
+bool sprite_player_system_play_state( sprite_player_system_t* sys, sprite_player_handle_t player, const sprite_state_t* state )
+{
+	int32_t index = sprite_player_system_index( sys, player );
+	assert( state );
+
+	if( index < 0 )
+	{
+		return false;
+	}
+
+	sprite_player_system_start( sys, (uint32_t) index, state );
+	return true;
+}
+
+static void sprite_player_system_start( sprite_player_system_t* sys, uint32_t index, const sprite_state_t* state )
+{
+	sys->next_state[ index ] = NULL;
+
+	if( state != sys->state[ index ] || !sys->playing[ index ] )
+	{
+		sys->state[ index ]       = state;
+		sys->frame_index[ index ] = 0;
+		sys->loops_left[ index ]  = sprite_state_loop_count( state );
+		sys->loop_start[ index ]  = sys->now;
+		sys->playing[ index ]     = sprite_state_frame_count( state ) > 0;
+
+		if( sys->playing[ index ] )
+		{
+			sprite_player_system_locate( sys, index, sys->now, -1 );
+		}
+		else
+		{
+			sprite_player_system_unschedule( sys, sys->dense_slot[ index ] );
+		}
+	}
+}
+
+/*
+ * Follows each player's state machine, given a mask of the conditions
+ * that hold for every player, in the order of their indices. Players
+ * whose transition waits for the end of the loop switch states during
+ * the update that reaches it, reporting the start of the new state.
+ */
+void sprite_player_system_transition( sprite_player_system_t* sys, const uint32_t* conditions )
+{
+	assert( sys );
+	assert( conditions || sys->count == 0 );
+
+	for( uint32_t i = 0; i < sys->count; i++ )
+	{
+		const sprite_state_t* state = sys->state[ i ];
+		const sprite_state_t* next  = NULL;
+		bool on_exit = false;
+
+		if( state && (next = sprite_state_transition( state, conditions[ i ], &on_exit )) != NULL )
+		{
+			if( on_exit && sys->playing[ i ] )
+			{
+				sys->next_state[ i ] = next;
+			}
+			else
+			{
+				sprite_player_system_start( sys, i, next );
+			}
+		}
+	}
+}
+
+void sprite_player_system_stop( sprite_player_system_t* sys, sprite_player_handle_t player )
+{
+	int32_t index = sprite_player_system_index( sys, player );
+
+	if( index >= 0 )
+	{
+		sys->playing[ index ] = false;
+		sprite_player_system_unschedule( sys, sys->dense_slot[ index ] );
+	}
+}
+
+bool sprite_player_system_is_playing( const sprite_player_system_t* sys, sprite_player_handle_t player )
+{
+	int32_t index = sprite_player_system_index( sys, player );
+	return index >= 0 && sys->playing[ index ];
+}
+
+void sprite_player_system_set_user_data( sprite_player_system_t* sys, sprite_player_handle_t player, const void* user_data )
+{
+	int32_t index = sprite_player_system_index( sys, player );
+
+	if( index >= 0 )
+	{
+		sys->user_data[ index ] = (void*) user_data;
+	}
+}
+
+void* sprite_player_system_user_data( const sprite_player_system_t* sys, sprite_player_handle_t player )
+{
+	int32_t index = sprite_player_system_index( sys, player );
+	return index >= 0 ? sys->user_data[ index ] : NULL;
+}
+
+/*
+ * Moves a player to the frame that is showing at now. Whole loops are
+ * counted off in one step and the frame is found with a binary search,
+ * so players that fell far behind cost no more than others. A state
+ * with a finite loop count stops on its last frame, and a state with a
+ * transition waiting hands over at the end of its loop. Only the
+ * player's own entries are written, so players can be stepped
+ * concurrently. Returns false if there is nothing to report.
+ */
+static bool sprite_player_system_step( sprite_player_system_t* sys, uint32_t index, uint32_t now, uint32_t* loops, bool* finished, bool* started )
+{
+	*loops    = 0;
+	*finished = false;
+	*started  = false;
+
+	for( ;; )
+	{
+		const sprite_state_t* state = sys->state[ index ];
+		uint32_t duration = sprite_state_duration( state );
+		uint32_t elapsed  = now - sys->loop_start[ index ];
+		uint32_t frame_end = 0;
+
+		if( sys->next_state[ index ] && elapsed >= duration )
+		{
+			const sprite_state_t* next = sys->next_state[ index ];
+
+			sys->next_state[ index ] = NULL;
+			sys->state[ index ]      = next;
+			sys->loops_left[ index ] = sprite_state_loop_count( next );
+			sys->loop_start[ index ] += duration;
+			*loops   = 0;
+			*started = true;
+
+			if( sprite_state_frame_count( next ) == 0 )
+			{
+				sys->frame_index[ index ] = 0;
+				sys->playing[ index ]     = false;
+				return true;
+			}
+			continue;
+		}
+
+		if( duration == 0 )
+		{
+			/* frames that take no time never advance */
+			sys->frame_index[ index ] = 0;
+			sys->frame_end[ index ]   = now + INT32_MAX;
+			return *started;
+		}
+
+		if( elapsed >= duration )
+		{
+			*loops = elapsed / duration;
+
+			if( sys->loops_left[ index ] > 0 && *loops >= sys->loops_left[ index ] )
+			{
+				sys->frame_index[ index ] = sprite_state_frame_count( state ) - 1;
+				sys->playing[ index ]     = false;
+				*loops    = sys->loops_left[ index ] - 1;
+				*finished = true;
+				return true;
+			}
+
+			if( sys->loops_left[ index ] > 0 )
+			{
+				sys->loops_left[ index ] -= *loops;
+			}
+
+			sys->loop_start[ index ] += *loops * duration;
+			elapsed -= *loops * duration;
+		}
+
+		sys->frame_index[ index ] = sprite_state_frame_at( state, elapsed, &frame_end );
+		sys->frame_end[ index ]   = sys->loop_start[ index ] + frame_end;
+		return true;
+	}
+}
+
+/*
+ * Records the frame that showed before a player moved from frame from
+ * of its state, loops loops later. from is -1 if the player started a
+ * new state.
+ */
+static inline void sprite_player_system_observe( sprite_player_system_t* sys, uint32_t index, int32_t from, uint32_t loops, bool finished, uint32_t now )
+{
+	#ifdef SPRITE_TELEMETRY
+	const sprite_state_t* state = sys->state[ index ];
+	uint32_t to     = sys->frame_index[ index ];
+	uint32_t passed = from >= 0 ? loops * sprite_state_frame_count( state ) + to - from : 0;
+
+	if( passed > 0 )
+	{
+		sprite_telemetry_frame( &sys->telemetry, now - sys->shown_at[ index ], sprite_state_frame_time( state, from ), passed );
+
+		if( !finished )
+		{
+			uint32_t time = sprite_state_frame_time( state, to );
+
+			if( time > 0 && 2 * (now - (sys->frame_end[ index ] - time)) >= time )
+			{
+				sys->telemetry.late++;
+			}
+		}
+	}
+
+	sys->shown_at[ index ] = now;
+	#endif
+}
+
+static void sprite_player_system_locate( sprite_player_system_t* sys, uint32_t index, uint32_t now, int32_t from )
+{
+	uint32_t loops;
+	bool finished;
+	bool started;
+
+	bool report = sprite_player_system_step( sys, index, now, &loops, &finished, &started );
+
+	sprite_player_system_schedule( sys, index );
+
+	if( report && sys->events )
+	{
+		sprite_events_emit( sys->events, sys->state[ index ], sprite_player_system_handle( sys, index ), sys->user_data[ index ], started ? -1 : from, sys->frame_index[ index ], loops, finished );
+	}
+
+	if( report )
+	{
+		sprite_player_system_observe( sys, index, started ? -1 : from, loops, finished, now );
+	}
+}
+
+/*
+ * Moves a player to time milliseconds since the start of the first
+ * loop of its state, restarting the loop count.
+ */
+void sprite_player_system_seek( sprite_player_system_t* sys, sprite_player_handle_t player, uint32_t time )
+{
+	int32_t index = sprite_player_system_index( sys, player );
+
+	if( index >= 0 && sys->state[ index ] )
+	{
+		sys->loops_left[ index ] = sprite_state_loop_count( sys->state[ index ] );
+		sys->loop_start[ index ] = sys->now - time;
+		sprite_player_system_locate( sys, index, sys->now, -1 );
+	}
+}
+
+/*
+ * Players append their events to the buffer, or stop reporting events
+ * if events is NULL. An event's player is the player's handle.
+ */
+void sprite_player_system_set_events( sprite_player_system_t* sys, sprite_events_t* events )
+{
+	assert( sys );
+	sys->events = events;
+}
+
+/*
+ * Advances one chunk of players. The first pass only compares times,
+ * so it can be vectorized; the second pass visits the players whose
+ * frame changed and notes what happened for the events.
+ */
+static void sprite_player_system_update_chunk( void* job, uint32_t chunk )
+{
+	const sprite_player_system_job_t* update = job;
+	sprite_player_system_t* sys    = update->sys;
+	const uint32_t now             = update->now;
+	const uint32_t begin           = chunk * update->chunk_size;
+	const uint32_t end             = sys->count - begin < update->chunk_size ? sys->count : begin + update->chunk_size;
+	const uint32_t* restrict expiry = sys->frame_end;
+	const uint8_t* restrict playing = sys->playing;
+	uint8_t* restrict due          = sys->due;
+
+	for( uint32_t i = begin; i < end; i++ )
+	{
+		due[ i ] = playing[ i ] & ((int32_t) (now - expiry[ i ]) >= 0);
+	}
+
+	for( uint32_t i = begin; i < end; i++ )
+	{
+		if( due[ i ] )
+		{
+			bool finished;
+			bool started;
+			sys->from_frame[ i ] = sys->frame_index[ i ];
+
+			if( sprite_player_system_step( sys, i, now, &sys->loops_passed[ i ], &finished, &started ) )
+			{
+				if( started )
+				{
+					sys->from_frame[ i ] = SPRITE_PLAYER_STARTED;
+				}
+
+				due[ i ] = finished ? SPRITE_PLAYER_FINISHED : SPRITE_PLAYER_CHANGED;
+			}
+			else
+			{
+				due[ i ] = SPRITE_PLAYER_MOVED;
+			}
+		}
+	}
+}
+
+/*
+ * Files the players that the chunks moved and reports their events in
+ * player order, however the chunks ran.
+ */
+static void sprite_player_system_report( sprite_player_system_t* sys, uint32_t now )
+{
+	for( uint32_t i = 0; i < sys->count; i++ )
+	{
+		if( sys->due[ i ] )
+		{
+			sprite_player_system_schedule( sys, i );
+
+			if( sys->due[ i ] != SPRITE_PLAYER_MOVED )
+			{
+				int32_t from = sys->from_frame[ i ] == SPRITE_PLAYER_STARTED ? -1 : sys->from_frame[ i ];
+
+				if( sys->events )
+				{
+					sprite_events_emit( sys->events, sys->state[ i ], sprite_player_system_handle( sys, i ), sys->user_data[ i ],
+					                    from, sys->frame_index[ i ], sys->loops_passed[ i ], sys->due[ i ] == SPRITE_PLAYER_FINISHED );
+				}
+
+				sprite_player_system_observe( sys, i, from, sys->loops_passed[ i ], sys->due[ i ] == SPRITE_PLAYER_FINISHED, now );
+			}
+		}
+	}
+}
+
+/*
+ * Advances every playing player to the time now, in milliseconds, by
+ * walking the wheel buckets from the last update to now. Only players
+ * whose frame expired are touched. Events are reported in the order
+ * the buckets are walked and, within a bucket, in the reverse of the
+ * order players were filed. Since a bucket is picked by the frame end
+ * modulo the wheel size, a step longer than the wheel doesn't report
+ * players in the order their frames expired.
+ */
+void sprite_player_system_update( sprite_player_system_t* sys, uint32_t now )
+{
+	assert( sys );
+	uint32_t span = now - sys->now;
+
+	#ifdef SPRITE_TELEMETRY
+	sprite_time_t started = sprite_monotonic_time( );
+	#endif
+
+	if( (int32_t) span > 0 )
+	{
+		if( span > SPRITE_PLAYER_WHEEL_SIZE )
+		{
+			span = SPRITE_PLAYER_WHEEL_SIZE;
+		}
+
+		for( uint32_t time = now - span + 1; span > 0; time++, span-- )
+		{
+			uint32_t slot = sys->wheel[ time & SPRITE_PLAYER_WHEEL_MASK ];
+
+			while( slot != SPRITE_PLAYER_NONE )
+			{
+				uint32_t next  = sys->wheel_next[ slot ];
+				uint32_t index = sys->slots[ slot ];
+
+				if( (int32_t) (now - sys->frame_end[ index ]) >= 0 )
+				{
+					sprite_player_system_locate( sys, index, now, sys->frame_index[ index ] );
+				}
+
+				slot = next;
+			}
+		}
+	}
+
+	#ifdef SPRITE_TELEMETRY
+	sprite_telemetry_update( &sys->telemetry, sprite_monotonic_time( ) - started );
+	#endif
+
+	sys->now = now;
+}
+
+/*
+ * Like sprite_player_system_update, but the players are split into
+ * chunks of chunk_size players (0 for a default) and dispatched, for
+ * example with sprite_workers_dispatch or a job system. A chunk writes
+ * only its own players, so the result does not depend on how chunks
+ * are scheduled. Every player is visited, which pays off when most
+ * players change frame in each update. A NULL dispatch runs the chunks
+ * in turn.
+ */
+void sprite_player_system_update_parallel( sprite_player_system_t* sys, uint32_t now, uint32_t chunk_size, sprite_dispatch_fxn_t dispatch, void* context )
+{
+	assert( sys );
+	sprite_player_system_job_t job;
+
+	#ifdef SPRITE_TELEMETRY
+	sprite_time_t started = sprite_monotonic_time( );
+	#endif
+
+	if( chunk_size == 0 )
+	{
+		chunk_size = SPRITE_PLAYER_SYSTEM_CHUNK;
+	}
+
+	job.sys        = sys;
+	job.now        = now;
+	job.chunk_size = (chunk_size + SPRITE_PIXEL_ALIGNMENT - 1) & ~(SPRITE_PIXEL_ALIGNMENT - 1);
+
+	uint32_t chunk_count = (sys->count + job.chunk_size - 1) / job.chunk_size;
+
+	if( dispatch )
+	{
+		dispatch( context, sprite_player_system_update_chunk, &job, chunk_count );
+	}
+	else
+	{
+		for( uint32_t chunk = 0; chunk < chunk_count; chunk++ )
+		{
+			sprite_player_system_update_chunk( &job, chunk );
+		}
+	}
+
+	sprite_player_system_report( sys, now );
+
+	#ifdef SPRITE_TELEMETRY
+	sprite_telemetry_update( &sys->telemetry, sprite_monotonic_time( ) - started );
+	#endif
+
+	sys->now = now;
+}
+
+/* Frame index of every player, by dense index. */
+const uint16_t* sprite_player_system_frames( const sprite_player_system_t* sys )
+{
+	return sys ? sys->frame_index : NULL;
+}
+
+const sprite_frame_t* sprite_player_system_frame( const sprite_player_system_t* sys, sprite_player_handle_t player )
+{
+	int32_t index = sprite_player_system_index( sys, player );
+	const sprite_state_t* state = index >= 0 ? sys->state[ index ] : NULL;
+	return state ? sprite_state_frame( state, sys->frame_index[ index ] ) : NULL;
+}
+
+/*
+ * Hands what every player shows to render in batches of up to capacity
+ * items, using items as the batch buffer. Items are in the order of
+ * the players' indices; players without a frame are left out.
+ */
+void sprite_player_system_render( const sprite_player_system_t* sys, sprite_render_item_t* items, uint32_t capacity, sprite_render_batch_fxn_t render, void* context )
+{
+	assert( sys );
+	assert( items );
+	assert( capacity > 0 );
+	assert( render );
+	uint32_t size = 0;
+
+	for( uint32_t i = 0; i < sys->count; i++ )
+	{
+		const sprite_state_t* state = sys->state[ i ];
+
+		if( state && sprite_state_frame_count( state ) > 0 )
+		{
+			items[ size ].user_data = sys->user_data[ i ];
+			items[ size ].sprite    = sys->sprite[ i ];
+			items[ size ].frame     = sprite_state_frame( state, sys->frame_index[ i ] );
+
+			if( ++size == capacity )
+			{
+				render( context, items, size );
+				size = 0;
+			}
+		}
+	}
+
+	if( size > 0 )
+	{
+		render( context, items, size );
+	}
+}
+
+/*
+ * Writes a snapshot of every player, in the order of their indices,
+ * to an array of sprite_player_system_count snapshots.
+ */
+void sprite_player_system_snapshot_all( const sprite_player_system_t* sys, sprite_player_snapshot_t* snapshots )
+{
+	assert( sys );
+	assert( snapshots || sys->count == 0 );
+
+	memset( snapshots, 0, sizeof(sprite_player_snapshot_t) * sys->count );
+
+	for( uint32_t i = 0; i < sys->count; i++ )
+	{
+		snapshots[ i ].state      = sys->state[ i ] ? sprite_state_id( sys->state[ i ] ) : 0;
+		snapshots[ i ].frame      = sys->frame_index[ i ];
+		snapshots[ i ].loops_left = sys->loops_left[ i ];
+		snapshots[ i ].time       = sprite_time_from_ms( sys->now - sys->loop_start[ i ] );
+		snapshots[ i ].is_playing = sys->playing[ i ];
+	}
+}
+
+/*
+ * Restores the first count players from snapshots taken with
+ * sprite_player_system_snapshot_all and sets the system's time to now,
+ * so that a rollback can restore the time a snapshot was taken at and
+ * run the updates after it again. No events are reported, and
+ * transitions waiting for the end of a loop are dropped. States are
+ * only looked up when a player's state differs from the snapshot's.
+ */
+void sprite_player_system_restore_all( sprite_player_system_t* sys, const sprite_player_snapshot_t* snapshots, uint32_t count, uint32_t now )
+{
+	assert( sys );
+	assert( count <= sys->count );
+	sys->now = now;
+
+	const sprite_t* sprite = NULL;
+	const sprite_state_t* found = NULL;
+	uint32_t id = 0;
+
+	for( uint32_t i = 0; i < count; i++ )
+	{
+		const sprite_player_snapshot_t* snapshot = &snapshots[ i ];
+		const sprite_state_t* state = sys->state[ i ];
+		uint32_t time = sprite_time_to_ms( snapshot->time );
+
+		if( !state || sprite_state_id( state ) != snapshot->state )
+		{
+			if( sys->sprite[ i ] != sprite || snapshot->state != id )
+			{
+				sprite = sys->sprite[ i ];
+				id     = snapshot->state;
+				found  = sprite_state_by_id( sprite, id );
+			}
+
+			state = found;
+		}
+
+		sys->state[ i ]       = state;
+		sys->next_state[ i ]  = NULL;
+		sys->frame_index[ i ] = snapshot->frame;
+		sys->loops_left[ i ]  = snapshot->loops_left;
+		sys->loop_start[ i ]  = sys->now - time;
+		sys->playing[ i ]     = state && snapshot->is_playing;
+		sys->frame_end[ i ]   = sys->now;
+		#ifdef SPRITE_TELEMETRY
+		sys->shown_at[ i ]    = sys->now;
+		#endif
+
+		if( sys->playing[ i ] )
+		{
+			uint32_t frame_end = 0;
+
+			if( sprite_state_duration( state ) == 0 )
+			{
+				sys->frame_end[ i ] = sys->now + INT32_MAX;
+			}
+			else
+			{
+				sprite_state_frame_at( state, time, &frame_end );
+				sys->frame_end[ i ] = sys->loop_start[ i ] + frame_end;
+			}
+		}
+
+		sprite_player_system_schedule( sys, i );
+	}
+}
+
+void sprite_player_system_memory_usage( const sprite_player_system_t* sys, sprite_memory_t* usage )
+{
+	assert( sys );
+	assert( usage );
+
+	size_t per_player = sizeof(*sys->slots) + sizeof(*sys->generation) + sizeof(*sys->dense_slot) +
+	                    sizeof(*sys->wheel_next) + sizeof(*sys->wheel_prev) + sizeof(*sys->frame_end) + sizeof(*sys->playing) + sizeof(*sys->due) +
+	                    sizeof(*sys->from_frame) + sizeof(*sys->loops_passed) +
+	                    sizeof(*sys->frame_index) + sizeof(*sys->loops_left) + sizeof(*sys->loop_start) + sizeof(*sys->state) + sizeof(*sys->next_state) +
+	                    sizeof(*sys->sprite) + sizeof(*sys->user_data);
+
+	#ifdef SPRITE_TELEMETRY
+	per_player += sizeof(*sys->shown_at);
+	#endif
+
+	memset( usage, 0, sizeof(sprite_memory_t) );
+	usage->players     = sizeof(sprite_player_system_t) + per_player * sys->capacity + sizeof(*sys->wheel) * SPRITE_PLAYER_WHEEL_SIZE;
+	usage->total       = usage->players;
+	#ifdef SPRITE_TELEMETRY
+	usage->allocations = 20;
+	#else
+	usage->allocations = 19;
+	#endif
+}
+
+/*
+ * Copies the timing statistics of all the system's players. Returns
+ * false, with the statistics zeroed, if the library was built without
+ * SPRITE_TELEMETRY.
+ */
+bool sprite_player_system_telemetry( const sprite_player_system_t* sys, sprite_telemetry_t* telemetry )
+{
+	assert( sys );
+	assert( telemetry );
+
+	#ifdef SPRITE_TELEMETRY
+	*telemetry = sys->telemetry;
+	return true;
+	#else
+	memset( telemetry, 0, sizeof(sprite_telemetry_t) );
+	return false;
+	#endif
+}
+
+void sprite_player_system_reset_telemetry( sprite_player_system_t* sys )
+{
+	assert( sys );
+
+	#ifdef SPRITE_TELEMETRY
+	memset( &sys->telemetry, 0, sizeof(sprite_telemetry_t) );
+	#endif
+}
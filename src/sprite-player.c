@@ -6,24 +6,51 @@
 #include <libcollections/array.h>
 #include "sprite.h"
 #include "sprite-mem.h"
+#include "sprite-private.h"
 
 static uint32_t default_timer( void );
 
 static sprite_timer_fxn_t sprite_timer = default_timer;
 
+typedef struct sprite_player_saved {
+	const sprite_state_t* state;
+	sprite_time_t time;
+	uint16_t frame_index;
+	uint16_t loops_left;
+} sprite_player_saved_t;
+
 struct sprite_player {
 	const sprite_t* sprite;
 	const sprite_state_t* state;
 	uint16_t frame_index;
-	uint16_t loop_count;
-	uint32_t last_frame_time;
+	uint16_t loops_left;      /* 0 if the state loops forever */
+	sprite_time_t time;       /* into the current loop */
+	sprite_time_t frame_end;  /* when the current frame ends, relative to the loop */
+	uint32_t last_time;       /* timer reading of the last wall clock update */
 	bool is_playing;
-	sprite_timer_fxn_t timer;
+	const sprite_clock_t* clock;
+	sprite_time_t clock_time; /* clock reading of the last update */
+	sprite_events_t* events;
 	void* user_data;
 
+	/* States waiting to play, without allocating: queued states play
+	 * once the current state ends, pushed states return to the state
+	 * below them. */
+	const sprite_state_t* queue[ SPRITE_ANIMATION_STACK_DEPTH ];
+	uint8_t queue_head;
+	uint8_t queue_size;
+	uint8_t stack_size;
+	sprite_player_saved_t stack[ SPRITE_ANIMATION_STACK_DEPTH ];
+
+	#ifdef SPRITE_TELEMETRY
+	sprite_telemetry_t telemetry;
+	sprite_time_t played;   /* all the time the player advanced by */
+	sprite_time_t shown_at; /* when the current frame appeared */
+	#endif
 };
 
 static void  sprite_player_initialize( sprite_player_t* sp, const sprite_t* sprite );
+static void  sprite_player_locate( sprite_player_t* sp, sprite_time_t time, int32_t from );
 
 
 sprite_player_t* sprite_player_create( const sprite_t* sprite )
@@ -52,9 +79,27 @@ void sprite_player_initialize( sprite_player_t* sp, const sprite_t* sprite )
 	assert( sp );
 	assert( sprite );
 
-	sp->sprite     = sprite;
-	sp->state      = NULL;
-	sp->user_data  = NULL;
+	sp->sprite      = sprite;
+	sp->state       = NULL;
+	sp->frame_index = 0;
+	sp->loops_left  = 0;
+	sp->time        = 0;
+	sp->frame_end   = 0;
+	sp->last_time   = 0;
+	sp->is_playing  = false;
+	sp->clock       = NULL;
+	sp->clock_time  = 0;
+	sp->events      = NULL;
+	sp->user_data   = NULL;
+	sp->queue_head  = 0;
+	sp->queue_size  = 0;
+	sp->stack_size  = 0;
+
+	#ifdef SPRITE_TELEMETRY
+	memset( &sp->telemetry, 0, sizeof(sprite_telemetry_t) );
+	sp->played   = 0;
+	sp->shown_at = 0;
+	#endif
 }
 
 void sprite_player_set_timer( sprite_timer_fxn_t timer )
@@ -63,12 +108,35 @@ void sprite_player_set_timer( sprite_timer_fxn_t timer )
 	sprite_timer = timer;
 }
 
+/*
+ * Players bound to a clock take their time from the clock instead of
+ * reading the timer on every update. Pass NULL to use the timer again.
+ */
+void sprite_player_set_clock( sprite_player_t* sp, const sprite_clock_t* clock )
+{
+	assert( sp );
+	sp->clock      = clock;
+	sp->clock_time = clock ? sprite_clock_now( clock ) : 0;
+	sp->last_time  = clock ? 0 : sprite_timer( );
+}
+
 void sprite_player_set_user_data( sprite_player_t* sp, const void* data )
 {
 	assert( sp );
 	sp->user_data = (void*) data;
 }
 
+/*
+ * The player appends its events to the buffer, or stops reporting
+ * events if events is NULL. Several players can share a buffer;
+ * events carry the player's user data.
+ */
+void sprite_player_set_events( sprite_player_t* sp, sprite_events_t* events )
+{
+	assert( sp );
+	sp->events = events;
+}
+
 void sprite_player_play( sprite_player_t* sp, const char* name )
 {
 	const sprite_state_t* state = sprite_state( sp->sprite, name );
@@ -76,20 +144,144 @@ void sprite_player_play( sprite_player_t* sp, const char* name )
 	sprite_player_play_state( sp, state );
 }
 
+/*
+ * Playing a different state also discards the queued and pushed states.
+ * The state that is playing keeps playing, but a state that finished
+ * or was stopped starts over.
+ */
 void sprite_player_play_state( sprite_player_t* sp, const sprite_state_t* state )
 {
 	assert( state );
-	if( state != sp->state )
+	if( state != sp->state || !sp->is_playing )
+	{
+		sp->queue_size  = 0;
+		sp->stack_size  = 0;
+		sp->state       = state;
+		sp->frame_index = 0;
+		sp->time        = 0;
+		sp->frame_end   = 0;
+		sp->last_time   = sp->clock ? 0 : sprite_timer( );
+		sp->clock_time  = sp->clock ? sprite_clock_now( sp->clock ) : 0;
+		sp->loops_left  = sprite_state_loop_count( state );
+		sp->is_playing  = sprite_state_frame_count( state ) > 0;
+
+		if( sp->is_playing )
+		{
+			sprite_player_locate( sp, 0, -1 );
+		}
+	}
+}
+
+/*
+ * Follows the sprite's state machine from the state that is playing,
+ * given the mask of conditions that hold. A transition that waits for
+ * the end of the loop is queued in place of any queued states. Returns
+ * true if the player moved or is going to.
+ */
+bool sprite_player_transition( sprite_player_t* sp, uint32_t conditions )
+{
+	assert( sp );
+	bool on_exit = false;
+	const sprite_state_t* next = sp->state ? sprite_state_transition( sp->state, conditions, &on_exit ) : NULL;
+
+	if( !next )
+	{
+		return false;
+	}
+
+	if( on_exit && sp->is_playing )
+	{
+		if( sp->queue_size != 1 || sp->queue[ sp->queue_head ] != next )
+		{
+			sp->queue_size = 0;
+			sprite_player_enqueue_state( sp, next );
+		}
+	}
+	else
+	{
+		sprite_player_play_state( sp, next );
+	}
+
+	return true;
+}
+
+/*
+ * Plays a state once and then returns to the state that is playing
+ * now, at the position it was interrupted. A pushed state that loops
+ * forever returns at the end of its first loop. Returns false if the
+ * stack is full.
+ */
+bool sprite_player_push_state( sprite_player_t* sp, const sprite_state_t* state )
+{
+	assert( sp );
+	assert( state );
+
+	if( !sp->state )
 	{
- 		uint16_t state_loop_count = sprite_state_loop_count(state);
+		sprite_player_play_state( sp, state );
+		return true;
+	}
 
-		sp->state           = state;
-		sp->frame_index     = 0;
-		sp->last_frame_time = sprite_timer( );
-		sp->loop_count      = state_loop_count > 0 ? (state_loop_count - 1) : 0;
-		sp->is_playing      = true;
-		assert( sp->loop_count >= 0 );
+	if( sp->stack_size >= SPRITE_ANIMATION_STACK_DEPTH )
+	{
+		return false;
 	}
+
+	sprite_player_saved_t* saved = &sp->stack[ sp->stack_size++ ];
+	saved->state       = sp->state;
+	saved->time        = sp->time;
+	saved->frame_index = sp->frame_index;
+	saved->loops_left  = sp->loops_left;
+
+	sp->state      = state;
+	sp->loops_left = sprite_state_loop_count( state );
+	sp->is_playing = true;
+	sprite_player_locate( sp, 0, -1 );
+	return true;
+}
+
+bool sprite_player_push( sprite_player_t* sp, const char* name )
+{
+	const sprite_state_t* state = sprite_state( sp->sprite, name );
+	return state ? sprite_player_push_state( sp, state ) : false;
+}
+
+/*
+ * Plays a state after the current state ends, e.g. idle after attack.
+ * A state that loops forever ends at the end of its current loop once
+ * something is queued. Returns false if the queue is full.
+ */
+bool sprite_player_enqueue_state( sprite_player_t* sp, const sprite_state_t* state )
+{
+	assert( sp );
+	assert( state );
+
+	if( !sp->state )
+	{
+		sprite_player_play_state( sp, state );
+		return true;
+	}
+
+	if( sp->queue_size >= SPRITE_ANIMATION_STACK_DEPTH )
+	{
+		return false;
+	}
+
+	sp->queue[ (sp->queue_head + sp->queue_size) % SPRITE_ANIMATION_STACK_DEPTH ] = state;
+	sp->queue_size++;
+	return true;
+}
+
+bool sprite_player_enqueue( sprite_player_t* sp, const char* name )
+{
+	const sprite_state_t* state = sprite_state( sp->sprite, name );
+	return state ? sprite_player_enqueue_state( sp, state ) : false;
+}
+
+void sprite_player_clear_queue( sprite_player_t* sp )
+{
+	assert( sp );
+	sp->queue_size = 0;
 }
 
 bool sprite_player_is_playing( sprite_player_t* sp, const char* name )
@@ -113,89 +305,384 @@ void sprite_player_pause( sprite_player_t* sp )
 void sprite_player_unpause( sprite_player_t* sp )
 {
 	assert( sp );
-	sp->is_playing = true;
+	sp->is_playing = sp->state != NULL;
+	/* the pause does not count as playing time */
+	sp->last_time  = sp->clock ? 0 : sprite_timer( );
+	sp->clock_time = sp->clock ? sprite_clock_now( sp->clock ) : 0;
 }
 
+/*
+ * Starts the next queued state, or resumes the state below the top
+ * of the stack, with time already into it. Returns false if nothing
+ * is waiting.
+ */
+static bool sprite_player_next( sprite_player_t* sp, sprite_time_t* time, int32_t* from )
+{
+	if( sp->queue_size > 0 )
+	{
+		sp->state      = sp->queue[ sp->queue_head ];
+		sp->loops_left = sprite_state_loop_count( sp->state );
+		sp->queue_head = (sp->queue_head + 1) % SPRITE_ANIMATION_STACK_DEPTH;
+		sp->queue_size--;
+		*from = -1;
+		return true;
+	}
 
-void sprite_player_render( sprite_player_t* sp, sprite_render_fxn_t render )
+	if( sp->stack_size > 0 )
+	{
+		const sprite_player_saved_t* saved = &sp->stack[ --sp->stack_size ];
+
+		sp->state      = saved->state;
+		sp->loops_left = saved->loops_left;
+		*time         += saved->time;
+		*from          = saved->frame_index;
+		return true;
+	}
+
+	return false;
+}
+
+/*
+ * Records the frame that showed before the player moved from frame
+ * from to frame to of its state, loops loops later. from is -1 if the
+ * player did not stay in one state.
+ */
+static inline void sprite_player_observe( sprite_player_t* sp, int32_t from, uint16_t to, uint32_t loops, bool finished )
 {
-	//assert( sp && sp->state );
+	#ifdef SPRITE_TELEMETRY
+	const sprite_state_t* state = sp->state;
+	uint32_t passed = from >= 0 ? loops * sprite_state_frame_count( state ) + to - from : 0;
+
+	if( passed > 0 )
+	{
+		sprite_telemetry_frame( &sp->telemetry, sprite_time_to_ms( sp->played - sp->shown_at ), sprite_state_frame_time( state, from ), passed );
+
+		if( !finished )
+		{
+			sprite_time_t time = sprite_time_from_ms( sprite_state_frame_time( state, to ) );
 
-	if( !sp->state ) return;
+			if( time > 0 && 2 * (sp->time - (sp->frame_end - time)) >= time )
+			{
+				sp->telemetry.late++;
+			}
+		}
+	}
 
-	if( sp->frame_index >= sprite_state_frame_count(sp->state) )
+	sp->shown_at = sp->played;
+	#endif
+}
+
+/*
+ * Moves the player to time into the current loop. The time may lie
+ * beyond the end of the loop: whole loops are counted off in one step
+ * and the frame is found with a binary search, so the cost does not
+ * depend on how much time passed.
+ *
+ * A state with a finite loop count ends once its loops are used up.
+ * A state that loops forever ends at the end of its current loop if
+ * another state is waiting in the queue or on the stack. Time left
+ * over from a state that ended carries into the state that follows;
+ * if nothing follows, the player stops on the last frame.
+ */
+static void sprite_player_locate( sprite_player_t* sp, sprite_time_t time, int32_t from )
+{
+	const sprite_state_t* entry = sp->state;
+
+	for( ;; )
 	{
-		sp->frame_index = 0;
+		const sprite_state_t* state = sp->state;
+		sprite_time_t duration = sprite_time_from_ms( sprite_state_duration( state ) );
+		bool is_waiting = sp->queue_size > 0 || sp->stack_size > 0;
+		uint32_t frame_end = 0;
+		sprite_time_t loops = 0;
 
- 		uint16_t states_loop_count = sprite_state_loop_count(sp->state);
+		if( duration == 0 )
+		{
+			if( is_waiting && sprite_player_next( sp, &time, &from ) )
+			{
+				continue;
+			}
+
+			/* frames that take no time never advance */
+			sp->frame_index = 0;
+			sp->time        = 0;
+			sp->frame_end   = UINT64_MAX;
+			return;
+		}
 
- 		if( states_loop_count > 0 )
+		if( time >= duration )
 		{
-			if( sp->loop_count > 0 )
+			uint32_t loops_to_end = sp->loops_left > 0 ? sp->loops_left : (is_waiting ? 1 : 0);
+			loops = time / duration;
+
+			if( loops_to_end > 0 && loops >= loops_to_end )
 			{
-				sp->loop_count--;
+				uint16_t last = sprite_state_frame_count( state ) - 1;
+
+				if( sp->events )
+				{
+					sprite_events_emit( sp->events, state, 0, sp->user_data, from, last, loops_to_end - 1, true );
+				}
+
+				sprite_player_observe( sp, state == entry ? from : -1, last, loops_to_end - 1, true );
+
+				time -= loops_to_end * duration;
+
+				if( sprite_player_next( sp, &time, &from ) )
+				{
+					continue;
+				}
+
+				sp->frame_index = last;
+				sp->time        = duration;
+				sp->frame_end   = duration;
+				sp->is_playing  = false;
+				return;
 			}
+
+			if( sp->loops_left > 0 )
+			{
+				sp->loops_left -= loops;
+			}
+
+			time -= loops * duration;
+		}
+
+		sp->frame_index = sprite_state_frame_at( state, sprite_time_to_ms( time ), &frame_end );
+		sp->time        = time;
+		sp->frame_end   = sprite_time_from_ms( frame_end );
+
+		if( sp->events )
+		{
+			sprite_events_emit( sp->events, state, 0, sp->user_data, from, sp->frame_index, loops > UINT32_MAX ? UINT32_MAX : (uint32_t) loops, false );
 		}
+
+		sprite_player_observe( sp, state == entry ? from : -1, sp->frame_index, loops > UINT32_MAX ? UINT32_MAX : (uint32_t) loops, false );
+		return;
 	}
+}
 
+/*
+ * Advances the player by dt and returns the frame that is showing.
+ * Time left over from a frame carries into the next one, so a
+ * player driven by a fixed time step shows exactly the same frames on
+ * every run. Any dt lands on the right frame and loop.
+ */
+const sprite_frame_t* sprite_player_advance( sprite_player_t* sp, sprite_time_t dt )
+{
+	assert( sp );
 
-	const sprite_frame_t* frame = sprite_state_frame( sp->state, sp->frame_index );
-	assert( frame );
-	uint32_t now    = sprite_timer( );
-	int32_t elapsed = now - sp->last_frame_time;
+	if( !sp->state ) return NULL;
 
-	render( frame );
+	#ifdef SPRITE_TELEMETRY
+	sprite_time_t started = sprite_monotonic_time( );
+	sp->played += dt;
+	#endif
 
-	if( sp->is_playing && elapsed > frame->time )
+	if( sp->is_playing )
 	{
-		/* Show the next sprite frame */
-		sp->frame_index++;
-		sp->last_frame_time = now;
+		sp->time += dt;
+
+		if( sp->time >= sp->frame_end )
+		{
+			sprite_player_locate( sp, sp->time, sp->frame_index );
+		}
 	}
+
+	#ifdef SPRITE_TELEMETRY
+	sprite_telemetry_update( &sp->telemetry, sprite_monotonic_time( ) - started );
+	#endif
+
+	return sprite_state_frame_count( sp->state ) > 0 ? sprite_state_frame( sp->state, sp->frame_index ) : NULL;
 }
 
-const sprite_frame_t* sprite_player_frame( sprite_player_t* sp )
+/*
+ * Moves the player to time since the start of the first loop of its
+ * state, restarting the loop count. Seeking does not pause or resume
+ * the player.
+ */
+void sprite_player_seek( sprite_player_t* sp, sprite_time_t time )
 {
-	//assert( sp && sp->state );
+	assert( sp );
 
-	if( !sp->state ) return NULL;
+	if( sp->state )
+	{
+		sp->loops_left = sprite_state_loop_count( sp->state );
+		sprite_player_locate( sp, time, -1 );
+	}
+}
+
+/*
+ * Copies the player's timing statistics. Returns false, with the
+ * statistics zeroed, if the library was built without SPRITE_TELEMETRY.
+ */
+bool sprite_player_telemetry( const sprite_player_t* sp, sprite_telemetry_t* telemetry )
+{
+	assert( sp );
+	assert( telemetry );
+
+	#ifdef SPRITE_TELEMETRY
+	*telemetry = sp->telemetry;
+	return true;
+	#else
+	memset( telemetry, 0, sizeof(sprite_telemetry_t) );
+	return false;
+	#endif
+}
+
+void sprite_player_reset_telemetry( sprite_player_t* sp )
+{
+	assert( sp );
+
+	#ifdef SPRITE_TELEMETRY
+	memset( &sp->telemetry, 0, sizeof(sprite_telemetry_t) );
+	#endif
+}
+
+/* Queued and pushed states are not part of a snapshot. */
+void sprite_player_snapshot( const sprite_player_t* sp, sprite_player_snapshot_t* snapshot )
+{
+	assert( sp );
+	assert( snapshot );
+
+	memset( snapshot, 0, sizeof(sprite_player_snapshot_t) );
+	snapshot->state      = sp->state ? sprite_state_id( sp->state ) : 0;
+	snapshot->frame      = sp->frame_index;
+	snapshot->loops_left = sp->loops_left;
+	snapshot->time       = sp->time;
+	snapshot->is_playing = sp->is_playing;
+}
+
+/*
+ * Puts the player back where a snapshot of it was taken, without
+ * reporting events. The queue and stack are cleared. The player's
+ * clock or timer is left alone, so time keeps running from the
+ * player's last update.
+ */
+void sprite_player_restore( sprite_player_t* sp, const sprite_player_snapshot_t* snapshot )
+{
+	assert( sp );
+	assert( snapshot );
+	const sprite_state_t* state = sp->state;
 
-	if( sp->frame_index >= sprite_state_frame_count(sp->state) )
+	if( !state || sprite_state_id( state ) != snapshot->state )
 	{
-		sp->frame_index = 0;
+		state = sprite_state_by_id( sp->sprite, snapshot->state );
+	}
+
+	sp->state       = state;
+	sp->frame_index = snapshot->frame;
+	sp->loops_left  = snapshot->loops_left;
+	sp->time        = snapshot->time;
+	sp->frame_end   = 0;
+	sp->is_playing  = state && snapshot->is_playing;
+	sp->queue_size  = 0;
+	sp->stack_size  = 0;
 
- 		uint16_t states_loop_count = sprite_state_loop_count(sp->state);
+	if( state )
+	{
+		sprite_time_t duration = sprite_time_from_ms( sprite_state_duration( state ) );
+		uint32_t frame_end = 0;
 
- 		if( states_loop_count > 0 )
+		if( duration == 0 )
 		{
-			if( sp->loop_count > 0 )
-			{
-				sp->loop_count--;
-			}
+			sp->frame_end = UINT64_MAX;
+		}
+		else if( sp->time >= duration )
+		{
+			sp->frame_end = duration;
+		}
+		else
+		{
+			sprite_state_frame_at( state, sprite_time_to_ms( sp->time ), &frame_end );
+			sp->frame_end = sprite_time_from_ms( frame_end );
 		}
 	}
+}
 
+/* Advances the player by the time that passed since its last update. */
+static inline const sprite_frame_t* sprite_player_update( sprite_player_t* sp )
+{
+	if( sp->clock )
+	{
+		sprite_time_t clock_now = sprite_clock_now( sp->clock );
+		sprite_time_t elapsed   = clock_now - sp->clock_time;
 
-	const sprite_frame_t* frame = sprite_state_frame( sp->state, sp->frame_index );
-	assert( frame );
-	uint32_t now    = sprite_timer( );
-	int32_t elapsed = now - sp->last_frame_time;
+		sp->clock_time = clock_now;
+		return sprite_player_advance( sp, elapsed );
+	}
+
+	uint32_t now = sprite_timer( );
+	uint32_t elapsed = now - sp->last_time;
 
-	if( sp->is_playing && elapsed > frame->time )
+	sp->last_time = now;
+	return sprite_player_advance( sp, sprite_time_from_ms( elapsed ) );
+}
+
+void sprite_player_render( sprite_player_t* sp, sprite_render_fxn_t render )
+{
+	const sprite_frame_t* frame = sprite_player_update( sp );
+
+	if( frame )
 	{
+		render( frame );
+	}
+}
+
+/*
+ * Updates many players and hands what they show to render in batches
+ * of up to capacity items, using items as the batch buffer. Players
+ * without a frame are left out.
+ */
+void sprite_player_render_batch( sprite_player_t** players, uint32_t count, sprite_render_item_t* items, uint32_t capacity, sprite_render_batch_fxn_t render, void* context )
+{
+	assert( players || count == 0 );
+	assert( items );
+	assert( capacity > 0 );
+	assert( render );
+	uint32_t size = 0;
+
+	for( uint32_t i = 0; i < count; i++ )
+	{
+		const sprite_frame_t* frame = sprite_player_update( players[ i ] );
+
+		if( frame )
+		{
+			items[ size ].user_data = players[ i ]->user_data;
+			items[ size ].sprite    = players[ i ]->sprite;
+			items[ size ].frame     = frame;
+
+			if( ++size == capacity )
+			{
+				render( context, items, size );
+				size = 0;
+			}
+		}
+	}
 
-		/* Show the next sprite frame */
-		sp->frame_index++;
-		sp->last_frame_time = now;
+	if( size > 0 )
+	{
+		render( context, items, size );
 	}
+}
 
-	return frame;
+const sprite_frame_t* sprite_player_frame( sprite_player_t* sp )
+{
+	return sprite_player_update( sp );
 }
 
+void sprite_player_memory_usage( const sprite_player_t* sp, sprite_memory_t* usage )
+{
+	assert( sp );
+	assert( usage );
 
-#define CLOCKS_PER_MILLISECOND   (CLOCKS_PER_SEC / 1000)
+	memset( usage, 0, sizeof(sprite_memory_t) );
+	usage->players     = sizeof(sprite_player_t);
+	usage->total       = usage->players;
+	usage->allocations = 1;
+}
 
 uint32_t default_timer( void )
 {
-	return (uint32_t) (clock() / CLOCKS_PER_MILLISECOND);
+	return sprite_time_to_ms( sprite_monotonic_time( ) );
 }
@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2012 by Joseph A. Marrero.  http://www.manvscode.com/
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef _SPRITE_PRIVATE_H_
+#define _SPRITE_PRIVATE_H_
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <assert.h>
+#include <libutility/utility.h>
+#ifdef __cplusplus
+extern "C" {
+#endif 
+#include "sprite.h"
+
+/*
+ * Declarations shared between the library's translation units.
+ * None of this is installed.
+ */
+
+/*
+ * The fourth byte of the file marker holds the byte order in the
+ * lowest bit and the file format version in the remaining bits.
+ * Files written before versioning was introduced are version 0.
+ *
+ *   Version 1: frames carry trim offsets and source dimensions.
+ *   Version 2: states carry per-frame metadata channels.
+ *   Version 3: sprites may reference a shared atlas file instead of
+ *              embedding their pixels.
+ *   Version 4: states may carry a tag per frame.
+ *   Version 5: sprites carry state machine conditions and transitions.
+ */
+#define SPRITE_FILE_VERSION                 (5)
+#define sprite_file_bom( version, big )     ((char) (((version) << 1) | ((big) ? 1 : 0)))
+#define sprite_file_version( bom )          (((uint8_t) (bom)) >> 1)
+#define sprite_file_is_big_endian( bom )    (((uint8_t) (bom)) & 1)
+
+/* Atlas files use the same marker layout with "SPA" as the marker. */
+#define SPRITE_ATLAS_FILE_VERSION           (1)
+
+struct sprite_atlas {
+	char     marker_and_bom[ 4 ]; // "SPA"0
+	uint16_t name_length;
+	char*    name;
+	uint16_t width;
+	uint16_t height;
+	uint8_t  bytes_per_pixel;
+	void*    pixels;
+	uint32_t pitch;      /* bytes from the start of one row to the next */
+	uint16_t alignment;  /* every row starts on a multiple of this many bytes */
+	sprite_free_fxn_t release; /* frees the pixels, NULL if they are borrowed */
+
+	/* regions changed by sprite_atlas_update_pixels() since the list was cleared */
+	uint8_t         dirty_count;
+	sprite_rect_t   dirty[ SPRITE_MAX_DIRTY_RECTS ];
+
+	/* Where the pixels were loaded from, so that a cache can evict
+	 * them and read them back on the next access. */
+	long            source_offset;        /* -1 if the pixels did not come from a file */
+	bool            source_is_big_endian;
+	char*           source;               /* NULL if the pixels did not come from a file */
+	uint32_t        pins;                 /* pinned atlases are never evicted */
+	sprite_cache_t* cache;
+	sprite_atlas_t* cache_prev;           /* more recently used */
+	sprite_atlas_t* cache_next;           /* less recently used */
+};
+
+#define sprite_atlas_tight_pitch( atlas )   ((uint32_t) (atlas)->width * (atlas)->bytes_per_pixel)
+
+bool sprite_atlas_allocate_pixels ( sprite_atlas_t* atlas, uint16_t w, uint16_t h, uint16_t bytes_per_pixel, uint16_t row_alignment );
+bool sprite_atlas_read_pixels     ( sprite_atlas_t* atlas, FILE* file, bool is_big_endian );
+bool sprite_atlas_write_pixels    ( const sprite_atlas_t* atlas, FILE* file, bool is_big_endian );
+
+sprite_time_t sprite_monotonic_time ( void );
+
+const uint32_t* sprite_state_tags  ( const sprite_state_t* state );
+void            sprite_events_emit ( sprite_events_t* events, const sprite_state_t* state, uint32_t player, const void* user_data,
+                                     int32_t from, uint16_t to, uint32_t loops, bool finished );
+
+const void* sprite_cache_touch    ( sprite_atlas_t* atlas );
+void        sprite_cache_unlink   ( sprite_atlas_t* atlas );
+
+/* Blends count RGBA pixels of src over dst. */
+typedef void (*sprite_blend_fxn_t) ( uint8_t* restrict dst, const uint8_t* restrict src, uint32_t count );
+
+typedef struct sprite_blend_kernel {
+	const char*        name;
+	sprite_blend_fxn_t blend;
+} sprite_blend_kernel_t;
+
+uint32_t sprite_canvas_blend_kernels ( const sprite_blend_kernel_t** kernels );
+
+#ifdef SPRITE_TELEMETRY
+/*
+ * Records a frame that was shown for shown milliseconds against its
+ * time, after which the player moved passed frames ahead.
+ */
+static inline void sprite_telemetry_frame( sprite_telemetry_t* telemetry, uint32_t shown, uint32_t time, uint32_t passed )
+{
+	uint32_t bucket = 0;
+
+	if( shown >= time )
+	{
+		uint32_t error = shown - time;
+
+		for( bucket = 1; error > 0 && bucket < SPRITE_TELEMETRY_BUCKETS - 1; bucket++ )
+		{
+			error >>= 1;
+		}
+	}
+
+	telemetry->display[ bucket ]++;
+	telemetry->frames++;
+	telemetry->dropped += passed - 1;
+}
+
+static inline void sprite_telemetry_update( sprite_telemetry_t* telemetry, sprite_time_t cost )
+{
+	telemetry->updates++;
+	telemetry->update_time += cost;
+
+	if( cost > telemetry->max_update_time )
+	{
+		telemetry->max_update_time = cost;
+	}
+}
+#endif
+
+#define SPRITE_USE_LITTLE_ENDIAN
+
+static inline size_t sprite_writef( void* ptr, size_t size, FILE* file, bool is_big_endian )
+{
+	size_t result = 0;
+
+	assert( file );
+	assert( ptr );
+	assert( size > 0 );
+
+	if( !feof(file) && !ferror(file) )
+	{
+		hton( ptr, size );
+		result = fwrite( ptr, size, 1, file );
+		ntoh( ptr, size ); /* don't mutate the sprite's data */
+	}
+
+
+	return result;
+}
+
+
+static inline size_t sprite_readf( void* ptr, size_t size, FILE* file, bool is_big_endian )
+{
+	size_t result = 0;
+
+	assert( file );
+	assert( ptr );
+	assert( size > 0 );
+
+	if( !feof(file) && !ferror(file) )
+	{
+		result = fread( ptr, size, 1, file );
+		ntoh( ptr, size );
+	}
+
+
+	return result;
+}
+
+#ifdef DEBUG_SPRITE
+#define sprite_read(ptr, size, file, is_big_endian)   if( sprite_readf(ptr, size, file, is_big_endian) != 1 )  {assert( false && "read failed" ); goto failure; }
+#define sprite_write(ptr, size, file, is_big_endian)  if( sprite_writef(ptr, size, file, is_big_endian) != 1 ) {assert( false && "write failed" ); goto failure; }
+#else
+#define sprite_read(ptr, size, file, is_big_endian)   if( sprite_readf(ptr, size, file, is_big_endian) != 1 )  goto failure;
+#define sprite_write(ptr, size, file, is_big_endian)  if( sprite_writef(ptr, size, file, is_big_endian) != 1 ) goto failure;
+#endif
+
+#ifdef __cplusplus
+}
+#endif 
+#endif /* _SPRITE_PRIVATE_H_ */
@@ -0,0 +1,279 @@
+/*
+ * Copyright (C) 2012 by Joseph A. Marrero.  http://www.manvscode.com/
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "sprite.h"
+#include "sprite-mem.h"
+#include "sprite-private.h"
+
+/*
+ * A track plays one state for any number of instances that animate
+ * in lock-step, such as torches or water tiles. The track's time is
+ * advanced once per tick, and an instance is only a phase: how far
+ * ahead of the track it runs. The frame showing at every point of a
+ * loop is kept in a table, at a resolution of the greatest common
+ * divisor of the frame times, so frame boundaries fall exactly on
+ * table entries. The table holds two loops, so an instance's frame is
+ * table[ tick + phase ] without a wrap around.
+ */
+struct sprite_track {
+	const sprite_t*       sprite;
+	const sprite_state_t* state;
+	const sprite_frame_t* frames;     /* first frame of the state */
+	uint16_t*             table;      /* frame index at each tick of two loops */
+	uint32_t              ticks;      /* of one loop */
+	uint32_t              resolution; /* milliseconds per tick */
+	uint32_t              duration;   /* of one loop, in milliseconds */
+	sprite_time_t         time;       /* into the current loop */
+	uint32_t              tick;       /* time in ticks */
+};
+
+#define SPRITE_TRACK_MAX_TICKS    65536
+
+static uint32_t sprite_track_gcd( uint32_t a, uint32_t b )
+{
+	while( b )
+	{
+		uint32_t r = a % b;
+		a = b;
+		b = r;
+	}
+
+	return a;
+}
+
+/*
+ * Creates a track that plays the named state of sprite. Returns NULL
+ * if the state does not exist, has no frames, or needs more than
+ * SPRITE_TRACK_MAX_TICKS table entries per loop.
+ */
+sprite_track_t* sprite_track_create( const sprite_t* sprite, const char* name )
+{
+	assert( sprite );
+	assert( name );
+	const sprite_state_t* state = sprite_state( sprite, name );
+
+	if( !state )
+	{
+		return NULL;
+	}
+
+	sprite_track_t* track = sprite_alloc( sizeof(sprite_track_t) );
+
+	if( track )
+	{
+		memset( track, 0, sizeof(sprite_track_t) );
+		track->sprite = sprite;
+
+		if( !sprite_track_set_state( track, state ) )
+		{
+			sprite_track_destroy( &track );
+		}
+	}
+
+	return track;
+}
+
+void sprite_track_destroy( sprite_track_t** track )
+{
+	if( *track )
+	{
+		sprite_free( (*track)->table );
+		sprite_free( *track );
+		*track = NULL;
+	}
+}
+
+/*
+ * Switches the track to another state of its sprite, or rebuilds the
+ * table after the current state's frames changed. The track's time is
+ * kept within the new loop. Phases from sprite_track_phase must be
+ * computed again. On failure the track is left as it was.
+ */
+bool sprite_track_set_state( sprite_track_t* track, const sprite_state_t* state )
+{
+	assert( track );
+	assert( state );
+	uint16_t frame_count = sprite_state_frame_count( state );
+	uint32_t duration    = sprite_state_duration( state );
+	uint32_t resolution  = 0;
+
+	if( frame_count == 0 )
+	{
+		goto failure;
+	}
+
+	for( uint16_t i = 0; i < frame_count; i++ )
+	{
+		resolution = sprite_track_gcd( resolution, sprite_state_frame_time( state, i ) );
+	}
+
+	if( duration == 0 )
+	{
+		/* frames that take no time never advance */
+		resolution = 1;
+	}
+
+	uint32_t ticks = duration > 0 ? duration / resolution : 1;
+
+	if( ticks > SPRITE_TRACK_MAX_TICKS )
+	{
+		goto failure;
+	}
+
+	uint16_t* table = sprite_alloc( sizeof(uint16_t) * 2 * ticks );
+
+	if( !table )
+	{
+		goto failure;
+	}
+
+	if( duration == 0 )
+	{
+		table[ 0 ] = 0;
+	}
+	else
+	{
+		for( uint32_t tick = 0; tick < ticks; )
+		{
+			uint32_t frame_end = 0;
+			uint16_t index     = sprite_state_frame_at( state, tick * resolution, &frame_end );
+
+			for( ; tick < frame_end / resolution; tick++ )
+			{
+				table[ tick ] = index;
+			}
+		}
+	}
+
+	memcpy( table + ticks, table, sizeof(uint16_t) * ticks );
+
+	sprite_free( track->table );
+	track->state      = state;
+	track->frames     = sprite_state_frame( state, 0 );
+	track->table      = table;
+	track->ticks      = ticks;
+	track->resolution = resolution;
+	track->duration   = duration;
+	sprite_track_seek( track, track->time );
+	return true;
+
+failure:
+	return false;
+}
+
+const sprite_state_t* sprite_track_state( const sprite_track_t* track )
+{
+	assert( track );
+	return track->state;
+}
+
+/*
+ * Moves the track to time into its state. Seeking to the reading of a
+ * clock every tick keeps tracks in step with the clock's players.
+ */
+void sprite_track_seek( sprite_track_t* track, sprite_time_t time )
+{
+	assert( track );
+	sprite_time_t loop = sprite_time_from_ms( track->duration );
+
+	track->time = loop > 0 ? time % loop : 0;
+	track->tick = (uint32_t) sprite_time_to_ms( track->time ) / track->resolution;
+}
+
+void sprite_track_advance( sprite_track_t* track, sprite_time_t dt )
+{
+	assert( track );
+	sprite_track_seek( track, track->time + dt );
+}
+
+/*
+ * Converts an offset, in milliseconds ahead of the track, to the phase
+ * of an instance. Offsets are rounded down to the track's resolution.
+ * Compute phases once, when instances are created.
+ */
+uint32_t sprite_track_phase( const sprite_track_t* track, uint32_t offset )
+{
+	assert( track );
+	return track->duration > 0 ? (offset % track->duration) / track->resolution : 0;
+}
+
+uint16_t sprite_track_frame_index( const sprite_track_t* track, uint32_t phase )
+{
+	assert( track );
+	assert( phase < track->ticks );
+	return track->table[ track->tick + phase ];
+}
+
+/* Frame showing for an instance with the given phase. */
+const sprite_frame_t* sprite_track_frame( const sprite_track_t* track, uint32_t phase )
+{
+	assert( track );
+	assert( phase < track->ticks );
+	return track->frames + track->table[ track->tick + phase ];
+}
+
+/*
+ * Hands the frames of count instances to render in batches of up to
+ * capacity items, using items as the batch buffer. phases holds the
+ * phase of each instance and may be NULL if all are in step, and
+ * user_data, if not NULL, what each item is tagged with.
+ */
+void sprite_track_render( const sprite_track_t* track, const uint32_t* phases, void* const* user_data, uint32_t count, sprite_render_item_t* items, uint32_t capacity, sprite_render_batch_fxn_t render, void* context )
+{
+	assert( track );
+	assert( items );
+	assert( capacity > 0 );
+	assert( render );
+	const uint16_t* table = track->table + track->tick;
+	uint32_t size = 0;
+
+	for( uint32_t i = 0; i < count; i++ )
+	{
+		items[ size ].user_data = user_data ? user_data[ i ] : NULL;
+		items[ size ].sprite    = track->sprite;
+		items[ size ].frame     = track->frames + table[ phases ? phases[ i ] : 0 ];
+
+		if( ++size == capacity )
+		{
+			render( context, items, size );
+			size = 0;
+		}
+	}
+
+	if( size > 0 )
+	{
+		render( context, items, size );
+	}
+}
+
+void sprite_track_memory_usage( const sprite_track_t* track, sprite_memory_t* usage )
+{
+	assert( track );
+	assert( usage );
+
+	memset( usage, 0, sizeof(sprite_memory_t) );
+	usage->players     = sizeof(sprite_track_t) + sizeof(uint16_t) * 2 * track->ticks;
+	usage->total       = usage->players;
+	usage->allocations = 2;
+}
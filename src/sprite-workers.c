@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2012 by Joseph A. Marrero.  http://www.manvscode.com/
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#define _POSIX_C_SOURCE 200112L /* pthreads */
+#include <stdlib.h>
+#include <assert.h>
+#include <pthread.h>
+#include "sprite.h"
+#include "sprite-mem.h"
+
+/*
+ * A small pool of threads for splitting work into chunks. The thread
+ * that dispatches a job works on it too. Chunks are handed out from a
+ * shared counter, so threads that finish early take the chunks that
+ * slower threads have not reached yet.
+ */
+struct sprite_workers {
+	pthread_mutex_t  lock;
+	pthread_cond_t   start;
+	pthread_cond_t   done;
+	pthread_t*       threads;
+	uint32_t         thread_count;
+	uint32_t         batch;      /* incremented for every dispatch */
+	uint32_t         busy;       /* threads still working on the batch */
+	bool             quit;
+
+	sprite_job_fxn_t fxn;
+	void*            job;
+	uint32_t         chunk_count;
+	uint32_t         next_chunk; /* only changed atomically */
+};
+
+static void sprite_workers_run( sprite_workers_t* workers )
+{
+	uint32_t chunk;
+
+	while( (chunk = __sync_fetch_and_add( &workers->next_chunk, 1 )) < workers->chunk_count )
+	{
+		workers->fxn( workers->job, chunk );
+	}
+}
+
+static void* sprite_workers_thread( void* arg )
+{
+	sprite_workers_t* workers = arg;
+	uint32_t batch = 0; /* a thread may start after the first dispatch */
+
+	pthread_mutex_lock( &workers->lock );
+
+	for( ;; )
+	{
+		while( workers->batch == batch && !workers->quit )
+		{
+			pthread_cond_wait( &workers->start, &workers->lock );
+		}
+
+		if( workers->quit )
+		{
+			break;
+		}
+
+		batch = workers->batch;
+		pthread_mutex_unlock( &workers->lock );
+
+		sprite_workers_run( workers );
+
+		pthread_mutex_lock( &workers->lock );
+		if( --workers->busy == 0 )
+		{
+			pthread_cond_signal( &workers->done );
+		}
+	}
+
+	pthread_mutex_unlock( &workers->lock );
+	return NULL;
+}
+
+/*
+ * Creates a pool with thread_count threads besides the thread that
+ * dispatches jobs. A pool without threads runs jobs on the caller.
+ */
+sprite_workers_t* sprite_workers_create( uint32_t thread_count )
+{
+	sprite_workers_t* workers = sprite_alloc( sizeof(sprite_workers_t) );
+	uint32_t started = 0;
+
+	if( !workers )
+	{
+		return NULL;
+	}
+
+	workers->threads      = NULL;
+	workers->thread_count = 0;
+	workers->batch        = 0;
+	workers->busy         = 0;
+	workers->quit         = false;
+	workers->fxn          = NULL;
+	workers->job          = NULL;
+	workers->chunk_count  = 0;
+	workers->next_chunk   = 0;
+
+	pthread_mutex_init( &workers->lock, NULL );
+	pthread_cond_init( &workers->start, NULL );
+	pthread_cond_init( &workers->done, NULL );
+
+	if( thread_count > 0 )
+	{
+		workers->threads = sprite_alloc( sizeof(pthread_t) * thread_count );
+
+		if( !workers->threads )
+		{
+			goto failure;
+		}
+
+		for( started = 0; started < thread_count; started++ )
+		{
+			if( pthread_create( &workers->threads[ started ], NULL, sprite_workers_thread, workers ) != 0 )
+			{
+				goto failure;
+			}
+		}
+	}
+
+	workers->thread_count = thread_count;
+	return workers;
+
+failure:
+	workers->thread_count = started;
+	sprite_workers_destroy( &workers );
+	return NULL;
+}
+
+void sprite_workers_destroy( sprite_workers_t** workers )
+{
+	if( *workers )
+	{
+		pthread_mutex_lock( &(*workers)->lock );
+		(*workers)->quit = true;
+		pthread_cond_broadcast( &(*workers)->start );
+		pthread_mutex_unlock( &(*workers)->lock );
+
+		for( uint32_t i = 0; i < (*workers)->thread_count; i++ )
+		{
+			pthread_join( (*workers)->threads[ i ], NULL );
+		}
+
+		pthread_cond_destroy( &(*workers)->done );
+		pthread_cond_destroy( &(*workers)->start );
+		pthread_mutex_destroy( &(*workers)->lock );
+		sprite_free( (*workers)->threads );
+		sprite_free( *workers );
+		*workers = NULL;
+	}
+}
+
+uint32_t sprite_workers_count( const sprite_workers_t* workers )
+{
+	return workers ? workers->thread_count + 1 : 1;
+}
+
+/*
+ * Calls fxn once for every chunk in [0, chunk_count) and returns when
+ * all of them are done. Chunks run in no particular order or thread.
+ * It has the signature of sprite_dispatch_fxn_t, with the pool as the
+ * context.
+ */
+void sprite_workers_dispatch( void* context, sprite_job_fxn_t fxn, void* job, uint32_t chunk_count )
+{
+	sprite_workers_t* workers = context;
+	assert( workers );
+	assert( fxn );
+
+	if( workers->thread_count == 0 || chunk_count <= 1 )
+	{
+		for( uint32_t chunk = 0; chunk < chunk_count; chunk++ )
+		{
+			fxn( job, chunk );
+		}
+		return;
+	}
+
+	pthread_mutex_lock( &workers->lock );
+	workers->fxn         = fxn;
+	workers->job         = job;
+	workers->chunk_count = chunk_count;
+	workers->next_chunk  = 0;
+	workers->busy        = workers->thread_count;
+	workers->batch      += 1;
+	pthread_cond_broadcast( &workers->start );
+	pthread_mutex_unlock( &workers->lock );
+
+	sprite_workers_run( workers );
+
+	pthread_mutex_lock( &workers->lock );
+	while( workers->busy > 0 )
+	{
+		pthread_cond_wait( &workers->done, &workers->lock );
+	}
+	pthread_mutex_unlock( &workers->lock );
+}
@@ -27,32 +27,82 @@
 #include <libutility/utility.h>
 #include "sprite.h"
 #include "sprite-mem.h"
+#include "sprite-private.h"
 
 #define UNKNOWN_NAME       ("<unknown>")
 
-
 struct sprite_state {
 	char     name[ SPRITE_MAX_STATE_NAME_LENGTH + 1 ];
+	uint32_t id;         /* sprite_tag( name ), for snapshots */
 	uint16_t const_time; /* optional. 0 means to ignore and use frame's time */
 	uint16_t loop_count; /* optional, 0 if loops forever */
 	lc_array_t  frames;
+
+	/* Frame timing, kept up to date as frames are added and removed.
+	 * frame_ends[ i ] is when frame i ends, relative to the start of
+	 * a loop, so the frame showing at any time is a binary search away.
+	 * States with a constant time do not need the table.
+	 */
+	uint32_t    duration;   /* of one loop, in milliseconds */
+	lc_array_t  frame_ends; /* uint32_t */
+
+	/* Metadata channels are stored frame-major so that all of the
+	 * metadata of a frame is adjacent: boxes[ frame * channel_count + channel ]
+	 */
+	uint8_t     channel_count;
+	lc_array_t  channels; /* sprite_channel_t */
+	lc_array_t  boxes;    /* sprite_box_t */
+
+	/* One tag per frame, 0 for untagged frames. Empty until a frame is tagged. */
+	lc_array_t  tags;     /* uint32_t */
+
+	/* Transitions compiled from the sprite's state machine: the target
+	 * of every condition that leaves the state, so that the next state
+	 * is found with a mask and a table lookup. NULL without transitions.
+	 */
+	uint32_t               transition_mask;
+	uint32_t               exit_mask;   /* transitions that wait for the end of a loop */
+	const sprite_state_t** transitions; /* one per condition of the sprite */
 };
 
+typedef struct sprite_channel {
+	char name[ SPRITE_MAX_CHANNEL_NAME_LENGTH + 1 ];
+} sprite_channel_t;
+
+typedef struct sprite_condition {
+	char name[ SPRITE_MAX_CONDITION_NAME_LENGTH + 1 ];
+} sprite_condition_t;
+
+/* A transition as described; states are referred to by id, 0 for any state. */
+typedef struct sprite_transition {
+	uint32_t from;
+	uint32_t to;
+	uint8_t  condition;
+	uint8_t  on_exit;
+} sprite_transition_t;
+
 struct sprite {
 	char     marker_and_bom[ 4 ]; // "SPR"0
 	uint16_t name_length;
 	char*    name;
-	uint16_t width;
-	uint16_t height;
-	uint8_t  bytes_per_pixel;
-	void*    pixels;
+	uint8_t  bytes_per_pixel; /* used until the sprite has an atlas */
+
+	sprite_atlas_t* atlas;
+	bool            owns_atlas;      /* true if the pixels are embedded in the sprite */
+	char*           atlas_reference; /* name of a shared atlas that has not been bound yet */
 
 	lc_tree_map_t states;  /* name -> state */
 	lc_tree_map_iterator_t state_itr;
+
+	/* state machine */
+	lc_array_t conditions;  /* sprite_condition_t */
+	lc_array_t transitions; /* sprite_transition_t, in order of priority */
 };
 
 static void   _sprite_create            ( sprite_t* p_sprite, const char* name, bool use_transparency );
 static void   _sprite_destroy           ( sprite_t* p_sprite );
+static void   sprite_state_update_timing ( sprite_state_t* p_state );
+static bool   sprite_compile_transitions ( sprite_t* p_sprite );
 
 
 sprite_state_t* sprite_state_create( const char* name )
@@ -63,11 +113,24 @@ sprite_state_t* sprite_state_create( const char* name )
 	{
 		strncpy( p_state->name, name, SPRITE_MAX_STATE_NAME_LENGTH );
 		p_state->name[ SPRITE_MAX_STATE_NAME_LENGTH ] = '\0';
+		p_state->id = sprite_tag( p_state->name );
 
 		p_state->const_time  = 0;
 		p_state->loop_count  = 0;
 
 		array_create( &p_state->frames, sizeof(sprite_frame_t), 0, sprite_alloc, sprite_free );
+
+		p_state->duration = 0;
+		array_create( &p_state->frame_ends, sizeof(uint32_t), 0, sprite_alloc, sprite_free );
+
+		p_state->channel_count = 0;
+		array_create( &p_state->channels, sizeof(sprite_channel_t), 0, sprite_alloc, sprite_free );
+		array_create( &p_state->boxes, sizeof(sprite_box_t), 0, sprite_alloc, sprite_free );
+		array_create( &p_state->tags, sizeof(uint32_t), 0, sprite_alloc, sprite_free );
+
+		p_state->transition_mask = 0;
+		p_state->exit_mask       = 0;
+		p_state->transitions     = NULL;
 	}
 
 	return p_state;
@@ -77,6 +140,11 @@ void sprite_state_destroy( sprite_state_t* p_state )
 {
 	assert( p_state );
 	array_destroy( &p_state->frames );
+	array_destroy( &p_state->frame_ends );
+	array_destroy( &p_state->channels );
+	array_destroy( &p_state->boxes );
+	array_destroy( &p_state->tags );
+	sprite_free( (void*) p_state->transitions );
 	sprite_free( p_state );
 }
 
@@ -120,21 +188,24 @@ void _sprite_create( sprite_t* p_sprite, const char* name, bool use_transparency
 	p_sprite->marker_and_bom[ 2 ] = 'R';
 
 	#ifdef SPRITE_USE_MACHINE_ENDIANNESS
-	p_sprite->marker_and_bom[ 3 ] = is_big_endian( );
+	p_sprite->marker_and_bom[ 3 ] = sprite_file_bom( SPRITE_FILE_VERSION, is_big_endian( ) );
 	#else
-	p_sprite->marker_and_bom[ 3 ] = 0; /* use little endian encoding */
+	p_sprite->marker_and_bom[ 3 ] = sprite_file_bom( SPRITE_FILE_VERSION, false ); /* use little endian encoding */
 	#endif
 
-	p_sprite->name            = strdup( name );
+	p_sprite->name            = sprite_strdup( name );
 	p_sprite->name_length     = strlen( name );
-	p_sprite->width           = 0;
-	p_sprite->height          = 0;
 	p_sprite->bytes_per_pixel = use_transparency ? 4 : 3;
-	p_sprite->pixels          = NULL;
+	p_sprite->atlas           = NULL;
+	p_sprite->owns_atlas      = false;
+	p_sprite->atlas_reference = NULL;
 
 	tree_map_create( &p_sprite->states, (tree_map_element_function) sprite_state_map_destroy,
   	                 (tree_map_compare_function) sprite_state_name_compare, sprite_alloc, sprite_free );
 	p_sprite->state_itr = NULL;
+
+	array_create( &p_sprite->conditions, sizeof(sprite_condition_t), 0, sprite_alloc, sprite_free );
+	array_create( &p_sprite->transitions, sizeof(sprite_transition_t), 0, sprite_alloc, sprite_free );
 }
 
 void sprite_destroy( sprite_t** p_sprite )
@@ -165,18 +236,19 @@ void _sprite_destroy( sprite_t* p_sprite )
 		#endif
 	}
 
-	if( p_sprite->pixels )
+	if( p_sprite->owns_atlas )
 	{
-		sprite_free( p_sprite->pixels );
-		#ifdef SPRITE_DEBUG
-		p_sprite->width           = 0;
-		p_sprite->height          = 0;
-		p_sprite->bytes_per_pixel = 0;
-		p_sprite->pixels          = NULL;
-		#endif
+		sprite_atlas_destroy( &p_sprite->atlas );
+	}
+
+	if( p_sprite->atlas_reference )
+	{
+		sprite_free( p_sprite->atlas_reference );
 	}
 
 	tree_map_destroy( &p_sprite->states );
+	array_destroy( &p_sprite->conditions );
+	array_destroy( &p_sprite->transitions );
 }
 
 void sprite_set_name( sprite_t* p_sprite, const char* name )
@@ -191,25 +263,120 @@ void sprite_set_name( sprite_t* p_sprite, const char* name )
 		name = "unknown";
 	}
 
-	p_sprite->name        = strdup( name );
+	p_sprite->name        = sprite_strdup( name );
 	p_sprite->name_length = strlen( name );
 }
 
 void sprite_set_texture( sprite_t* p_sprite, uint16_t w, uint16_t h, uint16_t bytes_per_pixel, const void* pixels )
 {
 	assert( p_sprite );
-	p_sprite->width           = w;
-	p_sprite->height          = h;
 	p_sprite->bytes_per_pixel = bytes_per_pixel;
 
-	if( p_sprite->pixels )
+	if( p_sprite->owns_atlas )
+	{
+		sprite_atlas_set_texture( p_sprite->atlas, w, h, bytes_per_pixel, pixels );
+	}
+	else
+	{
+		sprite_set_atlas( p_sprite, NULL );
+		p_sprite->atlas      = sprite_atlas_create( p_sprite->name, w, h, bytes_per_pixel, pixels );
+		p_sprite->owns_atlas = p_sprite->atlas != NULL;
+	}
+}
+
+/* Returns the sprite's private atlas, replacing a shared one if needed. */
+static sprite_atlas_t* sprite_private_atlas( sprite_t* p_sprite )
+{
+	if( !p_sprite->owns_atlas )
+	{
+		sprite_set_atlas( p_sprite, NULL );
+		p_sprite->atlas      = sprite_atlas_create( p_sprite->name, 0, 0, p_sprite->bytes_per_pixel, NULL );
+		p_sprite->owns_atlas = p_sprite->atlas != NULL;
+	}
+
+	return p_sprite->atlas;
+}
+
+/*
+ * The sprite takes ownership of the pixels without copying them.
+ * They are passed to release when the sprite no longer needs them.
+ */
+bool sprite_take_texture( sprite_t* p_sprite, uint16_t w, uint16_t h, uint16_t bytes_per_pixel, void* pixels, uint32_t pitch, sprite_free_fxn_t release )
+{
+	assert( p_sprite );
+	sprite_atlas_t* atlas = sprite_private_atlas( p_sprite );
+
+	if( atlas )
+	{
+		p_sprite->bytes_per_pixel = bytes_per_pixel;
+		return sprite_atlas_take_pixels( atlas, w, h, bytes_per_pixel, pixels, pitch, release );
+	}
+
+	return false;
+}
+
+/*
+ * The sprite uses the pixels without copying them. The caller must keep
+ * them alive for as long as the sprite uses them.
+ */
+bool sprite_borrow_texture( sprite_t* p_sprite, uint16_t w, uint16_t h, uint16_t bytes_per_pixel, const void* pixels, uint32_t pitch )
+{
+	assert( p_sprite );
+	sprite_atlas_t* atlas = sprite_private_atlas( p_sprite );
+
+	if( atlas )
+	{
+		p_sprite->bytes_per_pixel = bytes_per_pixel;
+		return sprite_atlas_borrow_pixels( atlas, w, h, bytes_per_pixel, pixels, pitch );
+	}
+
+	return false;
+}
+
+/*
+ * Makes the sprite reference a shared atlas instead of owning its
+ * pixels. The atlas must outlive the sprite.
+ */
+void sprite_set_atlas( sprite_t* p_sprite, sprite_atlas_t* atlas )
+{
+	assert( p_sprite );
+
+	if( p_sprite->owns_atlas )
+	{
+		sprite_atlas_destroy( &p_sprite->atlas );
+		p_sprite->owns_atlas = false;
+	}
+
+	if( p_sprite->atlas_reference )
+	{
+		sprite_free( p_sprite->atlas_reference );
+		p_sprite->atlas_reference = NULL;
+	}
+
+	p_sprite->atlas = atlas;
+}
+
+sprite_atlas_t* sprite_atlas( const sprite_t* p_sprite )
+{
+	return p_sprite ? p_sprite->atlas : NULL;
+}
+
+/*
+ * Returns the name of the shared atlas the sprite refers to, or NULL
+ * if the sprite embeds its own pixels. Sprites loaded from a file
+ * that refers to an atlas keep the name until an atlas is bound with
+ * sprite_set_atlas().
+ */
+const char* sprite_atlas_reference( const sprite_t* p_sprite )
+{
+	assert( p_sprite );
+
+	if( p_sprite->atlas_reference )
 	{
-		sprite_free( p_sprite->pixels );
+		return p_sprite->atlas_reference;
 	}
 
-	size_t size = sizeof(uint8_t) * p_sprite->width * p_sprite->height * p_sprite->bytes_per_pixel;
-	p_sprite->pixels = sprite_alloc( size );
-	memcpy( p_sprite->pixels, pixels, size );
+	return p_sprite->atlas && !p_sprite->owns_atlas ? sprite_atlas_name( p_sprite->atlas ) : NULL;
 }
 
 
@@ -221,7 +388,16 @@ bool sprite_add_state( sprite_t* p_sprite, const char* name )
 	{
 		sprite_state_t* p_state = sprite_state_create( name );
 
-		result = tree_map_insert( &p_sprite->states, p_state->name, p_state );
+		/* state ids must be unique within a sprite */
+		if( sprite_state_by_id( p_sprite, p_state->id ) )
+		{
+			sprite_state_destroy( p_state );
+		}
+		else
+		{
+			result = tree_map_insert( &p_sprite->states, p_state->name, p_state );
+			sprite_compile_transitions( p_sprite );
+		}
 	}
 
 	return result;
@@ -237,18 +413,7 @@ bool sprite_add_frame( sprite_t* p_sprite, const char* state, uint16_t x, uint16
 
 		if( tree_map_find( &p_sprite->states, state, (void**) &p_state ) )
 		{
-			size_t new_array_size = array_size(&p_state->frames) + 1;
-			array_resize( &p_state->frames, new_array_size );
-
-			sprite_frame_t* p_frame = array_elem( &p_state->frames, new_array_size - 1, sprite_frame_t );
-
-			p_frame->x      = x;
-			p_frame->y      = y;
-			p_frame->width  = width;
-			p_frame->height = height;
-			p_frame->time   = time;
-
-			result = true;
+			result = sprite_state_add_frame( p_state, x, y, width, height, time );
 		}
 	}
 
@@ -275,11 +440,78 @@ bool sprite_remove_state( sprite_t* p_sprite, const char* name )
 	if( p_sprite && name )
 	{
 		result = tree_map_remove( &p_sprite->states, name );
+		sprite_compile_transitions( p_sprite );
 	}
 
 	return result;
 }
 
+/*
+ * Renames a state. The state is keyed by its name and referred to by
+ * its id in transitions, so it moves to a new state under the new name
+ * and the transitions follow it; pointers to the old state are no
+ * longer valid afterwards. Fails if the new name or its id is taken.
+ */
+bool sprite_rename_state( sprite_t* p_sprite, const char* state, const char* name )
+{
+	assert( p_sprite );
+	assert( state );
+	assert( name );
+
+	sprite_state_t* p_state = NULL;
+
+	if( !tree_map_find( &p_sprite->states, state, (void**) &p_state ) )
+	{
+		return false;
+	}
+
+	sprite_state_t* p_renamed = sprite_state_create( name );
+
+	if( !p_renamed )
+	{
+		return false;
+	}
+
+	uint32_t old_id = p_state->id;
+	uint32_t new_id = p_renamed->id;
+
+	if( sprite_state_by_id( p_sprite, new_id ) ||
+	    !tree_map_insert( &p_sprite->states, p_renamed->name, p_renamed ) )
+	{
+		sprite_state_destroy( p_renamed );
+		return false;
+	}
+
+	/* move everything but the name over, then drop the emptied state */
+	sprite_state_t moved = *p_state;
+	memcpy( moved.name, p_renamed->name, sizeof(moved.name) );
+	moved.id = new_id;
+	array_destroy( &p_renamed->frames );
+	array_destroy( &p_renamed->frame_ends );
+	array_destroy( &p_renamed->channels );
+	array_destroy( &p_renamed->boxes );
+	array_destroy( &p_renamed->tags );
+	*p_renamed = moved;
+
+	array_create( &p_state->frames, sizeof(sprite_frame_t), 0, sprite_alloc, sprite_free );
+	array_create( &p_state->frame_ends, sizeof(uint32_t), 0, sprite_alloc, sprite_free );
+	array_create( &p_state->channels, sizeof(sprite_channel_t), 0, sprite_alloc, sprite_free );
+	array_create( &p_state->boxes, sizeof(sprite_box_t), 0, sprite_alloc, sprite_free );
+	array_create( &p_state->tags, sizeof(uint32_t), 0, sprite_alloc, sprite_free );
+	p_state->transitions = NULL;
+	tree_map_remove( &p_sprite->states, state );
+
+	for( size_t i = 0; i < array_size( &p_sprite->transitions ); i++ )
+	{
+		sprite_transition_t* t = array_elem( &p_sprite->transitions, i, sprite_transition_t );
+		t->from = t->from == old_id ? new_id : t->from;
+		t->to   = t->to == old_id ? new_id : t->to;
+	}
+
+	sprite_compile_transitions( p_sprite );
+	return true;
+}
+
 bool sprite_remove_frame( sprite_t* p_sprite, const char* state, uint16_t index )
 {
 	bool result = false;
@@ -306,6 +538,26 @@ bool sprite_remove_frame( sprite_t* p_sprite, const char* state, uint16_t index
 			/* decrease the array by 1 */
 			size_t new_array_size = array_size(&p_state->frames) - 1;
 			array_resize( &p_state->frames, new_array_size );
+
+			if( p_state->channel_count > 0 )
+			{
+				size_t stride = p_state->channel_count;
+				sprite_box_t* boxes = array_elem( &p_state->boxes, 0, sprite_box_t );
+
+				memmove( boxes + index * stride, boxes + (index + 1) * stride, (new_array_size - index) * stride * sizeof(sprite_box_t) );
+				array_resize( &p_state->boxes, new_array_size * stride );
+			}
+
+			if( array_size( &p_state->tags ) > 0 )
+			{
+				uint32_t* tags = array_elem( &p_state->tags, 0, uint32_t );
+
+				memmove( tags + index, tags + index + 1, (new_array_size - index) * sizeof(uint32_t) );
+				array_resize( &p_state->tags, new_array_size );
+			}
+
+			sprite_state_update_timing( p_state );
+
 			result = true;
 		}
 	}
@@ -320,27 +572,45 @@ const char* sprite_name( const sprite_t* p_sprite )
 
 uint16_t sprite_width( const sprite_t* p_sprite )
 {
-	return p_sprite ? p_sprite->width : 0;
+	return p_sprite && p_sprite->atlas ? p_sprite->atlas->width : 0;
 }
 
 uint16_t sprite_height( const sprite_t* p_sprite )
 {
-	return p_sprite ? p_sprite->height : 0;
+	return p_sprite && p_sprite->atlas ? p_sprite->atlas->height : 0;
 }
 
 uint16_t sprite_bit_depth( const sprite_t* p_sprite )
 {
-	return p_sprite ? p_sprite->bytes_per_pixel << 3 : 0;
+	return sprite_bytes_per_pixel( p_sprite ) << 3;
 }
 
 uint16_t sprite_bytes_per_pixel( const sprite_t* p_sprite )
 {
-	return p_sprite ? p_sprite->bytes_per_pixel : 0;
+	if( !p_sprite ) return 0;
+	return p_sprite->atlas ? p_sprite->atlas->bytes_per_pixel : p_sprite->bytes_per_pixel;
 }
 
+/* NULL while a cache has evicted the pixels, see sprite_atlas_pin_pixels(). */
 const void* sprite_pixels( const sprite_t* p_sprite )
 {
-	return p_sprite ? p_sprite->pixels : NULL;
+	return p_sprite && p_sprite->atlas ? sprite_atlas_pixels( p_sprite->atlas ) : NULL;
+}
+
+uint32_t sprite_pitch( const sprite_t* p_sprite )
+{
+	return p_sprite && p_sprite->atlas ? p_sprite->atlas->pitch : 0;
+}
+
+/*
+ * Writes into a region of the sprite's atlas. The regions changed
+ * since the last sprite_atlas_clear_dirty() are listed by
+ * sprite_atlas_dirty_rects().
+ */
+bool sprite_update_pixels( sprite_t* p_sprite, uint16_t x, uint16_t y, uint16_t w, uint16_t h, const void* pixels, uint32_t pitch )
+{
+	assert( p_sprite );
+	return p_sprite->atlas ? sprite_atlas_update_pixels( p_sprite->atlas, x, y, w, h, pixels, pitch ) : false;
 }
 
 sprite_state_t* sprite_state( const sprite_t* p_sprite, const char* state )
@@ -357,6 +627,31 @@ sprite_state_t* sprite_state( const sprite_t* p_sprite, const char* state )
 	return NULL;
 }
 
+/*
+ * Finds a state by its id, which is stable across runs, unlike the
+ * state's address. Ids come from sprite_state_id.
+ */
+sprite_state_t* sprite_state_by_id( const sprite_t* p_sprite, uint32_t id )
+{
+	if( p_sprite && id )
+	{
+		lc_tree_map_iterator_t itr;
+		for( itr = tree_map_begin( (lc_tree_map_t*) &p_sprite->states );
+		     itr != tree_map_end( );
+		     itr = tree_map_next( itr ) )
+		{
+			sprite_state_t* p_state = itr->value;
+
+			if( p_state->id == id )
+			{
+				return p_state;
+			}
+		}
+	}
+
+	return NULL;
+}
+
 sprite_state_t* sprite_first_state( sprite_t* p_sprite )
 {
 	if( p_sprite && sprite_state_count(p_sprite) > 0 )
@@ -399,28 +694,30 @@ const char* sprite_state_name( const sprite_state_t* p_state )
 	return p_state ? p_state->name : UNKNOWN_NAME;
 }
 
-uint16_t sprite_state_const_time( const sprite_state_t* p_state )
+/* A hash of the state's name; never 0. */
+uint32_t sprite_state_id( const sprite_state_t* p_state )
 {
 	assert( p_state );
-	return p_state->const_time;
+	return p_state->id;
 }
 
-uint16_t sprite_state_loop_count( const sprite_state_t* p_state )
+uint16_t sprite_state_const_time( const sprite_state_t* p_state )
 {
 	assert( p_state );
-	return p_state->loop_count;
+	return p_state->const_time;
 }
 
-void sprite_state_set_name( sprite_state_t* p_state, const char* name )
+uint16_t sprite_state_loop_count( const sprite_state_t* p_state )
 {
 	assert( p_state );
-	strcpy( p_state->name, name );
+	return p_state->loop_count;
 }
 
 void sprite_state_set_const_time( sprite_state_t* p_state, uint16_t time )
 {
 	assert( p_state );
 	p_state->const_time = time;
+	sprite_state_update_timing( p_state );
 }
 
 void sprite_state_set_loop_count( sprite_state_t* p_state, uint16_t loop_count )
@@ -430,6 +727,12 @@ void sprite_state_set_loop_count( sprite_state_t* p_state, uint16_t loop_count )
 }
 
 bool sprite_state_add_frame( sprite_state_t* p_state, uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint16_t time )
+{
+	return sprite_state_add_trimmed_frame( p_state, x, y, width, height, time, 0, 0, width, height );
+}
+
+bool sprite_state_add_trimmed_frame( sprite_state_t* p_state, uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint16_t time,
+                                     uint16_t offset_x, uint16_t offset_y, uint16_t source_width, uint16_t source_height )
 {
 	bool result = false;
 
@@ -440,11 +743,39 @@ bool sprite_state_add_frame( sprite_state_t* p_state, uint16_t x, uint16_t y, ui
 
 		sprite_frame_t* p_frame = array_elem( &p_state->frames, new_array_size - 1, sprite_frame_t );
 
-		p_frame->x      = x;
-		p_frame->y      = y;
-		p_frame->width  = width;
-		p_frame->height = height;
-		p_frame->time   = time;
+		p_frame->x             = x;
+		p_frame->y             = y;
+		p_frame->width         = width;
+		p_frame->height        = height;
+		p_frame->time          = time;
+		p_frame->offset_x      = offset_x;
+		p_frame->offset_y      = offset_y;
+		p_frame->source_width  = source_width;
+		p_frame->source_height = source_height;
+
+		if( p_state->channel_count > 0 )
+		{
+			size_t box_count = new_array_size * p_state->channel_count;
+			array_resize( &p_state->boxes, box_count );
+			memset( array_elem( &p_state->boxes, box_count - p_state->channel_count, sprite_box_t ), 0, sizeof(sprite_box_t) * p_state->channel_count );
+		}
+
+		if( array_size( &p_state->tags ) > 0 )
+		{
+			array_resize( &p_state->tags, new_array_size );
+			*array_elem( &p_state->tags, new_array_size - 1, uint32_t ) = 0;
+		}
+
+		if( p_state->const_time > 0 )
+		{
+			p_state->duration += p_state->const_time;
+		}
+		else
+		{
+			p_state->duration += time;
+			array_resize( &p_state->frame_ends, new_array_size );
+			*array_elem( &p_state->frame_ends, new_array_size - 1, uint32_t ) = p_state->duration;
+		}
 
 		result = true;
 	}
@@ -464,142 +795,794 @@ const sprite_frame_t* sprite_state_frame( const sprite_state_t* p_state, uint16_
 	return array_elem( (lc_array_t*) &p_state->frames, index, sprite_frame_t );
 }
 
-#define SPRITE_USE_LITTLE_ENDIAN
-
-static inline size_t sprite_writef( void* ptr, size_t size, FILE* file, bool is_big_endian )
+/*
+ * Tags are 32-bit hashes of names such as "footstep", so comparing them
+ * is cheap. Only the hash is stored; 0 is never returned.
+ */
+uint32_t sprite_tag( const char* name )
 {
-	size_t result = 0;
+	uint32_t hash = 2166136261u; /* FNV-1a */
 
-	assert( file );
-	assert( ptr );
-	assert( size > 0 );
+	assert( name );
 
-	if( !feof(file) && !ferror(file) )
+	while( *name )
 	{
-		hton( ptr, size );
-		result = fwrite( ptr, size, 1, file );
-		ntoh( ptr, size ); /* don't mutate the sprite's data */
+		hash ^= (uint8_t) *name++;
+		hash *= 16777619u;
 	}
 
+	return hash ? hash : 1;
+}
 
-	return result;
+/*
+ * Tags a frame so that players report an event when the frame is
+ * entered. A tag of 0 removes the frame's tag. Frames that take no
+ * time can carry tags as pure event markers.
+ */
+bool sprite_state_set_frame_tag( sprite_state_t* p_state, uint16_t index, uint32_t tag )
+{
+	assert( p_state );
+	size_t frame_count = array_size( &p_state->frames );
+
+	if( index >= frame_count )
+	{
+		return false;
+	}
+
+	if( array_size( &p_state->tags ) == 0 )
+	{
+		if( tag == 0 )
+		{
+			return true;
+		}
+
+		if( !array_resize( &p_state->tags, frame_count ) )
+		{
+			return false;
+		}
+
+		memset( array_elem( &p_state->tags, 0, uint32_t ), 0, frame_count * sizeof(uint32_t) );
+	}
+
+	*array_elem( &p_state->tags, index, uint32_t ) = tag;
+	return true;
 }
 
+uint32_t sprite_state_frame_tag( const sprite_state_t* p_state, uint16_t index )
+{
+	assert( p_state );
+	assert( index < array_size(&p_state->frames) );
+	return array_size( &p_state->tags ) > 0 ? *array_elem( (lc_array_t*) &p_state->tags, index, uint32_t ) : 0;
+}
 
-static inline size_t sprite_readf( void* ptr, size_t size, FILE* file, bool is_big_endian )
+/* The tag of every frame, or NULL if no frame is tagged. */
+const uint32_t* sprite_state_tags( const sprite_state_t* p_state )
 {
-	size_t result = 0;
+	return array_size( &p_state->tags ) > 0 ? array_elem( (lc_array_t*) &p_state->tags, 0, uint32_t ) : NULL;
+}
 
-	assert( file );
-	assert( ptr );
-	assert( size > 0 );
+static void sprite_state_update_timing( sprite_state_t* p_state )
+{
+	size_t frame_count = array_size( &p_state->frames );
 
-	if( !feof(file) && !ferror(file) )
+	if( p_state->const_time > 0 )
 	{
-		result = fread( ptr, size, 1, file );
-		ntoh( ptr, size );
+		p_state->duration = (uint32_t) p_state->const_time * frame_count;
+		array_resize( &p_state->frame_ends, 0 );
+		return;
 	}
 
+	array_resize( &p_state->frame_ends, frame_count );
+	p_state->duration = 0;
 
-	return result;
+	for( size_t i = 0; i < frame_count; i++ )
+	{
+		p_state->duration += array_elem( &p_state->frames, i, sprite_frame_t )->time;
+		*array_elem( &p_state->frame_ends, i, uint32_t ) = p_state->duration;
+	}
 }
 
-#ifdef DEBUG_SPRITE
-#define sprite_read(ptr, size, file, is_big_endian)   if( sprite_readf(ptr, size, file, is_big_endian) != 1 )  {assert( false && "read failed" ); goto failure; }
-#define sprite_write(ptr, size, file, is_big_endian)  if( sprite_writef(ptr, size, file, is_big_endian) != 1 ) {assert( false && "write failed" ); goto failure; }
-#else
-#define sprite_read(ptr, size, file, is_big_endian)   if( sprite_readf(ptr, size, file, is_big_endian) != 1 )  goto failure;
-#define sprite_write(ptr, size, file, is_big_endian)  if( sprite_writef(ptr, size, file, is_big_endian) != 1 ) goto failure;
-#endif
+/* How long a frame shows, honoring the state's constant time. */
+uint16_t sprite_state_frame_time( const sprite_state_t* p_state, uint16_t index )
+{
+	assert( p_state );
+	assert( index < array_size(&p_state->frames) );
+	return p_state->const_time > 0 ? p_state->const_time : array_elem( (lc_array_t*) &p_state->frames, index, sprite_frame_t )->time;
+}
 
+/* The time one loop through the state takes, in milliseconds. */
+uint32_t sprite_state_duration( const sprite_state_t* p_state )
+{
+	assert( p_state );
+	return p_state->duration;
+}
 
-sprite_t* sprite_from_file( const char* filename )
+/*
+ * Returns the index of the frame that is showing at time milliseconds
+ * into a loop, which must be less than the state's duration, and when
+ * that frame ends. Frames that take no time are never showing. This is
+ * O(1) for states with a constant time and O(log frames) otherwise.
+ */
+uint16_t sprite_state_frame_at( const sprite_state_t* p_state, uint32_t time, uint32_t* frame_end )
 {
-	sprite_t* p_sprite = NULL;
-	FILE* file = fopen( filename, "rb" );
+	assert( p_state );
+	assert( time < p_state->duration || p_state->duration == 0 );
 
-	if( !file )
+	if( p_state->duration == 0 )
 	{
-		goto failure;
+		*frame_end = 0;
+		return 0;
 	}
 
-	#ifdef DEBUG_SPRITE
-	printf( "[Sprite] Opening: %s\n", filename );
-	#endif
+	if( p_state->const_time > 0 )
+	{
+		uint16_t index = time / p_state->const_time;
+		*frame_end = (uint32_t) (index + 1) * p_state->const_time;
+		return index;
+	}
 
-	char marker_and_bom[ 4 ] = { 0 };
-	fread( marker_and_bom, sizeof(char), sizeof(marker_and_bom), file );
+	/* find the first frame that ends after time */
+	const uint32_t* ends = array_elem( (lc_array_t*) &p_state->frame_ends, 0, uint32_t );
+	size_t low  = 0;
+	size_t high = array_size( &p_state->frame_ends ) - 1;
 
-	if( marker_and_bom[ 0 ] != 'S' || marker_and_bom[ 1 ] != 'P' || marker_and_bom[ 2 ] != 'R' )
+	while( low < high )
 	{
-		goto failure;
+		size_t middle = low + (high - low) / 2;
+
+		if( ends[ middle ] > time )
+		{
+			high = middle;
+		}
+		else
+		{
+			low = middle + 1;
+		}
 	}
 
-	bool is_big_endian = marker_and_bom[ 3 ];
-	p_sprite = sprite_create( NULL, true );
-	memcpy( p_sprite->marker_and_bom, marker_and_bom, sizeof(char) * 4 );
+	*frame_end = ends[ low ];
+	return (uint16_t) low;
+}
 
+/*
+ * Adds a named metadata channel to every frame of the state. The
+ * returned index is used to access the channel's boxes. Existing
+ * frames get an empty box.
+ */
+int8_t sprite_state_add_channel( sprite_state_t* p_state, const char* name )
+{
+	assert( p_state );
+	assert( name );
 
-	sprite_read( &p_sprite->name_length, sizeof(p_sprite->name_length), file, is_big_endian );
-	assert( p_sprite->name_length > 0 );
-	p_sprite->name = sprite_alloc( sizeof(char) * p_sprite->name_length );
-	fread( p_sprite->name, sizeof(char), p_sprite->name_length + 1, file );
+	int8_t channel = sprite_state_channel( p_state, name );
 
-	sprite_read( &p_sprite->width, sizeof(p_sprite->width), file, is_big_endian );
-	sprite_read( &p_sprite->height, sizeof(p_sprite->height), file, is_big_endian );
-	fread( &p_sprite->bytes_per_pixel, sizeof(uint8_t), 1, file );
+	if( channel >= 0 )
+	{
+		return channel;
+	}
 
-	size_t pixel_size = sizeof(uint8_t) * p_sprite->width * p_sprite->height * p_sprite->bytes_per_pixel;
-	if( pixel_size > 0 )
+	if( p_state->channel_count >= SPRITE_MAX_CHANNELS )
 	{
-		p_sprite->pixels = sprite_alloc( pixel_size );
-		sprite_read( p_sprite->pixels, pixel_size, file, is_big_endian );
+		return -1;
 	}
 
-	uint16_t state_count = 0;
-	sprite_read( &state_count, sizeof(state_count), file, is_big_endian );
+	size_t frame_count   = array_size( &p_state->frames );
+	size_t old_stride    = p_state->channel_count;
+	size_t new_stride    = old_stride + 1;
+	lc_array_t new_boxes;
 
-	while( state_count-- > 0 )
+	if( !array_create( &new_boxes, sizeof(sprite_box_t), frame_count * new_stride, sprite_alloc, sprite_free ) ||
+	    !array_resize( &new_boxes, frame_count * new_stride ) )
 	{
-		sprite_state_t* state = sprite_state_create( UNKNOWN_NAME );
+		array_destroy( &new_boxes );
+		return -1;
+	}
 
+	for( size_t i = 0; i < frame_count; i++ )
+	{
+		sprite_box_t* dst = array_elem( &new_boxes, i * new_stride, sprite_box_t );
 
-		fread( state->name, sizeof(char), SPRITE_MAX_STATE_NAME_LENGTH + 1, file );
-		sprite_read( &state->const_time, sizeof(state->const_time), file, is_big_endian );
-		sprite_read( &state->loop_count, sizeof(state->loop_count), file, is_big_endian );
+		if( old_stride > 0 )
+		{
+			memcpy( dst, array_elem( &p_state->boxes, i * old_stride, sprite_box_t ), sizeof(sprite_box_t) * old_stride );
+		}
 
-		tree_map_insert( &p_sprite->states, state->name, state );
+		memset( dst + old_stride, 0, sizeof(sprite_box_t) );
+	}
 
-		uint16_t frame_count = 0;
-		sprite_read( &frame_count, sizeof(frame_count), file, is_big_endian );
+	array_destroy( &p_state->boxes );
+	p_state->boxes = new_boxes;
 
+	array_resize( &p_state->channels, new_stride );
+	sprite_channel_t* c = array_elem( &p_state->channels, old_stride, sprite_channel_t );
+	strncpy( c->name, name, SPRITE_MAX_CHANNEL_NAME_LENGTH );
+	c->name[ SPRITE_MAX_CHANNEL_NAME_LENGTH ] = '\0';
 
-		while( frame_count-- > 0 )
-		{
-			uint16_t x = 0;
-			uint16_t y = 0;
-			uint16_t width = 0;
-			uint16_t height = 0;
-			uint16_t time = 0;
+	p_state->channel_count = new_stride;
+	return (int8_t) old_stride;
+}
 
-			sprite_read( &x, sizeof(x), file, is_big_endian );
-			sprite_read( &y, sizeof(y), file, is_big_endian );
+/*
+ * Returns the index of a channel or -1 if the state has no such
+ * channel. Look channels up once and keep the index around.
+ */
+int8_t sprite_state_channel( const sprite_state_t* p_state, const char* name )
+{
+	assert( p_state );
+
+	for( uint8_t i = 0; i < p_state->channel_count; i++ )
+	{
+		const sprite_channel_t* c = array_elem( (lc_array_t*) &p_state->channels, i, sprite_channel_t );
+
+		if( strncasecmp( c->name, name, SPRITE_MAX_CHANNEL_NAME_LENGTH ) == 0 )
+		{
+			return (int8_t) i;
+		}
+	}
+
+	return -1;
+}
+
+uint8_t sprite_state_channel_count( const sprite_state_t* p_state )
+{
+	assert( p_state );
+	return p_state->channel_count;
+}
+
+const char* sprite_state_channel_name( const sprite_state_t* p_state, uint8_t channel )
+{
+	assert( p_state );
+	assert( channel < p_state->channel_count );
+	return array_elem( (lc_array_t*) &p_state->channels, channel, sprite_channel_t )->name;
+}
+
+bool sprite_state_set_frame_box( sprite_state_t* p_state, uint8_t channel, uint16_t index, const sprite_box_t* box )
+{
+	assert( p_state );
+	assert( box );
+
+	if( channel >= p_state->channel_count || index >= array_size(&p_state->frames) )
+	{
+		return false;
+	}
+
+	*array_elem( &p_state->boxes, (size_t) index * p_state->channel_count + channel, sprite_box_t ) = *box;
+	return true;
+}
+
+const sprite_box_t* sprite_state_frame_box( const sprite_state_t* p_state, uint8_t channel, uint16_t index )
+{
+	assert( p_state );
+	assert( channel < p_state->channel_count );
+	assert( index < array_size(&p_state->frames) );
+	return array_elem( (lc_array_t*) &p_state->boxes, (size_t) index * p_state->channel_count + channel, sprite_box_t );
+}
+
+/*
+ * Conditions are named flags that an entity sets every tick, such as
+ * "running" or "airborne". They are numbered in the order they are
+ * added, and bit n of a condition mask is condition n.
+ */
+int8_t sprite_add_condition( sprite_t* p_sprite, const char* name )
+{
+	assert( p_sprite );
+	assert( name );
+
+	int8_t condition = sprite_condition( p_sprite, name );
+
+	if( condition >= 0 )
+	{
+		return condition;
+	}
+
+	size_t count = array_size( &p_sprite->conditions );
+
+	if( count >= SPRITE_MAX_CONDITIONS || !array_resize( &p_sprite->conditions, count + 1 ) )
+	{
+		return -1;
+	}
+
+	sprite_condition_t* c = array_elem( &p_sprite->conditions, count, sprite_condition_t );
+	strncpy( c->name, name, SPRITE_MAX_CONDITION_NAME_LENGTH );
+	c->name[ SPRITE_MAX_CONDITION_NAME_LENGTH ] = '\0';
+
+	return (int8_t) count;
+}
+
+int8_t sprite_condition( const sprite_t* p_sprite, const char* name )
+{
+	assert( p_sprite );
+
+	for( size_t i = 0; i < array_size( &p_sprite->conditions ); i++ )
+	{
+		const sprite_condition_t* c = array_elem( (lc_array_t*) &p_sprite->conditions, i, sprite_condition_t );
+
+		if( strncasecmp( c->name, name, SPRITE_MAX_CONDITION_NAME_LENGTH ) == 0 )
+		{
+			return (int8_t) i;
+		}
+	}
+
+	return -1;
+}
+
+uint8_t sprite_condition_count( const sprite_t* p_sprite )
+{
+	assert( p_sprite );
+	return array_size( &p_sprite->conditions );
+}
+
+const char* sprite_condition_name( const sprite_t* p_sprite, uint8_t condition )
+{
+	assert( p_sprite );
+	assert( condition < array_size( &p_sprite->conditions ) );
+	return array_elem( (lc_array_t*) &p_sprite->conditions, condition, sprite_condition_t )->name;
+}
+
+/*
+ * Adds a transition from a state, or from any state if from is NULL,
+ * that is taken while condition holds. A transition on_exit waits for
+ * the end of the current loop instead of cutting the state short.
+ * When several conditions hold, the condition added first wins; for
+ * the same condition, the transition added first wins.
+ */
+bool sprite_add_transition( sprite_t* p_sprite, const char* from, const char* to, const char* condition, bool on_exit )
+{
+	assert( p_sprite );
+	assert( to );
+	assert( condition );
+
+	const sprite_state_t* from_state = from ? sprite_state( p_sprite, from ) : NULL;
+	const sprite_state_t* to_state   = sprite_state( p_sprite, to );
+	size_t count = array_size( &p_sprite->transitions );
+
+	if( (from && !from_state) || !to_state )
+	{
+		return false;
+	}
+
+	int8_t c = sprite_add_condition( p_sprite, condition );
+
+	if( c < 0 || !array_resize( &p_sprite->transitions, count + 1 ) )
+	{
+		return false;
+	}
+
+	sprite_transition_t* t = array_elem( &p_sprite->transitions, count, sprite_transition_t );
+	t->from      = from_state ? from_state->id : 0;
+	t->to        = to_state->id;
+	t->condition = (uint8_t) c;
+	t->on_exit   = on_exit;
+
+	return sprite_compile_transitions( p_sprite );
+}
+
+uint16_t sprite_transition_count( const sprite_t* p_sprite )
+{
+	assert( p_sprite );
+	return array_size( &p_sprite->transitions );
+}
+
+/*
+ * Rebuilds the transition table of every state from the transitions as
+ * described. Returns false if a transition refers to a state that no
+ * longer exists; such transitions are left out.
+ */
+static bool sprite_compile_transitions( sprite_t* p_sprite )
+{
+	size_t count = array_size( &p_sprite->transitions );
+	bool result  = true;
+
+	lc_tree_map_iterator_t itr;
+	for( itr = tree_map_begin(&p_sprite->states);
+	     itr != tree_map_end( );
+	     itr = tree_map_next(itr) )
+	{
+		sprite_state_t* state = itr->value;
+
+		sprite_free( (void*) state->transitions );
+		state->transitions     = NULL;
+		state->transition_mask = 0;
+		state->exit_mask       = 0;
+
+		if( count == 0 )
+		{
+			continue;
+		}
+
+		state->transitions = sprite_alloc( sizeof(sprite_state_t*) * array_size( &p_sprite->conditions ) );
+
+		if( !state->transitions )
+		{
+			result = false;
+			continue;
+		}
+
+		for( size_t i = 0; i < count; i++ )
+		{
+			const sprite_transition_t* t = array_elem( &p_sprite->transitions, i, sprite_transition_t );
+			uint32_t bit = 1u << t->condition;
+
+			if( (t->from && t->from != state->id) || (state->transition_mask & bit) )
+			{
+				continue;
+			}
+
+			const sprite_state_t* target = sprite_state_by_id( p_sprite, t->to );
+
+			if( !target )
+			{
+				result = false;
+			}
+			else if( target != state )
+			{
+				state->transitions[ t->condition ] = target;
+				state->transition_mask |= bit;
+				state->exit_mask       |= t->on_exit ? bit : 0;
+			}
+		}
+	}
+
+	return result;
+}
+
+/*
+ * Returns the state to move to from p_state while the conditions in
+ * the mask hold, or NULL to stay. on_exit, if not NULL, is set when the
+ * move waits for the end of the current loop.
+ */
+const sprite_state_t* sprite_state_transition( const sprite_state_t* p_state, uint32_t conditions, bool* on_exit )
+{
+	assert( p_state );
+	uint32_t mask = conditions & p_state->transition_mask;
+
+	if( !mask )
+	{
+		return NULL;
+	}
+
+	#if defined(__GNUC__)
+	uint32_t condition = __builtin_ctz( mask );
+	#else
+	uint32_t condition = 0;
+	while( !(mask & 1) ) { mask >>= 1; condition++; }
+	#endif
+
+	if( on_exit )
+	{
+		*on_exit = (p_state->exit_mask >> condition) & 1;
+	}
+
+	return p_state->transitions[ condition ];
+}
+
+void sprite_memory_usage( const sprite_t* p_sprite, sprite_memory_t* usage )
+{
+	assert( p_sprite );
+	assert( usage );
+
+	memset( usage, 0, sizeof(sprite_memory_t) );
+
+	usage->states      = sizeof(sprite_t);
+	usage->allocations = 1;
+
+	if( p_sprite->name )
+	{
+		usage->names += p_sprite->name_length + 1;
+		usage->allocations++;
+	}
+
+	/* shared atlases are not charged to the sprites that use them */
+	if( p_sprite->owns_atlas )
+	{
+		const sprite_atlas_t* atlas = p_sprite->atlas;
+
+		usage->states += sizeof(sprite_atlas_t);
+		usage->names  += atlas->name_length + 1;
+		usage->allocations += 2;
+
+		/* borrowed pixels belong to the caller */
+		if( atlas->pixels && atlas->release )
+		{
+			usage->pixels += (size_t) atlas->pitch * atlas->height;
+			usage->allocations++;
+		}
+	}
+
+	if( p_sprite->atlas_reference )
+	{
+		usage->names += strlen( p_sprite->atlas_reference ) + 1;
+		usage->allocations++;
+	}
+
+	lc_tree_map_iterator_t itr;
+	for( itr = tree_map_begin(&p_sprite->states);
+	     itr != tree_map_end( );
+	     itr = tree_map_next(itr) )
+	{
+		const sprite_state_t* state = itr->value;
+
+		usage->states += sizeof(sprite_state_t);
+		usage->allocations++;
+
+		if( array_size( &state->frames ) > 0 )
+		{
+			usage->frames += array_size( &state->frames ) * sizeof(sprite_frame_t);
+			usage->allocations++;
+		}
+
+		if( array_size( &state->frame_ends ) > 0 )
+		{
+			usage->frames += array_size( &state->frame_ends ) * sizeof(uint32_t);
+			usage->allocations++;
+		}
+
+		if( array_size( &state->tags ) > 0 )
+		{
+			usage->frames += array_size( &state->tags ) * sizeof(uint32_t);
+			usage->allocations++;
+		}
+
+		if( state->channel_count > 0 )
+		{
+			usage->names  += state->channel_count * sizeof(sprite_channel_t);
+			usage->frames += array_size( &state->boxes ) * sizeof(sprite_box_t);
+			usage->allocations += 2;
+		}
+
+		if( state->transitions )
+		{
+			usage->states += array_size( &p_sprite->conditions ) * sizeof(sprite_state_t*);
+			usage->allocations++;
+		}
+	}
+
+	if( array_size( &p_sprite->conditions ) > 0 )
+	{
+		usage->names += array_size( &p_sprite->conditions ) * sizeof(sprite_condition_t);
+		usage->allocations++;
+	}
+
+	if( array_size( &p_sprite->transitions ) > 0 )
+	{
+		usage->states += array_size( &p_sprite->transitions ) * sizeof(sprite_transition_t);
+		usage->allocations++;
+	}
+
+	usage->total = usage->pixels + usage->states + usage->frames + usage->names + usage->players;
+}
+
+sprite_t* sprite_from_file( const char* filename )
+{
+	sprite_t* p_sprite = NULL;
+	FILE* file = fopen( filename, "rb" );
+
+	if( !file )
+	{
+		goto failure;
+	}
+
+	#ifdef DEBUG_SPRITE
+	printf( "[Sprite] Opening: %s\n", filename );
+	#endif
+
+	char marker_and_bom[ 4 ] = { 0 };
+	fread( marker_and_bom, sizeof(char), sizeof(marker_and_bom), file );
+
+	if( marker_and_bom[ 0 ] != 'S' || marker_and_bom[ 1 ] != 'P' || marker_and_bom[ 2 ] != 'R' )
+	{
+		goto failure;
+	}
+
+	bool is_big_endian = sprite_file_is_big_endian( marker_and_bom[ 3 ] );
+	uint8_t version    = sprite_file_version( marker_and_bom[ 3 ] );
+
+	if( version > SPRITE_FILE_VERSION )
+	{
+		goto failure; /* written by a newer version of the library */
+	}
+
+	p_sprite = sprite_create( NULL, true );
+	memcpy( p_sprite->marker_and_bom, marker_and_bom, sizeof(char) * 4 );
+	sprite_free( p_sprite->name );
+	/* the sprite is always saved using the latest format */
+	p_sprite->marker_and_bom[ 3 ] = sprite_file_bom( SPRITE_FILE_VERSION, is_big_endian );
+
+
+	sprite_read( &p_sprite->name_length, sizeof(p_sprite->name_length), file, is_big_endian );
+	assert( p_sprite->name_length > 0 );
+	p_sprite->name = sprite_alloc( sizeof(char) * (p_sprite->name_length + 1) );
+	fread( p_sprite->name, sizeof(char), p_sprite->name_length + 1, file );
+
+	uint16_t atlas_name_length = 0;
+
+	if( version >= 3 )
+	{
+		sprite_read( &atlas_name_length, sizeof(atlas_name_length), file, is_big_endian );
+	}
+
+	if( atlas_name_length > 0 )
+	{
+		p_sprite->atlas_reference = sprite_alloc( sizeof(char) * (atlas_name_length + 1) );
+		if( !p_sprite->atlas_reference || fread( p_sprite->atlas_reference, sizeof(char), atlas_name_length + 1, file ) != atlas_name_length + 1u )
+		{
+			goto failure;
+		}
+		p_sprite->atlas_reference[ atlas_name_length ] = '\0';
+	}
+
+	uint16_t width  = 0;
+	uint16_t height = 0;
+
+	sprite_read( &width, sizeof(width), file, is_big_endian );
+	sprite_read( &height, sizeof(height), file, is_big_endian );
+	fread( &p_sprite->bytes_per_pixel, sizeof(uint8_t), 1, file );
+
+	size_t pixel_size = sizeof(uint8_t) * width * height * p_sprite->bytes_per_pixel;
+	if( !p_sprite->atlas_reference && pixel_size > 0 )
+	{
+		p_sprite->atlas = sprite_atlas_create( p_sprite->name, width, height, p_sprite->bytes_per_pixel, NULL );
+
+		if( !p_sprite->atlas || !p_sprite->atlas->pixels )
+		{
+			goto failure;
+		}
+
+		p_sprite->owns_atlas = true;
+		p_sprite->atlas->source               = sprite_strdup( filename );
+		p_sprite->atlas->source_offset        = ftell( file );
+		p_sprite->atlas->source_is_big_endian = is_big_endian;
+
+		if( !sprite_atlas_read_pixels( p_sprite->atlas, file, is_big_endian ) )
+		{
+			goto failure;
+		}
+	}
+
+	uint16_t state_count = 0;
+	sprite_read( &state_count, sizeof(state_count), file, is_big_endian );
+
+	while( state_count-- > 0 )
+	{
+		sprite_state_t* state = sprite_state_create( UNKNOWN_NAME );
+
+
+		fread( state->name, sizeof(char), SPRITE_MAX_STATE_NAME_LENGTH + 1, file );
+		state->name[ SPRITE_MAX_STATE_NAME_LENGTH ] = '\0';
+		state->id = sprite_tag( state->name );
+		sprite_read( &state->const_time, sizeof(state->const_time), file, is_big_endian );
+		sprite_read( &state->loop_count, sizeof(state->loop_count), file, is_big_endian );
+
+		tree_map_insert( &p_sprite->states, state->name, state );
+
+		uint16_t frame_count = 0;
+		sprite_read( &frame_count, sizeof(frame_count), file, is_big_endian );
+
+
+		while( frame_count-- > 0 )
+		{
+			uint16_t x = 0;
+			uint16_t y = 0;
+			uint16_t width = 0;
+			uint16_t height = 0;
+			uint16_t time = 0;
+
+			sprite_read( &x, sizeof(x), file, is_big_endian );
+			sprite_read( &y, sizeof(y), file, is_big_endian );
 			sprite_read( &width, sizeof(width), file, is_big_endian );
 			sprite_read( &height, sizeof(height), file, is_big_endian );
 			sprite_read( &time, sizeof(time), file, is_big_endian );
 
-			sprite_add_frame( p_sprite, state->name, x, y, width, height, time );
+			uint16_t offset_x      = 0;
+			uint16_t offset_y      = 0;
+			uint16_t source_width  = width;
+			uint16_t source_height = height;
+
+			if( version >= 1 )
+			{
+				sprite_read( &offset_x, sizeof(offset_x), file, is_big_endian );
+				sprite_read( &offset_y, sizeof(offset_y), file, is_big_endian );
+				sprite_read( &source_width, sizeof(source_width), file, is_big_endian );
+				sprite_read( &source_height, sizeof(source_height), file, is_big_endian );
+			}
+
+			sprite_state_add_trimmed_frame( state, x, y, width, height, time, offset_x, offset_y, source_width, source_height );
+		}
+
+		uint8_t channel_count = 0;
+
+		if( version >= 2 )
+		{
+			if( fread( &channel_count, sizeof(uint8_t), 1, file ) != 1 ) goto failure;
+		}
+
+		for( uint8_t c = 0; c < channel_count; c++ )
+		{
+			char name[ SPRITE_MAX_CHANNEL_NAME_LENGTH + 1 ];
+
+			if( fread( name, sizeof(char), sizeof(name), file ) != sizeof(name) ) goto failure;
+			name[ SPRITE_MAX_CHANNEL_NAME_LENGTH ] = '\0';
+
+			if( sprite_state_add_channel( state, name ) < 0 ) goto failure;
+		}
+
+		for( size_t i = 0; i < array_size( &state->boxes ); i++ )
+		{
+			sprite_box_t* box = array_elem( &state->boxes, i, sprite_box_t );
+
+			sprite_read( &box->x, sizeof(box->x), file, is_big_endian );
+			sprite_read( &box->y, sizeof(box->y), file, is_big_endian );
+			sprite_read( &box->width, sizeof(box->width), file, is_big_endian );
+			sprite_read( &box->height, sizeof(box->height), file, is_big_endian );
+		}
+
+		uint8_t has_tags = 0;
+
+		if( version >= 4 )
+		{
+			if( fread( &has_tags, sizeof(uint8_t), 1, file ) != 1 ) goto failure;
+		}
+
+		for( uint16_t i = 0; has_tags && i < sprite_state_frame_count( state ); i++ )
+		{
+			uint32_t tag = 0;
+
+			sprite_read( &tag, sizeof(tag), file, is_big_endian );
+			if( !sprite_state_set_frame_tag( state, i, tag ) ) goto failure;
+		}
+	}
+
+	uint8_t condition_count   = 0;
+	uint16_t transition_count = 0;
+
+	if( version >= 5 )
+	{
+		if( fread( &condition_count, sizeof(uint8_t), 1, file ) != 1 ) goto failure;
+	}
+
+	for( uint8_t c = 0; c < condition_count; c++ )
+	{
+		char name[ SPRITE_MAX_CONDITION_NAME_LENGTH + 1 ];
+
+		if( fread( name, sizeof(char), sizeof(name), file ) != sizeof(name) ) goto failure;
+		name[ SPRITE_MAX_CONDITION_NAME_LENGTH ] = '\0';
+
+		if( sprite_add_condition( p_sprite, name ) != c ) goto failure;
+	}
+
+	if( version >= 5 )
+	{
+		sprite_read( &transition_count, sizeof(transition_count), file, is_big_endian );
+	}
+
+	if( transition_count > 0 )
+	{
+		if( !array_resize( &p_sprite->transitions, transition_count ) ) goto failure;
+
+		for( uint16_t i = 0; i < transition_count; i++ )
+		{
+			sprite_transition_t* t = array_elem( &p_sprite->transitions, i, sprite_transition_t );
+
+			sprite_read( &t->from, sizeof(t->from), file, is_big_endian );
+			sprite_read( &t->to, sizeof(t->to), file, is_big_endian );
+			if( fread( &t->condition, sizeof(uint8_t), 1, file ) != 1 ) goto failure;
+			if( fread( &t->on_exit, sizeof(uint8_t), 1, file ) != 1 ) goto failure;
+			if( t->condition >= condition_count ) goto failure;
 		}
+
+		sprite_compile_transitions( p_sprite );
 	}
 
 	#ifdef DEBUG_SPRITE
 	printf( "[Sprite] Loaded: %s\n", sprite_name( p_sprite ) );
 	#endif
 
+	fclose( file );
 	return p_sprite;
 
 failure:
 	if( p_sprite ) sprite_destroy( &p_sprite );
+	if( file ) fclose( file );
 	return NULL;
 }
 
@@ -612,20 +1595,46 @@ bool sprite_save( sprite_t* p_sprite, const char* filename )
 		return false;
 	}
 
-	bool is_big_endian = p_sprite->marker_and_bom[ 3 ];
+	bool is_big_endian = sprite_file_is_big_endian( p_sprite->marker_and_bom[ 3 ] );
 
 	fwrite( p_sprite->marker_and_bom, sizeof(char), sizeof(p_sprite->marker_and_bom), file );
 
 	sprite_write( &p_sprite->name_length, sizeof(p_sprite->name_length), file, is_big_endian );
 	fwrite( p_sprite->name, sizeof(char), p_sprite->name_length + 1, file );
-	sprite_write( &p_sprite->width, sizeof(p_sprite->width), file, is_big_endian );
-	sprite_write( &p_sprite->height, sizeof(p_sprite->height), file, is_big_endian );
-	fwrite( &p_sprite->bytes_per_pixel, sizeof(uint8_t), 1, file );
+	/* a sprite that uses a shared atlas only stores the atlas' name */
+	const char* atlas_name     = sprite_atlas_reference( p_sprite );
+	uint16_t atlas_name_length = atlas_name ? strlen( atlas_name ) : 0;
+	uint16_t width             = sprite_width( p_sprite );
+	uint16_t height            = sprite_height( p_sprite );
+	uint8_t bytes_per_pixel    = sprite_bytes_per_pixel( p_sprite );
+
+	sprite_write( &atlas_name_length, sizeof(atlas_name_length), file, is_big_endian );
+	if( atlas_name_length > 0 )
+	{
+		fwrite( atlas_name, sizeof(char), atlas_name_length + 1, file );
+		width  = 0;
+		height = 0;
+	}
+
+	sprite_write( &width, sizeof(width), file, is_big_endian );
+	sprite_write( &height, sizeof(height), file, is_big_endian );
+	fwrite( &bytes_per_pixel, sizeof(uint8_t), 1, file );
 
-	size_t pixel_size = sizeof(uint8_t) * p_sprite->width * p_sprite->height * p_sprite->bytes_per_pixel;
-	if( pixel_size > 0 )
+	if( width > 0 && height > 0 )
 	{
-		sprite_write( p_sprite->pixels, pixel_size, file, is_big_endian );
+		/* evicted pixels are read back for as long as they are written */
+		const void* pixels = sprite_atlas_pin_pixels( p_sprite->atlas );
+		bool written       = pixels && sprite_atlas_write_pixels( p_sprite->atlas, file, is_big_endian );
+
+		if( pixels )
+		{
+			sprite_atlas_unpin_pixels( p_sprite->atlas );
+		}
+
+		if( !written )
+		{
+			goto failure;
+		}
 	}
 
 	uint16_t state_count = tree_map_size( &p_sprite->states );
@@ -655,7 +1664,57 @@ bool sprite_save( sprite_t* p_sprite, const char* filename )
 			sprite_write( &frame->width, sizeof(frame->width), file, is_big_endian );
 			sprite_write( &frame->height, sizeof(frame->height), file, is_big_endian );
 			sprite_write( &frame->time, sizeof(frame->time), file, is_big_endian );
+			sprite_write( &frame->offset_x, sizeof(frame->offset_x), file, is_big_endian );
+			sprite_write( &frame->offset_y, sizeof(frame->offset_y), file, is_big_endian );
+			sprite_write( &frame->source_width, sizeof(frame->source_width), file, is_big_endian );
+			sprite_write( &frame->source_height, sizeof(frame->source_height), file, is_big_endian );
 		}
+
+		fwrite( &state->channel_count, sizeof(uint8_t), 1, file );
+
+		for( uint8_t c = 0; c < state->channel_count; c++ )
+		{
+			fwrite( array_element( &state->channels, c ), sizeof(char), SPRITE_MAX_CHANNEL_NAME_LENGTH + 1, file );
+		}
+
+		for( size_t i = 0; i < array_size( &state->boxes ); i++ )
+		{
+			sprite_box_t* box = array_elem( &state->boxes, i, sprite_box_t );
+
+			sprite_write( &box->x, sizeof(box->x), file, is_big_endian );
+			sprite_write( &box->y, sizeof(box->y), file, is_big_endian );
+			sprite_write( &box->width, sizeof(box->width), file, is_big_endian );
+			sprite_write( &box->height, sizeof(box->height), file, is_big_endian );
+		}
+
+		uint8_t has_tags = array_size( &state->tags ) > 0;
+		fwrite( &has_tags, sizeof(uint8_t), 1, file );
+
+		for( size_t i = 0; i < array_size( &state->tags ); i++ )
+		{
+			sprite_write( array_elem( &state->tags, i, uint32_t ), sizeof(uint32_t), file, is_big_endian );
+		}
+	}
+
+	uint8_t condition_count = array_size( &p_sprite->conditions );
+	fwrite( &condition_count, sizeof(uint8_t), 1, file );
+
+	for( uint8_t c = 0; c < condition_count; c++ )
+	{
+		fwrite( array_element( &p_sprite->conditions, c ), sizeof(char), SPRITE_MAX_CONDITION_NAME_LENGTH + 1, file );
+	}
+
+	uint16_t transition_count = array_size( &p_sprite->transitions );
+	sprite_write( &transition_count, sizeof(transition_count), file, is_big_endian );
+
+	for( uint16_t i = 0; i < transition_count; i++ )
+	{
+		sprite_transition_t* t = array_elem( &p_sprite->transitions, i, sprite_transition_t );
+
+		sprite_write( &t->from, sizeof(t->from), file, is_big_endian );
+		sprite_write( &t->to, sizeof(t->to), file, is_big_endian );
+		fwrite( &t->condition, sizeof(uint8_t), 1, file );
+		fwrite( &t->on_exit, sizeof(uint8_t), 1, file );
 	}
 
 	#ifdef DEBUG_SPRITE
@@ -667,5 +1726,5 @@ bool sprite_save( sprite_t* p_sprite, const char* filename )
 
 failure:
 	if( file ) fclose( file );
-	return true;
+	return false;
 }
@@ -30,7 +30,13 @@ extern "C" {
 
 	
 #define SPRITE_MAX_STATE_NAME_LENGTH    15
+#define SPRITE_MAX_CHANNEL_NAME_LENGTH  15
+#define SPRITE_MAX_CHANNELS             16
+#define SPRITE_MAX_CONDITION_NAME_LENGTH 15
+#define SPRITE_MAX_CONDITIONS           32
 #define SPRITE_ANIMATION_STACK_DEPTH    8
+#define SPRITE_PIXEL_ALIGNMENT          64  /* alignment of pixels allocated by the library */
+#define SPRITE_MAX_DIRTY_RECTS          16
 
 struct sprite;
 typedef struct sprite sprite_t;
@@ -38,15 +44,92 @@ typedef struct sprite sprite_t;
 struct sprite_state;
 typedef struct sprite_state sprite_state_t;
 
+struct sprite_atlas;
+typedef struct sprite_atlas sprite_atlas_t;
+
+struct sprite_cache;
+typedef struct sprite_cache sprite_cache_t;
+
+struct sprite_events;
+typedef struct sprite_events sprite_events_t;
+
 typedef struct sprite_frame {
 	uint16_t x;
 	uint16_t y;
 	uint16_t width;
 	uint16_t height;
 	uint16_t time;
+	uint16_t offset_x;      /* position of a trimmed frame within its source image */
+	uint16_t offset_y;
+	uint16_t source_width;  /* size of the image before transparent borders were trimmed */
+	uint16_t source_height;
 } sprite_frame_t;
 
+/*
+ * Per-frame metadata such as hitboxes, hurtboxes and attachment points.
+ * Coordinates are relative to the origin of the untrimmed frame. An
+ * attachment point is a box with no width or height.
+ */
+typedef struct sprite_box {
+	int16_t  x;
+	int16_t  y;
+	uint16_t width;
+	uint16_t height;
+} sprite_box_t;
+
+/* A region of an atlas' pixels. */
+typedef struct sprite_rect {
+	uint16_t x;
+	uint16_t y;
+	uint16_t width;
+	uint16_t height;
+} sprite_rect_t;
+
 	
+/*
+ * Memory held by a sprite or player, broken down by what it is used
+ * for. Container bookkeeping inside libcollections is not included.
+ */
+typedef struct sprite_memory {
+	size_t pixels;
+	size_t states;
+	size_t frames;
+	size_t names;
+	size_t players;
+	size_t total;
+	size_t allocations;
+} sprite_memory_t;
+
+/*
+ * Library wide allocation counters. These are exact, but they are
+ * not updated atomically.
+ */
+typedef struct sprite_mem_stats {
+	size_t bytes_in_use;
+	size_t peak_bytes;
+	size_t allocations;
+	size_t frees;
+} sprite_mem_stats_t;
+
+/*
+ * Something that happened while a player advanced. Players append
+ * events to a buffer that is read once per tick.
+ */
+typedef enum sprite_event_type {
+	SPRITE_EVENT_FRAME    = 1, /* a frame started showing */
+	SPRITE_EVENT_LOOP     = 2, /* the state wrapped around; value is the number of loops */
+	SPRITE_EVENT_FINISHED = 3, /* the last loop of a state with a loop count ended */
+	SPRITE_EVENT_TAG      = 4, /* a tagged frame was entered; value is the tag */
+} sprite_event_type_t;
+
+typedef struct sprite_event {
+	uint8_t     type;
+	uint16_t    frame;
+	uint32_t    player;    /* handle in a player system, 0 for other players */
+	uint32_t    value;
+	const void* user_data; /* of the player */
+} sprite_event_t;
+
 typedef void* (*sprite_alloc_fxn_t) ( size_t size );
 typedef void  (*sprite_free_fxn_t)  ( void* ptr );
 	
@@ -57,10 +140,13 @@ void            sprite_destroy            ( sprite_t** p_sprite );
 
 void            sprite_set_name           ( sprite_t* p_sprite, const char* name );
 void            sprite_set_texture        ( sprite_t* p_sprite, uint16_t w, uint16_t h, uint16_t bytes_per_pixel, const void* pixels );
+bool            sprite_take_texture       ( sprite_t* p_sprite, uint16_t w, uint16_t h, uint16_t bytes_per_pixel, void* pixels, uint32_t pitch, sprite_free_fxn_t release );
+bool            sprite_borrow_texture     ( sprite_t* p_sprite, uint16_t w, uint16_t h, uint16_t bytes_per_pixel, const void* pixels, uint32_t pitch );
 bool            sprite_add_state          ( sprite_t* p_sprite, const char* state );
 bool            sprite_add_frame          ( sprite_t* p_sprite, const char* state, uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint16_t time );
 void            sprite_remove_all_states  ( sprite_t* p_sprite );
 bool            sprite_remove_state       ( sprite_t* p_sprite, const char* state );
+bool            sprite_rename_state       ( sprite_t* p_sprite, const char* state, const char* name );
 bool            sprite_remove_frame       ( sprite_t* p_sprite, const char* state, uint16_t index );
 
 const char*     sprite_name               ( const sprite_t* p_sprite );
@@ -69,28 +155,296 @@ uint16_t        sprite_height             ( const sprite_t* p_sprite );
 uint16_t        sprite_bit_depth          ( const sprite_t* p_sprite );
 uint16_t        sprite_bytes_per_pixel    ( const sprite_t* p_sprite );
 const void*     sprite_pixels             ( const sprite_t* p_sprite );
+uint32_t        sprite_pitch              ( const sprite_t* p_sprite );
+bool            sprite_update_pixels      ( sprite_t* p_sprite, uint16_t x, uint16_t y, uint16_t w, uint16_t h, const void* pixels, uint32_t pitch );
 sprite_state_t* sprite_state              ( const sprite_t* p_sprite, const char* state );
+sprite_state_t* sprite_state_by_id        ( const sprite_t* p_sprite, uint32_t id );
+void            sprite_set_atlas          ( sprite_t* p_sprite, sprite_atlas_t* atlas );
+sprite_atlas_t* sprite_atlas              ( const sprite_t* p_sprite );
+const char*     sprite_atlas_reference    ( const sprite_t* p_sprite );
 sprite_state_t* sprite_first_state        ( sprite_t* p_sprite );
 sprite_state_t* sprite_next_state         ( sprite_t* p_sprite );
+int8_t          sprite_add_condition      ( sprite_t* p_sprite, const char* name );
+int8_t          sprite_condition          ( const sprite_t* p_sprite, const char* name );
+uint8_t         sprite_condition_count    ( const sprite_t* p_sprite );
+const char*     sprite_condition_name     ( const sprite_t* p_sprite, uint8_t condition );
+bool            sprite_add_transition     ( sprite_t* p_sprite, const char* from, const char* to, const char* condition, bool on_exit );
+uint16_t        sprite_transition_count   ( const sprite_t* p_sprite );
 
 uint8_t               sprite_state_count          ( const sprite_t* p_sprite );
 const char*           sprite_state_name           ( const sprite_state_t* p_state );
+uint32_t              sprite_state_id             ( const sprite_state_t* p_state );
 uint16_t              sprite_state_const_time     ( const sprite_state_t* p_state );
 uint16_t              sprite_state_loop_count     ( const sprite_state_t* p_state );
-void                  sprite_state_set_name       ( sprite_state_t* p_state, const char* name );
 void                  sprite_state_set_const_time ( sprite_state_t* p_state, uint16_t time );
 void                  sprite_state_set_loop_count ( sprite_state_t* p_state, uint16_t loop_count );
 bool                  sprite_state_add_frame      ( sprite_state_t* state, uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint16_t time );
+bool                  sprite_state_add_trimmed_frame ( sprite_state_t* state, uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint16_t time,
+                                                       uint16_t offset_x, uint16_t offset_y, uint16_t source_width, uint16_t source_height );
 uint16_t              sprite_state_frame_count    ( const sprite_state_t* p_state );
 const sprite_frame_t* sprite_state_frame          ( const sprite_state_t* p_state, uint16_t index );
+uint16_t              sprite_state_frame_time     ( const sprite_state_t* p_state, uint16_t index );
+uint32_t              sprite_state_duration       ( const sprite_state_t* p_state );
+uint16_t              sprite_state_frame_at       ( const sprite_state_t* p_state, uint32_t time, uint32_t* frame_end );
+bool                  sprite_state_set_frame_tag  ( sprite_state_t* p_state, uint16_t index, uint32_t tag );
+uint32_t              sprite_state_frame_tag      ( const sprite_state_t* p_state, uint16_t index );
+uint32_t              sprite_tag                  ( const char* name );
+const sprite_state_t* sprite_state_transition     ( const sprite_state_t* p_state, uint32_t conditions, bool* on_exit );
+
+int8_t                sprite_state_add_channel    ( sprite_state_t* p_state, const char* name );
+int8_t                sprite_state_channel        ( const sprite_state_t* p_state, const char* name );
+uint8_t               sprite_state_channel_count  ( const sprite_state_t* p_state );
+const char*           sprite_state_channel_name   ( const sprite_state_t* p_state, uint8_t channel );
+bool                  sprite_state_set_frame_box  ( sprite_state_t* p_state, uint8_t channel, uint16_t index, const sprite_box_t* box );
+const sprite_box_t*   sprite_state_frame_box      ( const sprite_state_t* p_state, uint8_t channel, uint16_t index );
 
 sprite_t*             sprite_from_file          ( const char* filename );
 bool                  sprite_save               ( sprite_t* p_sprite, const char* filename );
+void                  sprite_memory_usage       ( const sprite_t* p_sprite, sprite_memory_t* usage );
 
+/*
+ *  Sprite Atlas
+ *
+ *  Pixels shared by many sprites
+ */
+sprite_atlas_t*       sprite_atlas_create          ( const char* name, uint16_t w, uint16_t h, uint16_t bytes_per_pixel, const void* pixels );
+void                  sprite_atlas_destroy         ( sprite_atlas_t** p_atlas );
+void                  sprite_atlas_set_texture     ( sprite_atlas_t* p_atlas, uint16_t w, uint16_t h, uint16_t bytes_per_pixel, const void* pixels );
+bool                  sprite_atlas_copy_pixels     ( sprite_atlas_t* p_atlas, uint16_t w, uint16_t h, uint16_t bytes_per_pixel, const void* pixels, uint32_t pitch, uint16_t row_alignment );
+bool                  sprite_atlas_take_pixels     ( sprite_atlas_t* p_atlas, uint16_t w, uint16_t h, uint16_t bytes_per_pixel, void* pixels, uint32_t pitch, sprite_free_fxn_t release );
+bool                  sprite_atlas_borrow_pixels   ( sprite_atlas_t* p_atlas, uint16_t w, uint16_t h, uint16_t bytes_per_pixel, const void* pixels, uint32_t pitch );
+const char*           sprite_atlas_name            ( const sprite_atlas_t* p_atlas );
+uint16_t              sprite_atlas_width           ( const sprite_atlas_t* p_atlas );
+uint16_t              sprite_atlas_height          ( const sprite_atlas_t* p_atlas );
+uint16_t              sprite_atlas_bytes_per_pixel ( const sprite_atlas_t* p_atlas );
+const void*           sprite_atlas_pixels          ( const sprite_atlas_t* p_atlas );
+const void*           sprite_atlas_pin_pixels      ( sprite_atlas_t* p_atlas );
+void                  sprite_atlas_unpin_pixels    ( sprite_atlas_t* p_atlas );
+uint32_t              sprite_atlas_pitch           ( const sprite_atlas_t* p_atlas );
+uint16_t              sprite_atlas_alignment       ( const sprite_atlas_t* p_atlas );
+bool                  sprite_atlas_update_pixels   ( sprite_atlas_t* p_atlas, uint16_t x, uint16_t y, uint16_t w, uint16_t h, const void* pixels, uint32_t pitch );
+uint8_t               sprite_atlas_dirty_count     ( const sprite_atlas_t* p_atlas );
+const sprite_rect_t*  sprite_atlas_dirty_rects     ( const sprite_atlas_t* p_atlas );
+void                  sprite_atlas_clear_dirty     ( sprite_atlas_t* p_atlas );
+sprite_atlas_t*       sprite_atlas_from_file       ( const char* filename );
+bool                  sprite_atlas_save            ( const sprite_atlas_t* p_atlas, const char* filename );
+
+/*
+ *  Sprite Cache
+ *
+ *  Keeps the pixels of atlases loaded from files within a byte budget
+ */
+sprite_cache_t*       sprite_cache_create          ( size_t budget );
+void                  sprite_cache_destroy         ( sprite_cache_t** p_cache );
+void                  sprite_cache_set_budget      ( sprite_cache_t* p_cache, size_t budget );
+size_t                sprite_cache_budget          ( const sprite_cache_t* p_cache );
+size_t                sprite_cache_resident_bytes  ( const sprite_cache_t* p_cache );
+bool                  sprite_cache_add             ( sprite_cache_t* p_cache, sprite_atlas_t* atlas );
+void                  sprite_cache_remove          ( sprite_cache_t* p_cache, sprite_atlas_t* atlas );
+bool                  sprite_cache_prefetch        ( sprite_cache_t* p_cache, const sprite_t* sprite );
+void                  sprite_cache_trim            ( sprite_cache_t* p_cache );
+
+/*
+ *  Sprite Canvas
+ *
+ *  Draws frames into RGBA pixels on the CPU
+ */
+typedef struct sprite_canvas {
+	uint8_t*      pixels; /* 4 bytes per pixel, alpha last */
+	uint16_t      width;
+	uint16_t      height;
+	uint32_t      pitch;  /* bytes from one row to the next */
+	sprite_rect_t clip;   /* nothing is drawn outside of it */
+} sprite_canvas_t;
+
+#define SPRITE_DRAW_BLEND     (1 << 0) /* blend with the alpha channel, otherwise copy */
+#define SPRITE_DRAW_FLIP_X    (1 << 1) /* mirror horizontally */
+
+typedef struct sprite_draw {
+	const sprite_t*       sprite;
+	const sprite_frame_t* frame;
+	int32_t               x;     /* canvas position of the untrimmed frame's top left corner */
+	int32_t               y;
+	uint8_t               scale; /* whole multiple of the frame's size, 0 or 1 for none */
+	uint8_t               flags;
+} sprite_draw_t;
+
+void                  sprite_canvas_initialize     ( sprite_canvas_t* canvas, void* pixels, uint16_t width, uint16_t height, uint32_t pitch );
+bool                  sprite_canvas_draw           ( const sprite_canvas_t* canvas, const sprite_draw_t* draw );
+uint32_t              sprite_canvas_draw_list      ( const sprite_canvas_t* canvas, const sprite_draw_t* draws, uint32_t count );
+
+
+/*
+ * Animation time in milliseconds with 16 fractional bits. Integer
+ * arithmetic keeps playback driven by fixed time steps bit-identical
+ * between runs, e.g. sprite_time_from_hz( 240 ) per tick.
+ */
+typedef uint64_t sprite_time_t;
+
+#define SPRITE_TIME_FRACTION_BITS       16
+#define sprite_time_from_ms( ms )       ((sprite_time_t) (ms) << SPRITE_TIME_FRACTION_BITS)
+#define sprite_time_from_hz( hz )       ((sprite_time_t) ((UINT64_C(1000) << SPRITE_TIME_FRACTION_BITS) / (hz)))
+#define sprite_time_to_ms( t )          ((uint32_t) ((t) >> SPRITE_TIME_FRACTION_BITS))
 
 typedef void     (*sprite_render_fxn_t) ( const sprite_frame_t* frame );
+
+/* What one player shows, collected so that many can be drawn at once. */
+typedef struct sprite_render_item {
+	const void*           user_data; /* of the player */
+	const sprite_t*       sprite;
+	const sprite_frame_t* frame;
+} sprite_render_item_t;
+
+typedef void (*sprite_render_batch_fxn_t) ( void* context, const sprite_render_item_t* items, uint32_t count );
 typedef uint32_t (*sprite_timer_fxn_t)  ( void );
 
+/* A job is split into chunks; a dispatcher calls fxn for every chunk and returns when all are done. */
+typedef void (*sprite_job_fxn_t)      ( void* job, uint32_t chunk );
+typedef void (*sprite_dispatch_fxn_t) ( void* context, sprite_job_fxn_t fxn, void* job, uint32_t chunk_count );
+
+/*
+ * Where a player is in its animation, without pointers, so snapshots
+ * can be copied, compared and saved. Unused bytes are always zero.
+ */
+typedef struct sprite_player_snapshot {
+	uint32_t      state;      /* sprite_state_id, 0 if there is no state */
+	uint16_t      frame;
+	uint16_t      loops_left; /* 0 if the state loops forever */
+	sprite_time_t time;       /* into the current loop */
+	uint8_t       is_playing;
+	uint8_t       reserved[ 7 ];
+} sprite_player_snapshot_t;
+
+/*
+ * Animation timing statistics, recorded only when the library is built
+ * with SPRITE_TELEMETRY. The display histogram compares how long frames
+ * were shown with their time: bucket 0 counts frames shown for less
+ * than their time, bucket 1 frames shown for exactly their time, and
+ * bucket n frames shown for 2^(n-2) up to 2^(n-1) - 1 ms too long. The
+ * last bucket has no upper bound.
+ */
+#define SPRITE_TELEMETRY_BUCKETS    16
+
+typedef struct sprite_telemetry {
+	uint32_t      frames;          /* frames that were shown and replaced */
+	uint32_t      dropped;         /* frames passed over between two updates */
+	uint32_t      late;            /* frames that appeared after half of their time had passed */
+	uint32_t      updates;
+	sprite_time_t update_time;     /* spent in updates */
+	sprite_time_t max_update_time;
+	uint32_t      display[ SPRITE_TELEMETRY_BUCKETS ];
+} sprite_telemetry_t;
+
+/*
+ *  Sprite Events
+ *
+ *  Fixed capacity buffer of player events
+ */
+sprite_events_t*      sprite_events_create        ( uint32_t capacity );
+void                  sprite_events_destroy       ( sprite_events_t** events );
+void                  sprite_events_clear         ( sprite_events_t* events );
+uint32_t              sprite_events_count         ( const sprite_events_t* events );
+const sprite_event_t* sprite_events_get           ( const sprite_events_t* events );
+uint32_t              sprite_events_dropped       ( const sprite_events_t* events );
+
+/*
+ *  Sprite Clock
+ *
+ *  Time shared by a group of players
+ */
+struct sprite_clock;
+typedef struct sprite_clock sprite_clock_t;
+
+sprite_clock_t*       sprite_clock_create         ( sprite_timer_fxn_t source );
+void                  sprite_clock_destroy        ( sprite_clock_t** clock );
+void                  sprite_clock_tick           ( sprite_clock_t* clock );
+void                  sprite_clock_advance        ( sprite_clock_t* clock, sprite_time_t dt );
+sprite_time_t         sprite_clock_now            ( const sprite_clock_t* clock );
+sprite_time_t         sprite_clock_delta          ( const sprite_clock_t* clock );
+void                  sprite_clock_set_scale      ( sprite_clock_t* clock, float scale );
+float                 sprite_clock_scale          ( const sprite_clock_t* clock );
+void                  sprite_clock_pause          ( sprite_clock_t* clock );
+void                  sprite_clock_unpause        ( sprite_clock_t* clock );
+bool                  sprite_clock_is_paused      ( const sprite_clock_t* clock );
+
+/*
+ *  Sprite Workers
+ *
+ *  Threads that share the chunks of a job
+ */
+struct sprite_workers;
+typedef struct sprite_workers sprite_workers_t;
+
+sprite_workers_t*     sprite_workers_create       ( uint32_t thread_count );
+void                  sprite_workers_destroy      ( sprite_workers_t** workers );
+uint32_t              sprite_workers_count        ( const sprite_workers_t* workers );
+void                  sprite_workers_dispatch     ( void* context, sprite_job_fxn_t fxn, void* job, uint32_t chunk_count );
+
+/*
+ *  Sprite Instances
+ *
+ *  Per-sprite quads packed into a GPU instance buffer
+ */
+typedef enum sprite_attribute {
+	SPRITE_ATTRIBUTE_POSITION = 0, /* x, y of the quad's top left corner */
+	SPRITE_ATTRIBUTE_SIZE,         /* width, height of the quad */
+	SPRITE_ATTRIBUTE_UV,           /* u0, v0, u1, v1 of the frame in its texture, u0 > u1 if mirrored */
+	SPRITE_ATTRIBUTE_COUNT
+} sprite_attribute_t;
+
+typedef enum sprite_component {
+	SPRITE_COMPONENT_NONE = 0,     /* the attribute is not written */
+	SPRITE_COMPONENT_FLOAT,
+	SPRITE_COMPONENT_INT16,        /* rounded */
+	SPRITE_COMPONENT_UNORM16,      /* 0 to 1 as 0 to 65535, clamped */
+} sprite_component_t;
+
+/* Where each attribute goes within an instance, in bytes. */
+typedef struct sprite_instance_format {
+	uint32_t stride;
+	struct {
+		uint8_t  component;
+		uint16_t offset;
+	} attributes[ SPRITE_ATTRIBUTE_COUNT ];
+} sprite_instance_format_t;
+
+/*
+ * Instances are given as parallel arrays. Positions are those of the
+ * untrimmed frames' top left corners, so quads line up with the
+ * canvas. A NULL frame gives a quad with no size.
+ */
+typedef struct sprite_instances {
+	const float*                 x;
+	const float*                 y;
+	const float*                 scale;       /* NULL for 1 */
+	const int8_t*                orientation; /* above 0 as drawn, otherwise mirrored; NULL for all as drawn */
+	const sprite_t* const*       sprites;     /* give the texture size */
+	const sprite_frame_t* const* frames;
+} sprite_instances_t;
+
+void                  sprite_instances_write          ( const sprite_instance_format_t* format, const sprite_instances_t* instances, uint32_t count, void* buffer );
+void                  sprite_instances_write_parallel ( const sprite_instance_format_t* format, const sprite_instances_t* instances, uint32_t count, void* buffer,
+                                                        uint32_t chunk_size, sprite_dispatch_fxn_t dispatch, void* context );
+
+/*
+ *  Sprite Draw List
+ *
+ *  Orders draws by layer, atlas and depth
+ */
+struct sprite_draw_list;
+typedef struct sprite_draw_list sprite_draw_list_t;
+
+sprite_draw_list_t*         sprite_draw_list_create       ( uint32_t capacity );
+void                        sprite_draw_list_destroy      ( sprite_draw_list_t** list );
+void                        sprite_draw_list_clear        ( sprite_draw_list_t* list );
+uint32_t                    sprite_draw_list_count        ( const sprite_draw_list_t* list );
+bool                        sprite_draw_list_add          ( sprite_draw_list_t* list, const sprite_t* sprite, const sprite_frame_t* frame, const void* user_data, uint8_t layer, float depth );
+void                        sprite_draw_list_sort         ( sprite_draw_list_t* list );
+const uint32_t*             sprite_draw_list_order        ( sprite_draw_list_t* list );
+const sprite_render_item_t* sprite_draw_list_item         ( const sprite_draw_list_t* list, uint32_t index );
+void                        sprite_draw_list_render       ( sprite_draw_list_t* list, sprite_render_item_t* items, uint32_t capacity, sprite_render_batch_fxn_t render, void* context );
+void                        sprite_draw_list_memory_usage ( const sprite_draw_list_t* list, sprite_memory_t* usage );
+
 /*
  *  Sprite Player
  *
@@ -102,18 +456,102 @@ typedef struct sprite_player sprite_player_t;
 sprite_player_t*      sprite_player_create        ( const sprite_t* sprite );
 void                  sprite_player_destroy       ( sprite_player_t** sp );
 void                  sprite_player_set_timer     ( sprite_timer_fxn_t timer );
+void                  sprite_player_set_clock     ( sprite_player_t* sp, const sprite_clock_t* clock );
 void                  sprite_player_set_user_data ( sprite_player_t* sp, const void* data );
+void                  sprite_player_set_events    ( sprite_player_t* sp, sprite_events_t* events );
 void                  sprite_player_play          ( sprite_player_t* sp, const char* name );
 void                  sprite_player_play_state    ( sprite_player_t* sp, const sprite_state_t* state );
+bool                  sprite_player_push          ( sprite_player_t* sp, const char* name );
+bool                  sprite_player_push_state    ( sprite_player_t* sp, const sprite_state_t* state );
+bool                  sprite_player_enqueue       ( sprite_player_t* sp, const char* name );
+bool                  sprite_player_enqueue_state ( sprite_player_t* sp, const sprite_state_t* state );
+void                  sprite_player_clear_queue   ( sprite_player_t* sp );
+bool                  sprite_player_transition    ( sprite_player_t* sp, uint32_t conditions );
 bool                  sprite_player_is_playing    ( sprite_player_t* sp, const char* name );
 void                  sprite_player_stop          ( sprite_player_t* sp );
 void                  sprite_player_pause         ( sprite_player_t* sp );
 void                  sprite_player_unpause       ( sprite_player_t* sp );
 void                  sprite_player_render        ( sprite_player_t* sp, sprite_render_fxn_t render );
+void                  sprite_player_render_batch  ( sprite_player_t** players, uint32_t count, sprite_render_item_t* items, uint32_t capacity, sprite_render_batch_fxn_t render, void* context );
 const sprite_frame_t* sprite_player_frame         ( sprite_player_t* sp );
+const sprite_frame_t* sprite_player_advance       ( sprite_player_t* sp, sprite_time_t dt );
+void                  sprite_player_seek          ( sprite_player_t* sp, sprite_time_t time );
+void                  sprite_player_snapshot      ( const sprite_player_t* sp, sprite_player_snapshot_t* snapshot );
+void                  sprite_player_restore       ( sprite_player_t* sp, const sprite_player_snapshot_t* snapshot );
+bool                  sprite_player_telemetry     ( const sprite_player_t* sp, sprite_telemetry_t* telemetry );
+void                  sprite_player_reset_telemetry ( sprite_player_t* sp );
+void                  sprite_player_memory_usage  ( const sprite_player_t* sp, sprite_memory_t* usage );
+
+/*
+ *  Sprite Track
+ *
+ *  One looping animation shared by many instances
+ */
+struct sprite_track;
+typedef struct sprite_track sprite_track_t;
+
+sprite_track_t*       sprite_track_create         ( const sprite_t* sprite, const char* name );
+void                  sprite_track_destroy        ( sprite_track_t** track );
+bool                  sprite_track_set_state      ( sprite_track_t* track, const sprite_state_t* state );
+const sprite_state_t* sprite_track_state          ( const sprite_track_t* track );
+void                  sprite_track_advance        ( sprite_track_t* track, sprite_time_t dt );
+void                  sprite_track_seek           ( sprite_track_t* track, sprite_time_t time );
+uint32_t              sprite_track_phase          ( const sprite_track_t* track, uint32_t offset );
+uint16_t              sprite_track_frame_index    ( const sprite_track_t* track, uint32_t phase );
+const sprite_frame_t* sprite_track_frame          ( const sprite_track_t* track, uint32_t phase );
+void                  sprite_track_render         ( const sprite_track_t* track, const uint32_t* phases, void* const* user_data, uint32_t count, sprite_render_item_t* items, uint32_t capacity, sprite_render_batch_fxn_t render, void* context );
+void                  sprite_track_memory_usage   ( const sprite_track_t* track, sprite_memory_t* usage );
+
+/*
+ *  Sprite Player System
+ *
+ *  Play many sprite animations with one update
+ *
+ *  The events of different players are not ordered by time.
+ *  sprite_player_system_update() walks 1 ms buckets from the last update
+ *  to now, at most 1024 of them, and reports the players of a bucket
+ *  with the most recently scheduled first. A player's bucket is its
+ *  frame end modulo 1024 ms.
+ *  sprite_player_system_update_parallel() reports them in player index
+ *  order.
+ */
+struct sprite_player_system;
+typedef struct sprite_player_system sprite_player_system_t;
+typedef uint32_t sprite_player_handle_t;
+
+#define SPRITE_PLAYER_INVALID_HANDLE    0
+
+sprite_player_system_t* sprite_player_system_create        ( uint32_t capacity );
+void                    sprite_player_system_destroy       ( sprite_player_system_t** sys );
+sprite_player_handle_t  sprite_player_system_add           ( sprite_player_system_t* sys, const sprite_t* sprite, const void* user_data );
+bool                    sprite_player_system_remove        ( sprite_player_system_t* sys, sprite_player_handle_t player );
+bool                    sprite_player_system_is_valid      ( const sprite_player_system_t* sys, sprite_player_handle_t player );
+int32_t                 sprite_player_system_index         ( const sprite_player_system_t* sys, sprite_player_handle_t player );
+sprite_player_handle_t  sprite_player_system_handle        ( const sprite_player_system_t* sys, uint32_t index );
+uint32_t                sprite_player_system_count         ( const sprite_player_system_t* sys );
+bool                    sprite_player_system_play          ( sprite_player_system_t* sys, sprite_player_handle_t player, const char* name );
+bool                    sprite_player_system_play_state    ( sprite_player_system_t* sys, sprite_player_handle_t player, const sprite_state_t* state );
+void                    sprite_player_system_transition    ( sprite_player_system_t* sys, const uint32_t* conditions );
+void                    sprite_player_system_seek          ( sprite_player_system_t* sys, sprite_player_handle_t player, uint32_t time );
+void                    sprite_player_system_stop          ( sprite_player_system_t* sys, sprite_player_handle_t player );
+bool                    sprite_player_system_is_playing    ( const sprite_player_system_t* sys, sprite_player_handle_t player );
+void                    sprite_player_system_set_user_data ( sprite_player_system_t* sys, sprite_player_handle_t player, const void* user_data );
+void*                   sprite_player_system_user_data     ( const sprite_player_system_t* sys, sprite_player_handle_t player );
+void                    sprite_player_system_set_events    ( sprite_player_system_t* sys, sprite_events_t* events );
+void                    sprite_player_system_update        ( sprite_player_system_t* sys, uint32_t now );
+void                    sprite_player_system_update_parallel ( sprite_player_system_t* sys, uint32_t now, uint32_t chunk_size, sprite_dispatch_fxn_t dispatch, void* context );
+const uint16_t*         sprite_player_system_frames        ( const sprite_player_system_t* sys );
+const sprite_frame_t*   sprite_player_system_frame         ( const sprite_player_system_t* sys, sprite_player_handle_t player );
+void                    sprite_player_system_render        ( const sprite_player_system_t* sys, sprite_render_item_t* items, uint32_t capacity, sprite_render_batch_fxn_t render, void* context );
+void                    sprite_player_system_snapshot_all  ( const sprite_player_system_t* sys, sprite_player_snapshot_t* snapshots );
+void                    sprite_player_system_restore_all   ( sprite_player_system_t* sys, const sprite_player_snapshot_t* snapshots, uint32_t count, uint32_t now );
+bool                    sprite_player_system_telemetry     ( const sprite_player_system_t* sys, sprite_telemetry_t* telemetry );
+void                    sprite_player_system_reset_telemetry ( sprite_player_system_t* sys );
+void                    sprite_player_system_memory_usage  ( const sprite_player_system_t* sys, sprite_memory_t* usage );
 
 
 void sprite_mem_set_fxns( sprite_alloc_fxn_t alloc, sprite_free_fxn_t free );
+void sprite_mem_stats   ( sprite_mem_stats_t* stats );
 
 #ifdef __cplusplus
 }
@@ -2,6 +2,9 @@
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include <libimageio/blending.h>
 #include "texture-packer.h"
 
@@ -20,8 +23,16 @@ typedef struct texture_packer_image {
 	uint8_t  bytes_per_pixel;
 	uint8_t* pixels;
 	void*    data;
+	uint16_t trim_x;        /* offset of the trimmed pixels within the source image */
+	uint16_t trim_y;
+	uint16_t source_width;  /* dimensions of the image before trimming */
+	uint16_t source_height;
+	uint64_t hash;
+	size_t   original;      /* index of the identical image, or TP_UNIQUE */
 } tp_image_t;
 
+#define TP_UNIQUE   ((size_t) -1)
+
 
 struct texture_packer_rect;
 typedef struct texture_packer_rect tp_rect_t;
@@ -33,17 +44,24 @@ struct texture_packer {
 	size_t      array_size;
 	tp_image_t* images;
 
+	size_t*      hash_table;      /* image index + 1 of unique images, 0 if empty */
+	size_t       hash_table_size; /* always a power of 2 */
+	size_t       unique_count;
+	tp_image_t** sorted;          /* unique images ordered by area while packing */
+	size_t       sorted_size;
+
 	tp_data_packed_fxn   data_packed;
+	tp_data_trimmed_fxn  data_trimmed;
 	tp_data_destroy_fxn  data_destroy;
 };
 
 
 static int tp_image_compare( const void* p_left, const void* p_right )
 {
-	const tp_image_t* left  = p_left;
-	const tp_image_t* right = p_right;
+	const tp_image_t* left  = *(const tp_image_t**) p_left;
+	const tp_image_t* right = *(const tp_image_t**) p_right;
 
-	return area(left) > area(right);
+	return (area(left) < area(right)) - (area(left) > area(right));
 }
 
 
@@ -149,10 +167,17 @@ tp_t* texture_packer_create( void )
 		tp->size         = 0;
 		tp->array_size   = 32;
 		tp->data_packed  = NULL;
+		tp->data_trimmed = NULL;
 		tp->data_destroy = NULL;
 
 		tp->images = (tp_image_t*) malloc( sizeof(tp_image_t) * tp->array_size );
 
+		tp->hash_table      = NULL;
+		tp->hash_table_size = 0;
+		tp->unique_count    = 0;
+		tp->sorted          = NULL;
+		tp->sorted_size     = 0;
+
 		tp->final_image.x               = 0;
 		tp->final_image.y               = 0;
 		tp->final_image.width           = 0;
@@ -174,6 +199,8 @@ void texture_packer_destroy( tp_t** tp )
 {
 	texture_packer_clear( *tp );
 	free( (*tp)->images );
+	free( (*tp)->hash_table );
+	free( (*tp)->sorted );
 
 	if( (*tp)->final_image.pixels )
 	{
@@ -193,6 +220,206 @@ void texture_packer_data_fxns( tp_t* tp, tp_data_packed_fxn on_packed, tp_data_d
 	tp->data_destroy = on_destroy;
 }
 
+/*
+ * Setting a trim callback turns on trimming. Images with an alpha
+ * channel are cropped to the bounding box of their non-transparent
+ * pixels when they are added, and the callback reports where the
+ * trimmed image sits within the original image.
+ */
+void texture_packer_trim_fxn( tp_t* tp, tp_data_trimmed_fxn on_trimmed )
+{
+	assert( tp );
+	tp->data_trimmed = on_trimmed;
+}
+
+
+/*
+ *  ------[ Alpha Bounds ]---------------------------------
+ */
+#ifdef __SSE2__
+/* Returns a 4-bit mask with a bit set for each non-transparent pixel. */
+static inline int tp_opaque_mask4( const uint8_t* pixels )
+{
+	const __m128i alpha       = _mm_set1_epi32( (int) 0xFF000000 );
+	const __m128i quad        = _mm_loadu_si128( (const __m128i*) pixels );
+	const __m128i transparent = _mm_cmpeq_epi32( _mm_and_si128( quad, alpha ), _mm_setzero_si128() );
+
+	return ~_mm_movemask_ps( _mm_castsi128_ps( transparent ) ) & 0xF;
+}
+#endif
+
+static inline int tp_first_opaque( const uint8_t* row, int width )
+{
+	int x = 0;
+
+	#ifdef __SSE2__
+	for( ; x + 4 <= width; x += 4 )
+	{
+		int mask = tp_opaque_mask4( row + 4 * x );
+		if( mask ) return x + __builtin_ctz( mask );
+	}
+	#endif
+
+	for( ; x < width; x++ )
+	{
+		if( row[ 4 * x + 3 ] ) return x;
+	}
+
+	return -1;
+}
+
+static inline int tp_last_opaque( const uint8_t* row, int width, int first )
+{
+	int x = width;
+
+	#ifdef __SSE2__
+	for( ; x - 4 >= first; x -= 4 )
+	{
+		int mask = tp_opaque_mask4( row + 4 * (x - 4) );
+		if( mask ) return x - 4 + (31 - __builtin_clz( mask ));
+	}
+	#endif
+
+	while( --x > first )
+	{
+		if( row[ 4 * x + 3 ] ) return x;
+	}
+
+	return first;
+}
+
+/*
+ * Finds the bounding box of the non-transparent pixels of a 32-bit
+ * image. The alpha channel is assumed to be the last byte of each
+ * pixel. Returns false when every pixel is transparent.
+ */
+static bool tp_alpha_bounds( uint16_t width, uint16_t height, const uint8_t* pixels, uint16_t* x, uint16_t* y, uint16_t* w, uint16_t* h )
+{
+	int min_x = width;
+	int max_x = -1;
+	int min_y = height;
+	int max_y = -1;
+
+	for( int row = 0; row < height; row++ )
+	{
+		const uint8_t* p = pixels + (size_t) row * width * 4;
+		int first = tp_first_opaque( p, width );
+
+		if( first < 0 ) continue;
+
+		int last = tp_last_opaque( p, width, first );
+
+		if( first < min_x ) min_x = first;
+		if( last > max_x )  max_x = last;
+		if( row < min_y )   min_y = row;
+		max_y = row;
+	}
+
+	if( max_x < 0 )
+	{
+		return false;
+	}
+
+	*x = min_x;
+	*y = min_y;
+	*w = max_x - min_x + 1;
+	*h = max_y - min_y + 1;
+	return true;
+}
+
+/*
+ *  ------[ Duplicate Detection ]--------------------------
+ */
+static uint64_t tp_image_hash( uint16_t width, uint16_t height, uint8_t bytes_per_pixel, const uint8_t* pixels )
+{
+	/* FNV-1a */
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	size_t size   = (size_t) width * height * bytes_per_pixel;
+
+	hash = (hash ^ width) * 0x100000001b3ULL;
+	hash = (hash ^ height) * 0x100000001b3ULL;
+	hash = (hash ^ bytes_per_pixel) * 0x100000001b3ULL;
+
+	for( size_t i = 0; i < size; i++ )
+	{
+		hash = (hash ^ pixels[ i ]) * 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+static inline bool tp_image_equals( const tp_image_t* image, uint64_t hash, uint16_t width, uint16_t height, uint8_t bytes_per_pixel, const uint8_t* pixels )
+{
+	return image->hash == hash &&
+	       image->width == width &&
+	       image->height == height &&
+	       image->bytes_per_pixel == bytes_per_pixel &&
+	       memcmp( image->pixels, pixels, (size_t) width * height * bytes_per_pixel ) == 0;
+}
+
+/* Returns the index of an identical unique image or TP_UNIQUE. */
+static size_t tp_find_image( const tp_t* tp, uint64_t hash, uint16_t width, uint16_t height, uint8_t bytes_per_pixel, const uint8_t* pixels )
+{
+	if( tp->hash_table_size > 0 )
+	{
+		size_t mask = tp->hash_table_size - 1;
+
+		for( size_t slot = hash & mask; tp->hash_table[ slot ]; slot = (slot + 1) & mask )
+		{
+			size_t index = tp->hash_table[ slot ] - 1;
+
+			if( tp_image_equals( &tp->images[ index ], hash, width, height, bytes_per_pixel, pixels ) )
+			{
+				return index;
+			}
+		}
+	}
+
+	return TP_UNIQUE;
+}
+
+static bool tp_hash_image( tp_t* tp, size_t index )
+{
+	if( (tp->unique_count + 1) * 2 > tp->hash_table_size )
+	{
+		size_t new_size   = tp->hash_table_size ? tp->hash_table_size * 2 : 64;
+		size_t* new_table = (size_t*) calloc( new_size, sizeof(size_t) );
+
+		if( !new_table )
+		{
+			return false;
+		}
+
+		for( size_t i = 0; i < tp->hash_table_size; i++ )
+		{
+			if( tp->hash_table[ i ] )
+			{
+				size_t slot = tp->images[ tp->hash_table[ i ] - 1 ].hash & (new_size - 1);
+				while( new_table[ slot ] ) slot = (slot + 1) & (new_size - 1);
+				new_table[ slot ] = tp->hash_table[ i ];
+			}
+		}
+
+		free( tp->hash_table );
+		tp->hash_table      = new_table;
+		tp->hash_table_size = new_size;
+	}
+
+	size_t mask = tp->hash_table_size - 1;
+	size_t slot = tp->images[ index ].hash & mask;
+
+	while( tp->hash_table[ slot ] ) slot = (slot + 1) & mask;
+
+	tp->hash_table[ slot ] = index + 1;
+	tp->unique_count++;
+	return true;
+}
+
+/*
+ * Images whose pixels are identical to an image that was already added
+ * are not stored again. They are packed once and every duplicate is
+ * reported at the same location.
+ */
 bool texture_packer_add( tp_t* tp, uint16_t width, uint16_t height, uint8_t bytes_per_pixel, const uint8_t* pixels, const void* data )
 {
 	assert( tp );
@@ -215,26 +442,67 @@ bool texture_packer_add( tp_t* tp, uint16_t width, uint16_t height, uint8_t byte
 
 	tp_image_t* image = &tp->images[ tp->size ];
 
+	uint16_t trim_x      = 0;
+	uint16_t trim_y      = 0;
+	uint16_t trim_width  = width;
+	uint16_t trim_height = height;
 
-	size_t image_size = sizeof(uint8_t) * width * height * bytes_per_pixel;
+	if( tp->data_trimmed && bytes_per_pixel == 4 )
+	{
+		if( !tp_alpha_bounds( width, height, pixels, &trim_x, &trim_y, &trim_width, &trim_height ) )
+		{
+			/* keep a single transparent pixel for fully transparent images */
+			trim_width  = 1;
+			trim_height = 1;
+		}
+	}
+
+	size_t src_pitch = (size_t) width * bytes_per_pixel;
+	size_t dst_pitch = (size_t) trim_width * bytes_per_pixel;
+	uint8_t* trimmed = (uint8_t*) malloc( dst_pitch * trim_height );
+
+	assert( trimmed != NULL );
+
+	if( !trimmed )
+	{
+		return false;
+	}
+
+	for( uint16_t row = 0; row < trim_height; row++ )
+	{
+		memcpy( trimmed + row * dst_pitch, pixels + (trim_y + row) * src_pitch + trim_x * bytes_per_pixel, dst_pitch );
+	}
+
+	uint64_t hash   = tp_image_hash( trim_width, trim_height, bytes_per_pixel, trimmed );
+	size_t original = tp_find_image( tp, hash, trim_width, trim_height, bytes_per_pixel, trimmed );
 
 	image->x               = 0;
 	image->y               = 0;
-	image->width           = width;
-	image->height          = height;
+	image->width           = trim_width;
+	image->height          = trim_height;
 	image->bytes_per_pixel = bytes_per_pixel;
-	image->pixels          = (uint8_t*) malloc( image_size );
+	image->pixels          = NULL;
 	image->data            = (void*) data;
-
-	assert( image->pixels != NULL );
-
-	if( image->pixels )
+	image->trim_x          = trim_x;
+	image->trim_y          = trim_y;
+	image->source_width    = width;
+	image->source_height   = height;
+	image->hash            = hash;
+	image->original        = original;
+
+	if( original != TP_UNIQUE )
 	{
-		memcpy( image->pixels, pixels, image_size );
+		free( trimmed );
 	}
 	else
 	{
-		return false;
+		image->pixels = trimmed;
+
+		if( !tp_hash_image( tp, tp->size ) )
+		{
+			free( trimmed );
+			return false;
+		}
 	}
 
 	tp->size++;
@@ -254,7 +522,13 @@ void texture_packer_clear( tp_t* tp )
 		free( image->pixels );
 	}
 
-	tp->size = 0;
+	tp->size         = 0;
+	tp->unique_count = 0;
+
+	if( tp->hash_table )
+	{
+		memset( tp->hash_table, 0, sizeof(size_t) * tp->hash_table_size );
+	}
 
 }
 
@@ -296,19 +570,21 @@ static bool tp_blit_tree( tp_image_t* dst, tp_rect_t* root )
 	return true;
 }
 
-static void tp_pack_images( const tp_t* tp,  const tp_rect_t* root )
+static void tp_pack_images( const tp_t* tp )
 {
-	if( root )
+	/* Report every image, duplicates included, in the order they were added. */
+	for( size_t i = 0; i < tp->size; i++ )
 	{
-		tp_pack_images( tp, root->children[ TP_CHILD_LEFT ] );
-		tp_pack_images( tp, root->children[ TP_CHILD_RIGHT ] );
+		tp_image_t* image    = &tp->images[ i ];
+		tp_image_t* original = image->original == TP_UNIQUE ? image : &tp->images[ image->original ];
 
-		if( root->image )
+		if( tp->data_trimmed )
 		{
-			tp_image_t* image = root->image;
-			/* Pass packed image to callback for further processing */
-			tp->data_packed( image->x, image->y, image->width, image->height, image->bytes_per_pixel, image->pixels, image->data );
+			tp->data_trimmed( image->trim_x, image->trim_y, image->source_width, image->source_height, image->data );
 		}
+
+		/* Pass packed image to callback for further processing */
+		tp->data_packed( original->x, original->y, original->width, original->height, original->bytes_per_pixel, original->pixels, image->data );
 	}
 }
 
@@ -344,6 +620,7 @@ static inline void tp_free_tree( tp_rect_t** root )
 	if( *root == NULL ) return;
 
 	tp_free_tree( &(*root)->children[ TP_CHILD_LEFT ] );
+	tp_free_tree( &(*root)->children[ TP_CHILD_RIGHT ] );
 
 	(*root)->x                          = 0;
 	(*root)->y                          = 0;
@@ -363,7 +640,13 @@ bool texture_packer_pack( tp_t* tp, uint16_t width, uint16_t height, uint8_t byt
 	tp->final_image.width           = width;
 	tp->final_image.height          = height;
 	tp->final_image.bytes_per_pixel = bytes_per_pixel;
-	tp->final_image.pixels          = (uint8_t*) malloc( sizeof(uint8_t) * width * height * bytes_per_pixel );
+
+	if( tp->final_image.pixels )
+	{
+		free( tp->final_image.pixels );
+	}
+
+	tp->final_image.pixels = (uint8_t*) malloc( sizeof(uint8_t) * width * height * bytes_per_pixel );
 
 	if( tp->final_image.pixels )
 	{
@@ -374,20 +657,42 @@ bool texture_packer_pack( tp_t* tp, uint16_t width, uint16_t height, uint8_t byt
 		goto failure;
 	}
 
+	tp_image_t** sorted = (tp_image_t**) realloc( tp->sorted, sizeof(tp_image_t*) * (tp->unique_count + 1) );
+
+	if( sorted )
+	{
+		tp->sorted      = sorted;
+		tp->sorted_size = tp->unique_count + 1;
+	}
+	else
+	{
+		goto failure;
+	}
+
+	size_t count = 0;
+	for( size_t i = 0; i < tp->size; i++ )
+	{
+		if( tp->images[ i ].original == TP_UNIQUE )
+		{
+			sorted[ count++ ] = &tp->images[ i ];
+		}
+	}
+	assert( count == tp->unique_count );
+
 	// sort the images by largest area to smallest area.
-	if( tp->size > 1 )
+	if( count > 1 )
 	{
-		qsort( tp->images, tp->size, sizeof(tp_image_t), tp_image_compare );
-		assert( area(&tp->images[ 0 ]) >= area(&tp->images[ tp->size - 1 ]) );
+		qsort( sorted, count, sizeof(tp_image_t*), tp_image_compare );
+		assert( area(sorted[ 0 ]) >= area(sorted[ count - 1 ]) );
 	}
 
 	tp_free_tree( &tp->root );
 
 	// Build a tree to utilize all of the space.
 	tp->root = tp_rect_create( 0, 0, width, height );
-	for( size_t i = 0; i < tp->size; i++ )
+	for( size_t i = 0; i < count; i++ )
 	{
-		tp_image_t* image = &tp->images[ i ];
+		tp_image_t* image = sorted[ i ];
 		assert( image->pixels );
 		bool is_assigned = tp_insert_image( tp, &tp->root, image );
 
@@ -400,10 +705,10 @@ bool texture_packer_pack( tp_t* tp, uint16_t width, uint16_t height, uint8_t byt
 	// Use the tree to generate the final texture.
 	if( tp_blit_tree( &tp->final_image, tp->root ) )
 	{
-		// Call the user data packed callback on all leaf nodes for further processing.
+		// Call the user data packed callback on all images for further processing.
 		if( tp->data_packed )
 		{
-			tp_pack_images( tp,  tp->root );
+			tp_pack_images( tp );
 		}
 	}
 	else
@@ -419,35 +724,121 @@ failure:
 	return false;
 }
 
+static inline bool tp_try_pack( tp_t* tp, uint16_t width, uint16_t height, size_t total_area, uint8_t bytes_per_pixel )
+{
+	return (size_t) width * height >= total_area && texture_packer_pack( tp, width, height, bytes_per_pixel );
+}
+
+/*
+ * Narrows one side of an atlas that holds the images down to the
+ * smallest size that still does, knowing that too_small doesn't.
+ */
+static void tp_shrink_side( tp_t* tp, uint16_t* width, uint16_t* height, bool shrink_width, uint16_t too_small, size_t total_area, uint8_t bytes_per_pixel )
+{
+	uint16_t* side = shrink_width ? width : height;
+	uint16_t fits  = *side;
+
+	while( fits - too_small > 1 )
+	{
+		*side = too_small + (fits - too_small) / 2;
+
+		if( tp_try_pack( tp, *width, *height, total_area, bytes_per_pixel ) ) fits      = *side;
+		else                                                                 too_small = *side;
+	}
+
+	*side = fits;
+}
+
+/*
+ * Finds the smallest square that holds every unique image by growing
+ * it by a quarter until the images fit and then searching back. Each
+ * attempt allocates and clears a whole atlas, and trimming can leave
+ * tiny images, so the number of attempts must not depend on their
+ * sizes. The square is then narrowed one side at a time.
+ */
 void texture_packer_fit_and_pack( tp_t* tp, uint8_t bytes_per_pixel )
 {
 	if( tp->size > 0 )
 	{
-		uint16_t min_width  = tp->images[ 0 ].width;
-		uint16_t min_height = tp->images[ 0 ].height;
-		bool increase_width = false;
+		uint16_t min_width  = 1;
+		uint16_t min_height = 1;
+		size_t total_area   = 0;
 
-		for( size_t i = 1; i < tp->size; i++ )
+		for( size_t i = 0; i < tp->size; i++ )
 		{
-			if( tp->images[ i ].width < min_width )
+			const tp_image_t* image = &tp->images[ i ];
+
+			if( image->original == TP_UNIQUE )
 			{
-				min_width = tp->images[ i ].width;
+				if( image->width > min_width )
+				{
+					min_width = image->width;
+				}
+				if( image->height > min_height )
+				{
+					min_height = image->height;
+				}
+
+				total_area += (size_t) image->width * image->height;
 			}
-			if( tp->images[ i ].height < min_height )
+		}
+
+		tp_data_packed_fxn on_packed = tp->data_packed;
+		uint32_t too_small = 0;
+		uint32_t side      = 1;
+		uint16_t width     = 0;
+		uint16_t height    = 0;
+		bool packed        = false;
+
+		tp->data_packed = NULL; /* only the final layout is reported */
+
+		for( ;; )
+		{
+			width  = side > min_width ? side : min_width;
+			height = side > min_height ? side : min_height;
+
+			if( (packed = tp_try_pack( tp, width, height, total_area, bytes_per_pixel )) || side == UINT16_MAX )
 			{
-				min_height = tp->images[ i ].height;
+				break;
 			}
-		}
 
-		uint16_t width  = min_width;
-		uint16_t height = min_height;
+			too_small = side;
+			side     += side / 4 > 0 ? side / 4 : 1;
+			side      = side < UINT16_MAX ? side : UINT16_MAX;
+		}
 
-		while( !texture_packer_pack( tp, width, height, bytes_per_pixel ) )
+		if( packed )
 		{
-			if( increase_width ) width  += min_width;
-			else                 height += min_height;
+			while( side - too_small > 1 )
+			{
+				uint32_t middle = too_small + (side - too_small) / 2;
+				uint16_t w      = middle > min_width ? middle : min_width;
+				uint16_t h      = middle > min_height ? middle : min_height;
+
+				if( tp_try_pack( tp, w, h, total_area, bytes_per_pixel ) )
+				{
+					side   = middle;
+					width  = w;
+					height = h;
+				}
+				else
+				{
+					too_small = middle;
+				}
+			}
+
+			tp_shrink_side( tp, &width, &height, true, min_width - 1, total_area, bytes_per_pixel );
+			tp_shrink_side( tp, &width, &height, false, min_height - 1, total_area, bytes_per_pixel );
+
+			/* the last attempt may have been one that didn't fit */
+			packed = texture_packer_pack( tp, width, height, bytes_per_pixel );
+		}
 
-			increase_width = !increase_width;
+		tp->data_packed = on_packed;
+
+		if( packed && on_packed )
+		{
+			tp_pack_images( tp );
 		}
 	}
 }
@@ -472,6 +863,48 @@ uint8_t* texture_packer_pixels( const tp_t* tp )
 	return tp->final_image.pixels;
 }
 
+void texture_packer_memory_usage( const tp_t* tp, tp_memory_t* usage )
+{
+	assert( tp );
+	assert( usage );
+
+	usage->images      = 0;
+	usage->atlas       = 0;
+	usage->scratch     = sizeof(tp_t) + sizeof(tp_image_t) * tp->array_size;
+	usage->allocations = 2;
+
+	for( size_t i = 0; i < tp->size; i++ )
+	{
+		const tp_image_t* image = &tp->images[ i ];
+
+		if( image->pixels )
+		{
+			usage->images += (size_t) image->width * image->height * image->bytes_per_pixel;
+			usage->allocations++;
+		}
+	}
+
+	if( tp->final_image.pixels )
+	{
+		usage->atlas += (size_t) tp->final_image.width * tp->final_image.height * tp->final_image.bytes_per_pixel;
+		usage->allocations++;
+	}
+
+	if( tp->hash_table )
+	{
+		usage->scratch += sizeof(size_t) * tp->hash_table_size;
+		usage->allocations++;
+	}
+
+	if( tp->sorted )
+	{
+		usage->scratch += sizeof(tp_image_t*) * tp->sorted_size;
+		usage->allocations++;
+	}
+
+	usage->total = usage->images + usage->atlas + usage->scratch;
+}
+
 /*bool texture_packer_save( const tp_t* tp, const tchar *filename )
 {
 }
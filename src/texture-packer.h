@@ -30,6 +30,7 @@ extern "C" {
 #endif 
 
 typedef void (*tp_data_packed_fxn)( uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint8_t bytes_per_pixel, uint8_t* pixels, void* data );
+typedef void (*tp_data_trimmed_fxn)( uint16_t offset_x, uint16_t offset_y, uint16_t source_width, uint16_t source_height, void* data );
 typedef void (*tp_data_cleared_fxn)( void* data );
 typedef void (*tp_data_destroy_fxn)( void* data );
 
@@ -40,9 +41,18 @@ typedef void (*tp_data_destroy_fxn)( void* data );
 struct texture_packer;
 typedef struct texture_packer tp_t;
 
+typedef struct tp_memory {
+	size_t images;      /* pixels of the unique images waiting to be packed */
+	size_t atlas;       /* pixels of the packed texture */
+	size_t scratch;     /* image records, hash table and sort buffer */
+	size_t total;
+	size_t allocations;
+} tp_memory_t;
+
 tp_t*    texture_packer_create          ( void );
 void     texture_packer_destroy         ( tp_t** tp );
 void     texture_packer_data_fxns       ( tp_t* tp, tp_data_packed_fxn on_packed, tp_data_destroy_fxn on_destroy );
+void     texture_packer_trim_fxn        ( tp_t* tp, tp_data_trimmed_fxn on_trimmed );
 bool     texture_packer_add             ( tp_t* tp, uint16_t width, uint16_t height, uint8_t bytes_per_pixel, const uint8_t* pixels, const void* data );
 void     texture_packer_clear           ( tp_t* tp );
 bool     texture_packer_pack            ( tp_t* tp, uint16_t width, uint16_t height, uint8_t bytes_per_pixel );
@@ -51,6 +61,7 @@ uint16_t texture_packer_width           ( const tp_t* tp );
 uint16_t texture_packer_height          ( const tp_t* tp );
 uint8_t  texture_packer_bytes_per_pixel ( const tp_t* tp );
 uint8_t* texture_packer_pixels          ( const tp_t* tp );
+void     texture_packer_memory_usage    ( const tp_t* tp, tp_memory_t* usage );
 
 #ifdef __cplusplus
 }
@@ -30,6 +30,7 @@
 #include "../src/sprite.h"
 
 #define DEFAULT_FRAME_TIME    100
+#define MAX_ATLAS_SPRITES     64
 
 typedef struct sprite_info {
 	sprite_t* sprite;
@@ -37,15 +38,21 @@ typedef struct sprite_info {
 	size_t    frame_idx;
 	uint16_t  frame_time;
 	uint16_t state_loop_count;
+	uint16_t  offset_x;
+	uint16_t  offset_y;
+	uint16_t  source_width;
+	uint16_t  source_height;
 } sprite_info_t;
 
 static void           on_packed_image     ( uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint8_t bytes_per_pixel, uint8_t* pixels, void* data );
+static void           on_trimmed_image    ( uint16_t offset_x, uint16_t offset_y, uint16_t source_width, uint16_t source_height, void* data );
 static sprite_info_t* sprite_info_create  ( sprite_t* sprite, const char* state, size_t idx );
 static void           sprite_info_destroy ( sprite_info_t* si );
 
 static void help( void );
 static void info( sprite_t* sprite );
 static void add( sprite_t* sprite, const char* state, const char* image );
+static void export( void );
 
 
 struct {
@@ -57,7 +64,10 @@ struct {
 	uint16_t frame_count_for_state;
 	bool verbose;
 	bool using_with_iphone;
-} sprite_compiler = { NULL, NULL, NULL, DEFAULT_FRAME_TIME, 0, 0, false, false };
+	const char* atlas_name;
+	sprite_t* atlas_sprites[ MAX_ATLAS_SPRITES ];
+	size_t atlas_sprite_count;
+} sprite_compiler = { NULL, NULL, NULL, DEFAULT_FRAME_TIME, 0, 0, false, false, NULL, { NULL }, 0 };
 
 static struct option long_options[] =
 {
@@ -68,6 +78,8 @@ static struct option long_options[] =
 	{"info",          no_argument,       0, 'i'},
 	{"export",        no_argument,       0, 'x'},
 	{"ios",           no_argument,       0, 'p'},
+	{"trim",          no_argument,       0, 'r'},
+	{"atlas",         required_argument, 0, 'A'},
 
 	{"time",          required_argument, 0, 't'},
 	{"loop-count",    required_argument, 0, 'l'},
@@ -94,7 +106,7 @@ int main( int argc, char* argv[] )
 	int opt;
 	int opt_idx;
 
-	while( (opt = getopt_long(argc, argv, "vhixpc:f:a:t:l:", long_options, &opt_idx)) != -1 )
+	while( (opt = getopt_long(argc, argv, "vhixprc:f:a:t:l:A:", long_options, &opt_idx)) != -1 )
 	{
 		switch( opt )
 		{
@@ -103,6 +115,20 @@ int main( int argc, char* argv[] )
 				break;
 			case 'c':
 				sprite_compiler.sprite = sprite_create( optarg, true );
+
+				if( sprite_compiler.atlas_name )
+				{
+					if( sprite_compiler.atlas_sprite_count >= MAX_ATLAS_SPRITES )
+					{
+						fprintf( stderr, "Too many sprites in atlas '%s'.\n", sprite_compiler.atlas_name );
+						return 1;
+					}
+
+					sprite_compiler.atlas_sprites[ sprite_compiler.atlas_sprite_count++ ] = sprite_compiler.sprite;
+				}
+				break;
+			case 'A':
+				sprite_compiler.atlas_name = optarg;
 				break;
 			case 'f':
 				sprite_compiler.sprite = sprite_from_file( optarg );
@@ -134,34 +160,12 @@ int main( int argc, char* argv[] )
 			case 'p':
 				sprite_compiler.using_with_iphone = true;
 				break;
+			case 'r':
+				texture_packer_trim_fxn( sprite_compiler.tp, on_trimmed_image );
+				break;
 			case 'x':
-			{
-				texture_packer_fit_and_pack( sprite_compiler.tp, 4 );
-
-
-				uint16_t width           = texture_packer_width( sprite_compiler.tp );
-				uint16_t height          = texture_packer_height( sprite_compiler.tp );
-				uint16_t bytes_per_pixel = texture_packer_bytes_per_pixel( sprite_compiler.tp );
-				const void* pixels       = texture_packer_pixels( sprite_compiler.tp );
-
-				#if 0
-				image_t dstImage;
-				dstImage.width          = width;
-				dstImage.height         = height;
-				dstImage.bits_per_pixel = bytes_per_pixel * 8;
-				dstImage.pixels         = (uint8_t*) pixels;
-				imageio_image_save( &dstImage, "/Users/manvscode/projects/libsprite/bin/output.tga", TGA );
-				#endif
-
-				sprite_set_texture( sprite_compiler.sprite, width, height, bytes_per_pixel, pixels );
-
-				char out_file[ 256 ] = {0};
-				strcat( out_file, sprite_name(sprite_compiler.sprite) );
-				strcat( out_file, ".spr" );
-				printf( "Saving %s\n", out_file );
-				sprite_save( sprite_compiler.sprite, out_file );
+				export( );
 				break;
-			}
 			default:
 			case 'h':
 				help();
@@ -184,6 +188,62 @@ int main( int argc, char* argv[] )
 
 
 
+void export( void )
+{
+	texture_packer_fit_and_pack( sprite_compiler.tp, 4 );
+
+
+	uint16_t width           = texture_packer_width( sprite_compiler.tp );
+	uint16_t height          = texture_packer_height( sprite_compiler.tp );
+	uint16_t bytes_per_pixel = texture_packer_bytes_per_pixel( sprite_compiler.tp );
+	const void* pixels       = texture_packer_pixels( sprite_compiler.tp );
+
+	#if 0
+	image_t dstImage;
+	dstImage.width          = width;
+	dstImage.height         = height;
+	dstImage.bits_per_pixel = bytes_per_pixel * 8;
+	dstImage.pixels         = (uint8_t*) pixels;
+	imageio_image_save( &dstImage, "/Users/manvscode/projects/libsprite/bin/output.tga", TGA );
+	#endif
+
+	char out_file[ 256 ] = {0};
+
+	if( sprite_compiler.atlas_name )
+	{
+		/* All of the sprites share one atlas and only reference it by name. */
+		sprite_atlas_t* atlas = sprite_atlas_create( sprite_compiler.atlas_name, 0, 0, bytes_per_pixel, NULL );
+		sprite_atlas_borrow_pixels( atlas, width, height, bytes_per_pixel, pixels, (uint32_t) width * bytes_per_pixel );
+
+		snprintf( out_file, sizeof(out_file), "%s.spa", sprite_atlas_name(atlas) );
+		printf( "Saving %s\n", out_file );
+		sprite_atlas_save( atlas, out_file );
+
+		for( size_t i = 0; i < sprite_compiler.atlas_sprite_count; i++ )
+		{
+			sprite_t* sprite = sprite_compiler.atlas_sprites[ i ];
+
+			sprite_set_atlas( sprite, atlas );
+			snprintf( out_file, sizeof(out_file), "%s.spr", sprite_name(sprite) );
+			printf( "Saving %s\n", out_file );
+			sprite_save( sprite, out_file );
+			sprite_set_atlas( sprite, NULL );
+		}
+
+		sprite_atlas_destroy( &atlas );
+	}
+	else
+	{
+		/* the packer outlives the save, so its pixels are not copied */
+		sprite_borrow_texture( sprite_compiler.sprite, width, height, bytes_per_pixel, pixels, (uint32_t) width * bytes_per_pixel );
+
+		strcat( out_file, sprite_name(sprite_compiler.sprite) );
+		strcat( out_file, ".spr" );
+		printf( "Saving %s\n", out_file );
+		sprite_save( sprite_compiler.sprite, out_file );
+	}
+}
+
 void on_packed_image( uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint8_t bytes_per_pixel, uint8_t* pixels, void* data )
 {
 	sprite_info_t* sprite_info = data;
@@ -203,7 +263,18 @@ void on_packed_image( uint16_t x, uint16_t y, uint16_t width, uint16_t height, u
 	sprite_state_set_loop_count( state, sprite_info->state_loop_count );
 
 	printf( "Adding frame to '%s'\n", sprite_info->state );
-	sprite_state_add_frame( state, x, y, width, height, sprite_info->frame_time );
+	sprite_state_add_trimmed_frame( state, x, y, width, height, sprite_info->frame_time,
+	                                sprite_info->offset_x, sprite_info->offset_y, sprite_info->source_width, sprite_info->source_height );
+}
+
+void on_trimmed_image( uint16_t offset_x, uint16_t offset_y, uint16_t source_width, uint16_t source_height, void* data )
+{
+	sprite_info_t* sprite_info = data;
+
+	sprite_info->offset_x      = offset_x;
+	sprite_info->offset_y      = offset_y;
+	sprite_info->source_width  = source_width;
+	sprite_info->source_height = source_height;
 }
 
 sprite_info_t* sprite_info_create( sprite_t* sprite, const char* state, size_t idx )
@@ -215,6 +286,10 @@ sprite_info_t* sprite_info_create( sprite_t* sprite, const char* state, size_t i
 		ssf->sprite    = sprite;
 		ssf->state     = strdup( state );
 		ssf->frame_idx = idx;
+		ssf->offset_x      = 0;
+		ssf->offset_y      = 0;
+		ssf->source_width  = 0;
+		ssf->source_height = 0;
 
 		assert( ssf->sprite );
 		assert( ssf->state );
@@ -245,6 +320,8 @@ void help( void )
 		printf( "  -%c, --%-12s %-s\n", 'c', "create", "Create a new sprite." );
 		printf( "  -%c, --%-12s %-s\n", 't', "time",   "Set the frame time." );
 		printf( "  -%c, --%-12s %-s\n", 'l', "loop-count",   "Set the state loop count. Zero is interpreted as infinitely looped." );
+		printf( "  -%c, --%-12s %-s\n", 'r', "trim",   "Trim transparent borders from frames added after this option." );
+		printf( "  -%c, --%-12s %-s\n", 'A', "atlas",  "Pack the sprites created after this option into one shared atlas." );
 	}
 
 	printf( "----------------------------------------------------\n" );
@@ -255,6 +332,10 @@ void info( sprite_t* sprite )
 	printf( "----[ Sprite Info ]------------------------------------------\n" );
 	printf( "Name: %-40s\n", sprite_name( sprite ) );
 	printf( "Width: %-6d  Height: %-6d  Bit Depth: %-dbpp\n", sprite_width(sprite), sprite_height(sprite), sprite_bytes_per_pixel(sprite) == 4 ? 32 : 24 );
+	if( sprite_atlas_reference(sprite) )
+	{
+		printf( "Atlas: %-40s\n", sprite_atlas_reference(sprite) );
+	}
 	printf( "Number of States: %6d\n", sprite_state_count(sprite) );
 	printf( "----[ States ]-----------------------------------------------\n" );
 	const sprite_state_t* state = sprite_first_state( sprite );
@@ -281,6 +362,11 @@ void info( sprite_t* sprite )
 			printf( "Constant Time: Unused\n" );
 		}
 
+		for( uint8_t c = 0; c < sprite_state_channel_count( state ); c++ )
+		{
+			printf( "        Channel %d: \"%s\"\n", c, sprite_state_channel_name( state, c ) );
+		}
+
 		for( size_t i = 0; i < sprite_state_frame_count( state ); i++ )
 		{
 			const sprite_frame_t* frame = sprite_state_frame( state, i );
@@ -288,6 +374,11 @@ void info( sprite_t* sprite )
 			printf( "        |\n" );
 
 			printf( "        +--- Frame %2zd: [x:%3d, y:%3d, W:%3d, H:%3d] @ %dms\n", i, frame->x, frame->y, frame->width, frame->height, frame->time );
+
+			if( frame->width != frame->source_width || frame->height != frame->source_height )
+			{
+				printf( "        |    Trimmed: [offset x:%3d, offset y:%3d, source W:%3d, source H:%3d]\n", frame->offset_x, frame->offset_y, frame->source_width, frame->source_height );
+			}
 		}
 
 		printf( "\n" );
@@ -336,6 +427,8 @@ void add( sprite_t* sprite, const char* state, const char* filename )
 	sprite_info_t* info = sprite_info_create( sprite, state, sprite_compiler.frame_count_for_state );
 	info->state_loop_count = sprite_compiler.state_loop_count;
 	info->frame_time = sprite_compiler.frame_time;
+	info->source_width  = image.width;
+	info->source_height = image.height;
 
 	texture_packer_add( sprite_compiler.tp, image.width, image.height, image.bits_per_pixel / 8, image.pixels, info );
 	sprite_compiler.frame_count_for_state++;
@@ -0,0 +1,300 @@
+/*
+ * Copyright (C) 2012 by Joseph A. Marrero.  http://www.manvscode.com/
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sprite.h>
+
+/*
+ * Saves atlases with tight, padded, aligned and borrowed pixels and
+ * checks that they load back with the same pixels. The checks also
+ * run in builds with NDEBUG defined.
+ */
+#define FILENAME    "test-atlas.spa"
+#define FILENAME2   "test-atlas-2.spa"
+#define FILENAME3   "test-atlas-3.spa"
+#define WIDTH       13
+#define HEIGHT      7
+#define BPP         4
+
+static int failures = 0;
+
+#define check( condition ) \
+	do { \
+		if( !(condition) ) \
+		{ \
+			fprintf( stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition ); \
+			failures++; \
+		} \
+	} while( 0 )
+
+static void fill( uint8_t* pixels, uint32_t pitch )
+{
+	memset( pixels, 0xEE, (size_t) pitch * HEIGHT ); /* padding */
+
+	for( uint32_t y = 0; y < HEIGHT; y++ )
+	{
+		for( uint32_t x = 0; x < WIDTH * BPP; x++ )
+		{
+			pixels[ y * pitch + x ] = (uint8_t) (y * 31 + x * 7 + 1);
+		}
+	}
+}
+
+static bool same_pixels( const sprite_atlas_t* a, const sprite_atlas_t* b )
+{
+	const uint8_t* pa = sprite_atlas_pixels( a );
+	const uint8_t* pb = sprite_atlas_pixels( b );
+
+	if( !pa || !pb ||
+	    sprite_atlas_width( a ) != sprite_atlas_width( b ) ||
+	    sprite_atlas_height( a ) != sprite_atlas_height( b ) ||
+	    sprite_atlas_bytes_per_pixel( a ) != sprite_atlas_bytes_per_pixel( b ) )
+	{
+		return false;
+	}
+
+	size_t row_size = (size_t) sprite_atlas_width( a ) * sprite_atlas_bytes_per_pixel( a );
+
+	for( uint16_t y = 0; y < sprite_atlas_height( a ); y++ )
+	{
+		if( memcmp( pa + (size_t) y * sprite_atlas_pitch( a ), pb + (size_t) y * sprite_atlas_pitch( b ), row_size ) != 0 )
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void check_round_trip( const char* name, const sprite_atlas_t* atlas )
+{
+	bool saved = sprite_atlas_save( atlas, FILENAME );
+	check( saved );
+
+	sprite_atlas_t* loaded = sprite_atlas_from_file( FILENAME );
+	check( loaded );
+
+	if( !loaded || !same_pixels( atlas, loaded ) )
+	{
+		fprintf( stderr, "%s atlas did not load back the same\n", name );
+		failures++;
+	}
+
+	sprite_atlas_destroy( &loaded );
+	remove( FILENAME );
+}
+
+static void check_whole_atlas_dirty( const sprite_atlas_t* atlas )
+{
+	const sprite_rect_t* rect = sprite_atlas_dirty_rects( atlas );
+
+	check( sprite_atlas_dirty_count( atlas ) == 1 );
+	check( rect[ 0 ].x == 0 && rect[ 0 ].y == 0 );
+	check( rect[ 0 ].width == sprite_atlas_width( atlas ) && rect[ 0 ].height == sprite_atlas_height( atlas ) );
+}
+
+/*
+ * Replacing the pixels in any way makes the whole atlas dirty, even
+ * after the earlier regions were cleared.
+ */
+static void test_replaced_pixels_are_dirty( uint8_t* tight, uint8_t* padded )
+{
+	sprite_atlas_t* atlas = sprite_atlas_create( "dirty", WIDTH, HEIGHT, BPP, tight );
+	check( atlas );
+	check_whole_atlas_dirty( atlas );
+
+	uint8_t patch[ 2 * 2 * BPP ] = { 0 };
+	sprite_atlas_clear_dirty( atlas );
+	bool updated = sprite_atlas_update_pixels( atlas, 3, 2, 2, 2, patch, 2 * BPP );
+	check( updated && sprite_atlas_dirty_count( atlas ) == 1 );
+	check( sprite_atlas_dirty_rects( atlas )[ 0 ].width == 2 );
+
+	sprite_atlas_set_texture( atlas, WIDTH - 1, HEIGHT, BPP, tight );
+	check_whole_atlas_dirty( atlas );
+
+	sprite_atlas_clear_dirty( atlas );
+	bool copied = sprite_atlas_copy_pixels( atlas, WIDTH, HEIGHT, BPP, padded, WIDTH * BPP + 12, 64 );
+	check( copied );
+	check_whole_atlas_dirty( atlas );
+
+	sprite_atlas_clear_dirty( atlas );
+	bool borrowed = sprite_atlas_borrow_pixels( atlas, WIDTH, HEIGHT - 2, BPP, padded, WIDTH * BPP + 12 );
+	check( borrowed );
+	check_whole_atlas_dirty( atlas );
+
+	uint8_t* owned = malloc( sizeof(patch) );
+	sprite_atlas_clear_dirty( atlas );
+	bool taken = owned && sprite_atlas_take_pixels( atlas, 2, 2, BPP, owned, 2 * BPP, free );
+	check( taken );
+	check_whole_atlas_dirty( atlas );
+
+	sprite_atlas_destroy( &atlas );
+}
+
+/* Files from a newer version of the library are rejected. */
+static void test_newer_version_is_rejected( uint8_t* tight )
+{
+	sprite_atlas_t* atlas = sprite_atlas_create( "newer", WIDTH, HEIGHT, BPP, tight );
+	bool saved = atlas && sprite_atlas_save( atlas, FILENAME );
+	check( saved );
+	sprite_atlas_destroy( &atlas );
+
+	FILE* file = fopen( FILENAME, "r+b" );
+	check( file );
+
+	if( file )
+	{
+		char bom = 0;
+		bool patched = fseek( file, 3, SEEK_SET ) == 0 && fread( &bom, 1, 1, file ) == 1;
+		bom += 2; /* the version starts at the second bit */
+		patched = patched && fseek( file, 3, SEEK_SET ) == 0 && fwrite( &bom, 1, 1, file ) == 1;
+		check( patched );
+		fclose( file );
+	}
+
+	atlas = sprite_atlas_from_file( FILENAME );
+	check( atlas == NULL );
+	sprite_atlas_destroy( &atlas );
+	remove( FILENAME );
+}
+
+static sprite_atlas_t* save_and_load( const char* filename, const uint8_t* pixels )
+{
+	sprite_atlas_t* atlas = sprite_atlas_create( filename, WIDTH, HEIGHT, BPP, pixels );
+	bool saved = atlas && sprite_atlas_save( atlas, filename );
+	check( saved );
+	sprite_atlas_destroy( &atlas );
+
+	return sprite_atlas_from_file( filename );
+}
+
+/*
+ * Only pinning reads evicted pixels back, and pinned atlases stay
+ * resident even when the cache is over its budget.
+ */
+static void test_cache_pins( uint8_t* tight, uint8_t* padded )
+{
+	size_t size              = WIDTH * BPP * HEIGHT;
+	sprite_cache_t* cache    = sprite_cache_create( size );
+	sprite_atlas_t* a        = save_and_load( FILENAME, tight );
+	sprite_atlas_t* b        = save_and_load( FILENAME2, tight );
+	sprite_atlas_t* original = sprite_atlas_create( "original", WIDTH, HEIGHT, BPP, tight );
+
+	if( !cache || !a || !b || !original )
+	{
+		fprintf( stderr, "out of memory\n" );
+		exit( EXIT_FAILURE );
+	}
+
+	check( !sprite_cache_add( cache, original ) ); /* nothing to read it back from */
+
+	sprite_atlas_clear_dirty( b );
+	bool added = sprite_cache_add( cache, a ) && sprite_cache_add( cache, b );
+	check( added );
+	check( sprite_atlas_pixels( a ) == NULL && sprite_atlas_pixels( b ) != NULL );
+
+	/* the getters don't read pixels back */
+	check( sprite_atlas_pixels( a ) == NULL );
+	check( sprite_cache_resident_bytes( cache ) == size );
+
+	check( sprite_atlas_pin_pixels( a ) != NULL );
+	check( same_pixels( a, original ) );
+	check( sprite_atlas_pixels( b ) == NULL );
+	check( sprite_atlas_dirty_count( a ) == 1 ); /* still has to be uploaded */
+
+	check( sprite_atlas_pin_pixels( b ) != NULL );
+	check( sprite_atlas_dirty_count( b ) == 0 ); /* reloading doesn't change the pixels */
+	check( sprite_atlas_pixels( a ) != NULL && sprite_atlas_pixels( b ) != NULL );
+	check( sprite_cache_resident_bytes( cache ) == 2 * size );
+
+	sprite_cache_trim( cache );
+	check( sprite_atlas_pixels( a ) != NULL && sprite_atlas_pixels( b ) != NULL );
+
+	sprite_atlas_unpin_pixels( a );
+	check( sprite_atlas_pixels( a ) == NULL && sprite_atlas_pixels( b ) != NULL );
+	sprite_atlas_unpin_pixels( b );
+
+	/* saving reads evicted pixels back like any other use */
+	bool saved = sprite_atlas_save( a, FILENAME3 );
+	check( saved );
+	check( sprite_atlas_pixels( a ) != NULL && sprite_atlas_pixels( b ) == NULL );
+	check( sprite_cache_resident_bytes( cache ) == size );
+
+	/* replacing the pixels takes the atlas out of the cache */
+	bool borrowed = sprite_atlas_borrow_pixels( a, WIDTH, HEIGHT, BPP, padded, WIDTH * BPP + 12 );
+	check( borrowed );
+	check( sprite_cache_resident_bytes( cache ) == 0 );
+	check( !sprite_cache_add( cache, a ) );
+
+	/* atlases left in a destroyed cache get their pixels back */
+	sprite_cache_destroy( &cache );
+	check( sprite_atlas_pixels( b ) != NULL && same_pixels( b, original ) );
+
+	sprite_atlas_destroy( &a );
+	sprite_atlas_destroy( &b );
+	sprite_atlas_destroy( &original );
+	remove( FILENAME );
+	remove( FILENAME2 );
+	remove( FILENAME3 );
+}
+
+int main( int argc, char* argv[] )
+{
+	uint8_t tight[ WIDTH * BPP * HEIGHT ];
+	uint8_t padded[ (WIDTH * BPP + 12) * HEIGHT ];
+	uint8_t original[ sizeof(padded) ];
+
+	fill( tight, WIDTH * BPP );
+	fill( padded, WIDTH * BPP + 12 );
+	memcpy( original, padded, sizeof(padded) );
+
+	sprite_atlas_t* atlas = sprite_atlas_create( "tight", WIDTH, HEIGHT, BPP, tight );
+	check( atlas && sprite_atlas_pitch( atlas ) == WIDTH * BPP );
+	check_round_trip( "tight", atlas );
+
+	bool copied = sprite_atlas_copy_pixels( atlas, WIDTH, HEIGHT, BPP, padded, WIDTH * BPP + 12, 1 );
+	check( copied && sprite_atlas_pitch( atlas ) == WIDTH * BPP );
+	check_round_trip( "repacked", atlas );
+
+	copied = sprite_atlas_copy_pixels( atlas, WIDTH, HEIGHT, BPP, tight, WIDTH * BPP, 64 );
+	check( copied && sprite_atlas_pitch( atlas ) == 64 && sprite_atlas_alignment( atlas ) >= 64 );
+	check_round_trip( "aligned", atlas );
+
+	bool borrowed = sprite_atlas_borrow_pixels( atlas, WIDTH, HEIGHT, BPP, padded, WIDTH * BPP + 12 );
+	check( borrowed && sprite_atlas_pitch( atlas ) == WIDTH * BPP + 12 );
+	check_round_trip( "borrowed", atlas );
+	check( memcmp( padded, original, sizeof(padded) ) == 0 );
+
+	sprite_atlas_destroy( &atlas );
+
+	test_replaced_pixels_are_dirty( tight, padded );
+	test_newer_version_is_rejected( tight );
+	test_cache_pins( tight, padded );
+
+	if( failures == 0 )
+	{
+		printf( "All atlas tests passed.\n" );
+	}
+
+	return failures ? 1 : 0;
+}
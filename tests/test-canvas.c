@@ -0,0 +1,226 @@
+/*
+ * Copyright (C) 2012 by Joseph A. Marrero.  http://www.manvscode.com/
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sprite.h>
+#include <sprite-private.h>
+
+/*
+ * Checks the canvas blend kernels against each other and against the
+ * exact blend, then checks whole draws with flipping, scaling and
+ * clipping against a pixel by pixel reference. Build with -mavx2 to
+ * include the AVX2 kernel.
+ */
+static int failures = 0;
+
+#define check( condition ) \
+	do { \
+		if( !(condition) ) \
+		{ \
+			fprintf( stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition ); \
+			failures++; \
+		} \
+	} while( 0 )
+
+#define SPAN    67
+
+static uint8_t reference_blend( uint32_t s, uint32_t d, uint32_t a )
+{
+	return (uint8_t) ((s * a + d * (255 - a) + 127) / 255);
+}
+
+static uint8_t random_alpha( void )
+{
+	switch( rand( ) % 4 )
+	{
+		case 0: return 0;
+		case 1: return 255;
+		default: return (uint8_t) rand( );
+	}
+}
+
+static void test_kernels( void )
+{
+	const sprite_blend_kernel_t* kernels = NULL;
+	uint32_t kernel_count = sprite_canvas_blend_kernels( &kernels );
+	uint8_t src[ 4 * SPAN ];
+	uint8_t dst[ 4 * SPAN ];
+	uint8_t expected[ 4 * SPAN ];
+	uint8_t result[ 4 * SPAN ];
+
+	check( kernel_count >= 1 );
+
+	for( int trial = 0; trial < 20000; trial++ )
+	{
+		uint32_t count = (uint32_t) rand( ) % (SPAN + 1);
+		bool runs      = rand( ) % 2; /* whole groups of opaque or clear pixels */
+		uint8_t alpha  = random_alpha( );
+
+		for( uint32_t i = 0; i < 4 * SPAN; i++ )
+		{
+			src[ i ] = (uint8_t) rand( );
+			dst[ i ] = (uint8_t) rand( );
+		}
+
+		for( uint32_t i = 0; i < count; i++ )
+		{
+			if( !runs || i % 8 == 0 ) alpha = random_alpha( );
+			src[ 4 * i + 3 ] = alpha;
+		}
+
+		memcpy( expected, dst, sizeof(expected) );
+
+		for( uint32_t i = 0; i < count; i++ )
+		{
+			uint32_t a = src[ 4 * i + 3 ];
+			expected[ 4 * i + 0 ] = reference_blend( src[ 4 * i + 0 ], dst[ 4 * i + 0 ], a );
+			expected[ 4 * i + 1 ] = reference_blend( src[ 4 * i + 1 ], dst[ 4 * i + 1 ], a );
+			expected[ 4 * i + 2 ] = reference_blend( src[ 4 * i + 2 ], dst[ 4 * i + 2 ], a );
+			expected[ 4 * i + 3 ] = reference_blend( 255, dst[ 4 * i + 3 ], a );
+		}
+
+		for( uint32_t k = 0; k < kernel_count; k++ )
+		{
+			memcpy( result, dst, sizeof(result) );
+			kernels[ k ].blend( result, src, count );
+
+			if( memcmp( result, expected, sizeof(result) ) != 0 )
+			{
+				fprintf( stderr, "%s kernel differs, trial %d, %u pixels\n", kernels[ k ].name, trial, count );
+				exit( EXIT_FAILURE );
+			}
+		}
+	}
+
+	printf( "kernels:" );
+	for( uint32_t k = 0; k < kernel_count; k++ )
+	{
+		printf( " %s", kernels[ k ].name );
+	}
+	printf( "\n" );
+}
+
+static void test_draws( void )
+{
+	enum { ATLAS_WIDTH = 64, ATLAS_HEIGHT = 32, WIDTH = 100, HEIGHT = 80 };
+	static uint8_t atlas[ ATLAS_WIDTH * ATLAS_HEIGHT * 4 ];
+	static uint8_t canvas_pixels[ WIDTH * HEIGHT * 4 ];
+	static uint8_t expected[ WIDTH * HEIGHT * 4 ];
+
+	for( size_t i = 0; i < sizeof(atlas); i++ )
+	{
+		atlas[ i ] = (uint8_t) rand( );
+	}
+	for( size_t i = 0; i < sizeof(atlas) / 4; i++ )
+	{
+		atlas[ 4 * i + 3 ] = random_alpha( );
+	}
+
+	sprite_t* sprite = sprite_create( "canvas", true );
+	sprite_set_texture( sprite, ATLAS_WIDTH, ATLAS_HEIGHT, 4, atlas );
+	sprite_add_state( sprite, "idle" );
+	sprite_state_add_trimmed_frame( sprite_state( sprite, "idle" ), 5, 3, 21, 13, 10, 2, 4, 30, 20 );
+
+	const sprite_frame_t* frame = sprite_state_frame( sprite_state( sprite, "idle" ), 0 );
+	const uint8_t* pixels       = sprite_pixels( sprite );
+	uint32_t pitch              = sprite_pitch( sprite );
+	if( !pixels )
+	{
+		fprintf( stderr, "out of memory\n" );
+		exit( EXIT_FAILURE );
+	}
+
+	for( int trial = 0; trial < 500; trial++ )
+	{
+		sprite_canvas_t canvas;
+		sprite_canvas_initialize( &canvas, canvas_pixels, WIDTH, HEIGHT, WIDTH * 4 );
+		canvas.clip.x      = 3;
+		canvas.clip.y      = 2;
+		canvas.clip.width  = 90;
+		canvas.clip.height = 200; /* past the bottom of the canvas */
+
+		for( size_t i = 0; i < sizeof(canvas_pixels); i++ )
+		{
+			canvas_pixels[ i ] = expected[ i ] = (uint8_t) (i * 7 + trial);
+		}
+
+		sprite_draw_t draw = { sprite, frame, rand( ) % 140 - 40, rand( ) % 120 - 40, (uint8_t) (rand( ) % 4), (uint8_t) (rand( ) % 4) };
+		check( sprite_canvas_draw( &canvas, &draw ) );
+
+		int scale  = draw.scale > 1 ? draw.scale : 1;
+		bool flip  = draw.flags & SPRITE_DRAW_FLIP_X;
+		bool blend = draw.flags & SPRITE_DRAW_BLEND;
+
+		for( int y = 2; y < HEIGHT; y++ )
+		{
+			for( int x = 3; x < 93; x++ )
+			{
+				if( x < draw.x || y < draw.y ) continue;
+
+				int u = (x - draw.x) / scale;
+				int v = (y - draw.y) / scale - frame->offset_y;
+				u = (flip ? frame->source_width - 1 - u : u) - frame->offset_x;
+
+				if( u < 0 || v < 0 || u >= frame->width || v >= frame->height ) continue;
+
+				const uint8_t* s = pixels + (frame->y + v) * pitch + (frame->x + u) * 4;
+				uint8_t* d       = expected + (y * WIDTH + x) * 4;
+
+				if( blend )
+				{
+					d[ 0 ] = reference_blend( s[ 0 ], d[ 0 ], s[ 3 ] );
+					d[ 1 ] = reference_blend( s[ 1 ], d[ 1 ], s[ 3 ] );
+					d[ 2 ] = reference_blend( s[ 2 ], d[ 2 ], s[ 3 ] );
+					d[ 3 ] = reference_blend( 255, d[ 3 ], s[ 3 ] );
+				}
+				else
+				{
+					memcpy( d, s, 4 );
+				}
+			}
+		}
+
+		if( memcmp( canvas_pixels, expected, sizeof(expected) ) != 0 )
+		{
+			fprintf( stderr, "draw %d differs: at %d,%d scale %d flags %d\n", trial, draw.x, draw.y, draw.scale, draw.flags );
+			exit( EXIT_FAILURE );
+		}
+	}
+
+	sprite_destroy( &sprite );
+}
+
+int main( int argc, char* argv[] )
+{
+	srand( argc > 1 ? (unsigned) atoi( argv[ 1 ] ) : 1 );
+
+	test_kernels( );
+	test_draws( );
+
+	if( failures == 0 )
+	{
+		printf( "All canvas tests passed.\n" );
+	}
+
+	return failures ? EXIT_FAILURE : 0;
+}
@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2012 by Joseph A. Marrero.  http://www.manvscode.com/
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sprite.h>
+
+/*
+ * Checks the order of a draw list against a stable sort of the same
+ * records by layer, atlas and depth, where atlases rank in the order
+ * they first appear.
+ */
+static int failures = 0;
+
+#define check( condition ) \
+	do { \
+		if( !(condition) ) \
+		{ \
+			fprintf( stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition ); \
+			failures++; \
+		} \
+	} while( 0 )
+
+#define ATLAS_COUNT    5
+#define RECORD_COUNT   100000
+
+typedef struct record {
+	uint8_t  layer;
+	uint32_t atlas;
+	float    depth;
+	uint32_t index;
+} record_t;
+
+static int record_compare( const void* left, const void* right )
+{
+	const record_t* a = left;
+	const record_t* b = right;
+
+	if( a->layer != b->layer ) return a->layer < b->layer ? -1 : 1;
+	if( a->atlas != b->atlas ) return a->atlas < b->atlas ? -1 : 1;
+	if( a->depth != b->depth ) return a->depth < b->depth ? -1 : 1;
+	return a->index < b->index ? -1 : a->index > b->index; /* keeps qsort stable */
+}
+
+static uint32_t batch_count;
+static uint32_t item_count;
+
+static void render( void* context, const sprite_render_item_t* items, uint32_t count )
+{
+	const record_t* records = context;
+
+	for( uint32_t i = 0; i < count; i++ )
+	{
+		const record_t* first  = &records[ (uintptr_t) items[ 0 ].user_data ];
+		const record_t* record = &records[ (uintptr_t) items[ i ].user_data ];
+
+		check( sprite_atlas( items[ i ].sprite ) == sprite_atlas( items[ 0 ].sprite ) );
+		check( record->layer == first->layer );
+	}
+
+	batch_count++;
+	item_count += count;
+}
+
+static float random_depth( int round )
+{
+	switch( round )
+	{
+		case 0: return (float) (rand( ) % 200 - 100) / 7.0f;
+		case 1: return rand( ) % 2 ? 0.0f : -0.0f; /* must compare equal */
+		default: return 0.0f;
+	}
+}
+
+int main( int argc, char* argv[] )
+{
+	static record_t records[ RECORD_COUNT ];
+	static record_t expected[ RECORD_COUNT ];
+	sprite_render_item_t items[ 512 ];
+	sprite_t* sprites[ ATLAS_COUNT ];
+	sprite_atlas_t* atlases[ ATLAS_COUNT ];
+
+	srand( argc > 1 ? (unsigned) atoi( argv[ 1 ] ) : 1 );
+
+	for( int i = 0; i < ATLAS_COUNT; i++ )
+	{
+		sprites[ i ] = sprite_create( "sprite", true );
+		atlases[ i ] = sprite_atlas_create( "atlas", 4, 4, 4, NULL );
+		sprite_set_atlas( sprites[ i ], atlases[ i ] );
+	}
+
+	sprite_draw_list_t* list = sprite_draw_list_create( RECORD_COUNT );
+	if( !list )
+	{
+		fprintf( stderr, "out of memory\n" );
+		exit( EXIT_FAILURE );
+	}
+
+	for( int round = 0; round < 3; round++ )
+	{
+		int32_t rank[ ATLAS_COUNT ];
+		uint32_t ranked = 0;
+
+		memset( rank, -1, sizeof(rank) );
+		sprite_draw_list_clear( list );
+
+		for( uint32_t i = 0; i < RECORD_COUNT; i++ )
+		{
+			int sprite    = rand( ) % ATLAS_COUNT;
+			uint8_t layer = round == 2 ? 0 : (uint8_t) (rand( ) % 4);
+			float depth   = random_depth( round );
+
+			if( rank[ sprite ] < 0 )
+			{
+				rank[ sprite ] = (int32_t) ranked++;
+			}
+
+			records[ i ].layer = layer;
+			records[ i ].atlas = (uint32_t) rank[ sprite ];
+			records[ i ].depth = depth;
+			records[ i ].index = i;
+			check( sprite_draw_list_add( list, sprites[ sprite ], NULL, (void*) (uintptr_t) i, layer, depth ) );
+		}
+
+		check( sprite_draw_list_count( list ) == RECORD_COUNT );
+		check( !sprite_draw_list_add( list, sprites[ 0 ], NULL, NULL, 0, 0.0f ) );
+
+		memcpy( expected, records, sizeof(expected) );
+		qsort( expected, RECORD_COUNT, sizeof(record_t), record_compare );
+
+		const uint32_t* order = sprite_draw_list_order( list );
+
+		for( uint32_t i = 0; i < RECORD_COUNT; i++ )
+		{
+			if( order[ i ] != expected[ i ].index )
+			{
+				fprintf( stderr, "round %d: record %u is %u, expected %u\n", round, i, order[ i ], expected[ i ].index );
+				return EXIT_FAILURE;
+			}
+		}
+
+		batch_count = 0;
+		item_count  = 0;
+		sprite_draw_list_render( list, items, 512, render, records );
+		check( item_count == RECORD_COUNT );
+		printf( "round %d: %u batches\n", round, batch_count );
+	}
+
+	/* records added after a sort join the order */
+	sprite_draw_list_clear( list );
+	sprite_draw_list_add( list, sprites[ 0 ], NULL, NULL, 1, 5.0f );
+	sprite_draw_list_add( list, sprites[ 1 ], NULL, NULL, 0, 5.0f );
+	sprite_draw_list_sort( list );
+	sprite_draw_list_add( list, sprites[ 0 ], NULL, NULL, 0, 1.0f );
+
+	const uint32_t* order = sprite_draw_list_order( list );
+	check( order[ 0 ] == 2 && order[ 1 ] == 1 && order[ 2 ] == 0 );
+	check( sprite_draw_list_item( list, 2 )->sprite == sprites[ 0 ] );
+
+	sprite_draw_list_destroy( &list );
+
+	for( int i = 0; i < ATLAS_COUNT; i++ )
+	{
+		sprite_destroy( &sprites[ i ] );
+		sprite_atlas_destroy( &atlases[ i ] );
+	}
+
+	if( failures == 0 )
+	{
+		printf( "All draw list tests passed.\n" );
+	}
+
+	return failures ? EXIT_FAILURE : 0;
+}
@@ -0,0 +1,331 @@
+/*
+ * Copyright (C) 2012 by Joseph A. Marrero.  http://www.manvscode.com/
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sprite.h>
+
+/*
+ * Plays the same random players in two systems, one advanced with
+ * sprite_player_system_update, which walks the timing wheel, and one
+ * with sprite_player_system_update_parallel, which visits every player
+ * on worker threads. Both must end every update in the same state and
+ * report the same events. Handle bookkeeping is checked separately.
+ */
+static int failures = 0;
+
+#define check( condition ) \
+	do { \
+		if( !(condition) ) \
+		{ \
+			fprintf( stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition ); \
+			failures++; \
+		} \
+	} while( 0 )
+
+#define PLAYER_COUNT    3000
+#define UPDATE_COUNT    400
+#define EVENT_CAPACITY  (8 * PLAYER_COUNT)
+
+static const char* states[] = { "idle", "run", "jump", "still", "blink" };
+#define STATE_COUNT    (sizeof(states) / sizeof(states[ 0 ]))
+
+static sprite_t* create_sprite( void )
+{
+	sprite_t* sprite = sprite_create( "test", true );
+
+	sprite_add_state( sprite, "idle" );
+	for( int i = 0; i < 4; i++ ) sprite_add_frame( sprite, "idle", i, 0, 1, 1, 40 );
+
+	sprite_add_state( sprite, "run" );
+	sprite_add_frame( sprite, "run", 0, 0, 1, 1, 7 );
+	sprite_add_frame( sprite, "run", 1, 0, 1, 1, 0 );
+	sprite_add_frame( sprite, "run", 2, 0, 1, 1, 13 );
+	sprite_add_frame( sprite, "run", 3, 0, 1, 1, 29 );
+	sprite_state_set_frame_tag( sprite_state( sprite, "run" ), 2, sprite_tag( "footstep" ) );
+
+	sprite_add_state( sprite, "jump" );
+	sprite_add_frame( sprite, "jump", 0, 0, 1, 1, 30 );
+	sprite_add_frame( sprite, "jump", 1, 0, 1, 1, 45 );
+	sprite_state_set_loop_count( sprite_state( sprite, "jump" ), 2 );
+
+	sprite_add_state( sprite, "still" );
+	sprite_add_frame( sprite, "still", 0, 0, 1, 1, 0 );
+
+	sprite_add_state( sprite, "blink" );
+	for( int i = 0; i < 3; i++ ) sprite_add_frame( sprite, "blink", i, 0, 1, 1, 0 );
+	sprite_state_set_const_time( sprite_state( sprite, "blink" ), 2000 ); /* longer than the wheel */
+
+	check( sprite_add_transition( sprite, NULL, "jump", "jump", false ) );
+	check( sprite_add_transition( sprite, "jump", "idle", "land", true ) );
+	check( sprite_add_transition( sprite, "idle", "run", "move", false ) );
+	check( sprite_add_transition( sprite, "run", "idle", "stop", true ) );
+
+	return sprite;
+}
+
+static int event_compare( const void* left, const void* right )
+{
+	const sprite_event_t* a = left;
+	const sprite_event_t* b = right;
+
+	if( a->player != b->player ) return a->player < b->player ? -1 : 1;
+	if( a->type != b->type ) return a->type < b->type ? -1 : 1;
+	if( a->frame != b->frame ) return a->frame < b->frame ? -1 : 1;
+	if( a->value != b->value ) return a->value < b->value ? -1 : 1;
+	return 0;
+}
+
+/* Events are reported in a different order by the two updates. */
+static void compare_events( sprite_events_t* serial, sprite_events_t* parallel, uint32_t update )
+{
+	static sprite_event_t a[ EVENT_CAPACITY ];
+	static sprite_event_t b[ EVENT_CAPACITY ];
+	uint32_t count = sprite_events_count( serial );
+
+	check( sprite_events_dropped( serial ) == 0 && sprite_events_dropped( parallel ) == 0 );
+
+	if( count != sprite_events_count( parallel ) )
+	{
+		fprintf( stderr, "update %u: %u events, %u in parallel\n", update, count, sprite_events_count( parallel ) );
+		exit( EXIT_FAILURE );
+	}
+
+	memcpy( a, sprite_events_get( serial ), sizeof(sprite_event_t) * count );
+	memcpy( b, sprite_events_get( parallel ), sizeof(sprite_event_t) * count );
+	qsort( a, count, sizeof(sprite_event_t), event_compare );
+	qsort( b, count, sizeof(sprite_event_t), event_compare );
+
+	for( uint32_t i = 0; i < count; i++ )
+	{
+		if( event_compare( &a[ i ], &b[ i ] ) != 0 )
+		{
+			fprintf( stderr, "update %u: events differ\n", update );
+			exit( EXIT_FAILURE );
+		}
+	}
+
+	sprite_events_clear( serial );
+	sprite_events_clear( parallel );
+}
+
+static void compare_systems( const sprite_player_system_t* serial, const sprite_player_system_t* parallel, uint32_t update )
+{
+	static sprite_player_snapshot_t a[ PLAYER_COUNT ];
+	static sprite_player_snapshot_t b[ PLAYER_COUNT ];
+	uint32_t count = sprite_player_system_count( serial );
+
+	check( count == sprite_player_system_count( parallel ) );
+	sprite_player_system_snapshot_all( serial, a );
+	sprite_player_system_snapshot_all( parallel, b );
+
+	for( uint32_t i = 0; i < count; i++ )
+	{
+		if( memcmp( &a[ i ], &b[ i ], sizeof(sprite_player_snapshot_t) ) != 0 ||
+		    sprite_player_system_frames( serial )[ i ] != sprite_player_system_frames( parallel )[ i ] )
+		{
+			fprintf( stderr, "update %u: player %u differs\n", update, i );
+			exit( EXIT_FAILURE );
+		}
+	}
+}
+
+static void test_update_parallel( void )
+{
+	sprite_t* sprite            = create_sprite( );
+	sprite_workers_t* workers   = sprite_workers_create( 4 );
+	sprite_player_system_t* a   = sprite_player_system_create( PLAYER_COUNT );
+	sprite_player_system_t* b   = sprite_player_system_create( PLAYER_COUNT );
+	sprite_events_t* a_events   = sprite_events_create( EVENT_CAPACITY );
+	sprite_events_t* b_events   = sprite_events_create( EVENT_CAPACITY );
+	static sprite_player_handle_t handles[ PLAYER_COUNT ];
+	static uint32_t conditions[ PLAYER_COUNT ];
+	uint32_t handle_count = 0;
+	uint32_t now          = 0;
+
+	if( !(sprite && workers && a && b && a_events && b_events) )
+	{
+		fprintf( stderr, "out of memory\n" );
+		exit( EXIT_FAILURE );
+	}
+
+	sprite_player_system_set_events( a, a_events );
+	sprite_player_system_set_events( b, b_events );
+
+	for( uint32_t update = 0; update < UPDATE_COUNT; update++ )
+	{
+		/* the same changes to both systems */
+		for( int change = rand( ) % 64; change > 0; change-- )
+		{
+			int what = rand( ) % 8;
+
+			if( what < 3 && handle_count < PLAYER_COUNT )
+			{
+				sprite_player_handle_t handle = sprite_player_system_add( a, sprite, NULL );
+				check( handle == sprite_player_system_add( b, sprite, NULL ) );
+				handles[ handle_count++ ] = handle;
+			}
+			else if( handle_count > 0 )
+			{
+				uint32_t which = (uint32_t) rand( ) % handle_count;
+				sprite_player_handle_t handle = handles[ which ];
+
+				switch( what )
+				{
+					case 3:
+						check( sprite_player_system_remove( a, handle ) );
+						check( sprite_player_system_remove( b, handle ) );
+						handles[ which ] = handles[ --handle_count ];
+						break;
+					case 4:
+						sprite_player_system_stop( a, handle );
+						sprite_player_system_stop( b, handle );
+						break;
+					case 5:
+					{
+						uint32_t time = (uint32_t) rand( ) % 3000;
+						sprite_player_system_seek( a, handle, time );
+						sprite_player_system_seek( b, handle, time );
+						break;
+					}
+					default:
+					{
+						const char* state = states[ rand( ) % STATE_COUNT ];
+						check( sprite_player_system_play( a, handle, state ) );
+						check( sprite_player_system_play( b, handle, state ) );
+						break;
+					}
+				}
+			}
+		}
+
+		if( rand( ) % 10 == 0 )
+		{
+			for( uint32_t i = 0; i < sprite_player_system_count( a ); i++ )
+			{
+				conditions[ i ] = (uint32_t) rand( ) & ((1u << sprite_condition_count( sprite )) - 1);
+			}
+
+			sprite_player_system_transition( a, conditions );
+			sprite_player_system_transition( b, conditions );
+		}
+
+		compare_events( a_events, b_events, update );
+
+		/* mostly short steps, sometimes more than the wheel's span */
+		now += rand( ) % 20 == 0 ? 500 + (uint32_t) rand( ) % 3000 : (uint32_t) rand( ) % 50;
+
+		sprite_player_system_update( a, now );
+		sprite_player_system_update_parallel( b, now, 256, sprite_workers_dispatch, workers );
+
+		compare_systems( a, b, update );
+		compare_events( a_events, b_events, update );
+	}
+
+	printf( "%u players agree after %u updates\n", sprite_player_system_count( a ), UPDATE_COUNT );
+
+	sprite_events_destroy( &a_events );
+	sprite_events_destroy( &b_events );
+	sprite_player_system_destroy( &a );
+	sprite_player_system_destroy( &b );
+	sprite_workers_destroy( &workers );
+	sprite_destroy( &sprite );
+}
+
+static void test_handles( void )
+{
+	enum { CAPACITY = 8 };
+	sprite_t* sprite = create_sprite( );
+	sprite_player_system_t* sys   = sprite_player_system_create( CAPACITY );
+	sprite_player_system_t* other = sprite_player_system_create( CAPACITY );
+	sprite_player_handle_t handles[ CAPACITY ];
+
+	check( !sprite_player_system_is_valid( sys, SPRITE_PLAYER_INVALID_HANDLE ) );
+
+	/* a handle from another system names a slot that was never handed out here */
+	sprite_player_handle_t foreign = SPRITE_PLAYER_INVALID_HANDLE;
+	for( int i = 0; i < 3; i++ ) foreign = sprite_player_system_add( other, sprite, NULL );
+	check( !sprite_player_system_is_valid( sys, foreign ) );
+	check( sprite_player_system_index( sys, foreign ) == -1 );
+	check( !sprite_player_system_play( sys, foreign, "idle" ) );
+	check( !sprite_player_system_remove( sys, foreign ) );
+
+	for( uint32_t i = 0; i < CAPACITY; i++ )
+	{
+		handles[ i ] = sprite_player_system_add( sys, sprite, (void*) (uintptr_t) (i + 1) );
+		check( handles[ i ] != SPRITE_PLAYER_INVALID_HANDLE );
+		check( sprite_player_system_index( sys, handles[ i ] ) == (int32_t) i );
+		check( sprite_player_system_handle( sys, i ) == handles[ i ] );
+	}
+
+	check( sprite_player_system_add( sys, sprite, NULL ) == SPRITE_PLAYER_INVALID_HANDLE );
+
+	/* removing moves the last player into the hole; its handle still works */
+	check( sprite_player_system_play( sys, handles[ CAPACITY - 1 ], "run" ) );
+	check( sprite_player_system_remove( sys, handles[ 2 ] ) );
+	check( !sprite_player_system_is_valid( sys, handles[ 2 ] ) );
+	check( !sprite_player_system_remove( sys, handles[ 2 ] ) );
+	check( !sprite_player_system_play( sys, handles[ 2 ], "idle" ) );
+	check( sprite_player_system_user_data( sys, handles[ 2 ] ) == NULL );
+	check( sprite_player_system_index( sys, handles[ CAPACITY - 1 ] ) == 2 );
+	check( sprite_player_system_user_data( sys, handles[ CAPACITY - 1 ] ) == (void*) (uintptr_t) CAPACITY );
+	check( sprite_player_system_is_playing( sys, handles[ CAPACITY - 1 ] ) );
+
+	/* the slot is reused under a new generation */
+	sprite_player_handle_t reused = sprite_player_system_add( sys, sprite, NULL );
+	check( reused != SPRITE_PLAYER_INVALID_HANDLE && reused != handles[ 2 ] );
+	check( !sprite_player_system_is_valid( sys, handles[ 2 ] ) );
+	check( sprite_player_system_is_valid( sys, reused ) );
+
+	/* free slots reject handles with their current generation */
+	for( uint32_t i = 0; i < CAPACITY; i++ )
+	{
+		sprite_player_system_remove( sys, handles[ i ] );
+	}
+	sprite_player_system_remove( sys, reused );
+	check( sprite_player_system_count( sys ) == 0 );
+
+	for( uint32_t i = 0; i < CAPACITY; i++ )
+	{
+		check( !sprite_player_system_is_valid( sys, handles[ i ] ) );
+		check( !sprite_player_system_is_valid( sys, sprite_player_system_handle( other, 0 ) ) );
+	}
+
+	sprite_player_system_destroy( &sys );
+	sprite_player_system_destroy( &other );
+	sprite_destroy( &sprite );
+}
+
+int main( int argc, char* argv[] )
+{
+	srand( argc > 1 ? (unsigned) atoi( argv[ 1 ] ) : 1 );
+
+	test_handles( );
+	test_update_parallel( );
+
+	if( failures == 0 )
+	{
+		printf( "All player system tests passed.\n" );
+	}
+
+	return failures ? EXIT_FAILURE : 0;
+}
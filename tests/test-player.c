@@ -0,0 +1,510 @@
+/*
+ * Copyright (C) 2012 by Joseph A. Marrero.  http://www.manvscode.com/
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sprite.h>
+
+/*
+ * Checks which frame a state shows at any time and how a player gets
+ * there: constant time states, frames that take no time, catching up
+ * many loops in one step, seeking and finite loop counts. Queued and
+ * pushed states are checked with fixed steps against the events they
+ * report.
+ */
+static int failures = 0;
+
+#define check( condition ) \
+	do { \
+		if( !(condition) ) \
+		{ \
+			fprintf( stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition ); \
+			failures++; \
+		} \
+	} while( 0 )
+
+static const uint16_t walk_times[]   = { 10, 0, 20, 30 };
+static const uint16_t attack_times[] = { 40, 60 };
+#define WALK_FRAMES      (sizeof(walk_times) / sizeof(walk_times[ 0 ]))
+#define ATTACK_FRAMES    (sizeof(attack_times) / sizeof(attack_times[ 0 ]))
+
+typedef struct expected_event {
+	uint8_t  type;
+	uint16_t frame;
+	uint32_t value;
+} expected_event_t;
+
+static sprite_t* create_sprite( void )
+{
+	sprite_t* sprite = sprite_create( "test", true );
+
+	if( !sprite )
+	{
+		fprintf( stderr, "out of memory\n" );
+		exit( EXIT_FAILURE );
+	}
+
+	sprite_add_state( sprite, "walk" );
+	for( uint16_t i = 0; i < WALK_FRAMES; i++ ) sprite_add_frame( sprite, "walk", i, 0, 1, 1, walk_times[ i ] );
+
+	sprite_add_state( sprite, "blink" );
+	for( uint16_t i = 0; i < 3; i++ ) sprite_add_frame( sprite, "blink", i, 0, 1, 1, 0 );
+	sprite_state_set_const_time( sprite_state( sprite, "blink" ), 25 );
+
+	sprite_add_state( sprite, "attack" );
+	for( uint16_t i = 0; i < ATTACK_FRAMES; i++ ) sprite_add_frame( sprite, "attack", i, 0, 1, 1, attack_times[ i ] );
+	sprite_state_set_loop_count( sprite_state( sprite, "attack" ), 2 );
+
+	sprite_add_state( sprite, "still" );
+	sprite_add_frame( sprite, "still", 0, 0, 1, 1, 0 );
+
+	return sprite;
+}
+
+/* The first frame that ends after time, found by walking the frames. */
+static uint16_t reference_frame( const uint16_t* times, uint16_t count, uint32_t time, uint32_t* frame_end )
+{
+	uint32_t end = 0;
+
+	for( uint16_t i = 0; i < count; i++ )
+	{
+		end += times[ i ];
+
+		if( end > time )
+		{
+			*frame_end = end;
+			return i;
+		}
+	}
+
+	*frame_end = end;
+	return count - 1;
+}
+
+static void check_events( sprite_events_t* events, const expected_event_t* expected, uint32_t count )
+{
+	const sprite_event_t* reported = sprite_events_get( events );
+
+	check( sprite_events_count( events ) == count );
+
+	for( uint32_t i = 0; i < count && i < sprite_events_count( events ); i++ )
+	{
+		if( reported[ i ].type != expected[ i ].type || reported[ i ].frame != expected[ i ].frame || reported[ i ].value != expected[ i ].value )
+		{
+			fprintf( stderr, "event %u: type %u frame %u value %u, expected type %u frame %u value %u\n", i,
+			         reported[ i ].type, reported[ i ].frame, reported[ i ].value, expected[ i ].type, expected[ i ].frame, expected[ i ].value );
+			failures++;
+		}
+	}
+
+	sprite_events_clear( events );
+}
+
+static void test_frame_at( sprite_t* sprite )
+{
+	const sprite_state_t* walk = sprite_state( sprite, "walk" );
+	sprite_state_t* blink      = sprite_state( sprite, "blink" );
+	uint32_t frame_end         = 0;
+	uint32_t expected_end      = 0;
+
+	check( sprite_state_duration( walk ) == 60 );
+
+	/* frames that take no time never show */
+	for( uint32_t time = 0; time < 60; time++ )
+	{
+		uint16_t frame = sprite_state_frame_at( walk, time, &frame_end );
+		check( frame == reference_frame( walk_times, WALK_FRAMES, time, &expected_end ) );
+		check( frame_end == expected_end );
+		check( frame != 1 );
+	}
+
+	/* the constant time replaces the time of every frame */
+	check( sprite_state_duration( blink ) == 75 );
+	check( sprite_state_frame_time( blink, 2 ) == 25 );
+
+	for( uint32_t time = 0; time < 75; time++ )
+	{
+		check( sprite_state_frame_at( blink, time, &frame_end ) == time / 25 );
+		check( frame_end == (time / 25 + 1) * 25 );
+	}
+
+	/* without it the frames take no time at all */
+	sprite_state_set_const_time( blink, 0 );
+	check( sprite_state_duration( blink ) == 0 );
+	check( sprite_state_frame_at( blink, 0, &frame_end ) == 0 && frame_end == 0 );
+
+	sprite_state_set_const_time( blink, 25 );
+	check( sprite_state_duration( blink ) == 75 );
+
+	/* the timing follows frames that are added and removed */
+	sprite_add_state( sprite, "shrink" );
+	for( uint16_t i = 0; i < WALK_FRAMES; i++ ) sprite_add_frame( sprite, "shrink", i, 0, 1, 1, walk_times[ i ] );
+	sprite_remove_frame( sprite, "shrink", 3 );
+	check( sprite_state_duration( sprite_state( sprite, "shrink" ) ) == 30 );
+	check( sprite_state_frame_at( sprite_state( sprite, "shrink" ), 29, &frame_end ) == 2 && frame_end == 30 );
+}
+
+/*
+ * Random steps, some with fractions of a millisecond and some many
+ * loops long, must land where the total time does.
+ */
+static void test_catch_up( sprite_t* sprite )
+{
+	sprite_player_t* player = sprite_player_create( sprite );
+	sprite_events_t* events = sprite_events_create( 16 );
+	sprite_player_snapshot_t snapshot;
+	sprite_time_t total     = 0;
+	uint64_t loops          = 0;
+	uint32_t frame_end      = 0;
+
+	if( !player || !events )
+	{
+		fprintf( stderr, "out of memory\n" );
+		exit( EXIT_FAILURE );
+	}
+
+	sprite_player_set_events( player, events );
+	sprite_player_play( player, "walk" );
+	check_events( events, (expected_event_t[]) { { SPRITE_EVENT_FRAME, 0, 0 } }, 1 );
+
+	for( int step = 0; step < 20000; step++ )
+	{
+		sprite_time_t dt = step % 100 == 0 ? sprite_time_from_ms( 60 * (rand( ) % 5000) + rand( ) % 60 )
+		                                   : (sprite_time_t) rand( ) % sprite_time_from_ms( 25 );
+		total += dt;
+
+		const sprite_frame_t* frame = sprite_player_advance( player, dt );
+		uint16_t expected           = reference_frame( walk_times, WALK_FRAMES, sprite_time_to_ms( total ) % 60, &frame_end );
+
+		sprite_player_snapshot( player, &snapshot );
+		check( snapshot.frame == expected );
+		check( frame == sprite_state_frame( sprite_state( sprite, "walk" ), expected ) );
+		check( snapshot.time == total % sprite_time_from_ms( 60 ) );
+		check( snapshot.is_playing );
+
+		for( uint32_t i = 0; i < sprite_events_count( events ); i++ )
+		{
+			if( sprite_events_get( events )[ i ].type == SPRITE_EVENT_LOOP )
+			{
+				loops += sprite_events_get( events )[ i ].value;
+			}
+		}
+
+		check( sprite_events_dropped( events ) == 0 );
+		sprite_events_clear( events );
+	}
+
+	check( loops == total / sprite_time_from_ms( 60 ) );
+
+	/* 1000 loops in one step are a single loop event */
+	sprite_player_seek( player, 0 );
+	sprite_events_clear( events );
+	sprite_player_advance( player, sprite_time_from_ms( 60 * 1000 + 35 ) );
+	check_events( events, (expected_event_t[]) { { SPRITE_EVENT_LOOP, 3, 1000 }, { SPRITE_EVENT_FRAME, 3, 0 } }, 2 );
+
+	sprite_events_destroy( &events );
+	sprite_player_destroy( &player );
+}
+
+static void test_const_time_and_still( sprite_t* sprite )
+{
+	sprite_player_t* player = sprite_player_create( sprite );
+	sprite_events_t* events = sprite_events_create( 16 );
+	sprite_player_snapshot_t snapshot;
+
+	if( !player || !events )
+	{
+		fprintf( stderr, "out of memory\n" );
+		exit( EXIT_FAILURE );
+	}
+
+	sprite_player_set_events( player, events );
+
+	sprite_player_play( player, "blink" );
+	sprite_player_advance( player, sprite_time_from_ms( 24 ) );
+	sprite_player_advance( player, sprite_time_from_ms( 1 ) );
+	sprite_player_advance( player, sprite_time_from_ms( 55 ) );
+	check_events( events, (expected_event_t[]) {
+		{ SPRITE_EVENT_FRAME, 0, 0 },
+		{ SPRITE_EVENT_FRAME, 1, 0 },
+		{ SPRITE_EVENT_LOOP, 0, 1 },
+		{ SPRITE_EVENT_FRAME, 0, 0 },
+	}, 4 );
+	sprite_player_snapshot( player, &snapshot );
+	check( snapshot.frame == 0 && snapshot.time == sprite_time_from_ms( 5 ) );
+
+	/* a state whose frames take no time stays on its first frame and reports nothing */
+	sprite_player_play( player, "still" );
+	sprite_player_advance( player, sprite_time_from_ms( 1000 ) );
+	check( sprite_events_count( events ) == 0 );
+	sprite_player_snapshot( player, &snapshot );
+	check( snapshot.frame == 0 && snapshot.is_playing );
+
+	sprite_events_destroy( &events );
+	sprite_player_destroy( &player );
+}
+
+static void test_loop_count( sprite_t* sprite )
+{
+	sprite_player_t* player = sprite_player_create( sprite );
+	sprite_events_t* events = sprite_events_create( 16 );
+	sprite_player_snapshot_t snapshot;
+
+	if( !player || !events )
+	{
+		fprintf( stderr, "out of memory\n" );
+		exit( EXIT_FAILURE );
+	}
+
+	sprite_player_set_events( player, events );
+
+	/* two loops of 100 ms, then the player stops on the last frame */
+	sprite_player_play( player, "attack" );
+	sprite_player_advance( player, sprite_time_from_ms( 99 ) );
+	sprite_player_advance( player, sprite_time_from_ms( 1 ) );
+	sprite_player_snapshot( player, &snapshot );
+	check( snapshot.frame == 0 && snapshot.loops_left == 1 && snapshot.is_playing );
+
+	sprite_player_advance( player, sprite_time_from_ms( 100 ) );
+	check_events( events, (expected_event_t[]) {
+		{ SPRITE_EVENT_FRAME, 0, 0 },
+		{ SPRITE_EVENT_FRAME, 1, 0 },
+		{ SPRITE_EVENT_LOOP, 0, 1 },
+		{ SPRITE_EVENT_FRAME, 0, 0 },
+		{ SPRITE_EVENT_FRAME, 1, 0 },
+		{ SPRITE_EVENT_FINISHED, 1, 0 },
+	}, 6 );
+	sprite_player_snapshot( player, &snapshot );
+	check( snapshot.frame == 1 && !snapshot.is_playing );
+	check( snapshot.time == sprite_time_from_ms( 100 ) );
+
+	sprite_player_advance( player, sprite_time_from_ms( 500 ) );
+	check( sprite_events_count( events ) == 0 );
+
+	/* finishing in the same step as the loops before it */
+	sprite_player_play( player, "attack" );
+	sprite_player_advance( player, sprite_time_from_ms( 5000 ) );
+	check_events( events, (expected_event_t[]) {
+		{ SPRITE_EVENT_FRAME, 0, 0 },
+		{ SPRITE_EVENT_LOOP, 1, 1 },
+		{ SPRITE_EVENT_FRAME, 1, 0 },
+		{ SPRITE_EVENT_FINISHED, 1, 0 },
+	}, 4 );
+
+	/* seeking restarts the loop count and doesn't resume the player */
+	sprite_player_seek( player, sprite_time_from_ms( 150 ) );
+	sprite_player_snapshot( player, &snapshot );
+	check( snapshot.frame == 1 && snapshot.loops_left == 1 && !snapshot.is_playing );
+	check( snapshot.time == sprite_time_from_ms( 50 ) );
+
+	sprite_player_play( player, "attack" );
+	sprite_player_seek( player, sprite_time_from_ms( 30 ) );
+	sprite_player_snapshot( player, &snapshot );
+	check( snapshot.frame == 0 && snapshot.loops_left == 2 && snapshot.is_playing );
+
+	sprite_events_clear( events );
+	sprite_player_seek( player, sprite_time_from_ms( 250 ) );
+	check_events( events, (expected_event_t[]) {
+		{ SPRITE_EVENT_LOOP, 1, 1 },
+		{ SPRITE_EVENT_FRAME, 1, 0 },
+		{ SPRITE_EVENT_FINISHED, 1, 0 },
+	}, 3 );
+	sprite_player_snapshot( player, &snapshot );
+	check( snapshot.frame == 1 && !snapshot.is_playing );
+
+	sprite_events_destroy( &events );
+	sprite_player_destroy( &player );
+}
+
+static sprite_player_t* create_player( sprite_t* sprite, sprite_events_t* events )
+{
+	sprite_player_t* player = sprite_player_create( sprite );
+
+	if( !player || !events )
+	{
+		fprintf( stderr, "out of memory\n" );
+		exit( EXIT_FAILURE );
+	}
+
+	sprite_player_set_events( player, events );
+	return player;
+}
+
+static void check_position( const sprite_player_t* player, const sprite_state_t* state, uint16_t frame, uint32_t time )
+{
+	sprite_player_snapshot_t snapshot;
+	sprite_player_snapshot( player, &snapshot );
+
+	check( snapshot.state == sprite_state_id( state ) );
+	check( snapshot.frame == frame );
+	check( snapshot.time == sprite_time_from_ms( time ) );
+}
+
+/*
+ * A looping state ends at the end of its loop once something is
+ * queued, and the queued states follow each other on the exact
+ * millisecond.
+ */
+static void test_queue( sprite_t* sprite )
+{
+	sprite_events_t* events = sprite_events_create( 64 );
+	sprite_player_t* player = create_player( sprite, events );
+
+	sprite_player_play( player, "walk" );
+	check( sprite_player_enqueue( player, "attack" ) );
+	check( sprite_player_enqueue( player, "blink" ) );
+
+	for( int step = 0; step < 60; step++ )
+	{
+		sprite_player_advance( player, sprite_time_from_ms( 5 ) );
+	}
+
+	check_events( events, (expected_event_t[]) {
+		{ SPRITE_EVENT_FRAME, 0, 0 },    /* walk at 0 */
+		{ SPRITE_EVENT_FRAME, 2, 0 },    /* 10, skipping the frame that takes no time */
+		{ SPRITE_EVENT_FRAME, 3, 0 },    /* 30 */
+		{ SPRITE_EVENT_FINISHED, 3, 0 }, /* 60 */
+		{ SPRITE_EVENT_FRAME, 0, 0 },    /* attack at 60 */
+		{ SPRITE_EVENT_FRAME, 1, 0 },    /* 100 */
+		{ SPRITE_EVENT_LOOP, 0, 1 },     /* 160 */
+		{ SPRITE_EVENT_FRAME, 0, 0 },
+		{ SPRITE_EVENT_FRAME, 1, 0 },    /* 200 */
+		{ SPRITE_EVENT_FINISHED, 1, 0 }, /* 260 */
+		{ SPRITE_EVENT_FRAME, 0, 0 },    /* blink at 260 */
+		{ SPRITE_EVENT_FRAME, 1, 0 },    /* 285 */
+	}, 12 );
+	check_position( player, sprite_state( sprite, "blink" ), 1, 40 );
+
+	/* time left over from a state that ended carries into the next one */
+	sprite_player_play( player, "walk" );
+	check( sprite_player_enqueue( player, "attack" ) );
+	sprite_player_advance( player, sprite_time_from_ms( 70 ) );
+	check_events( events, (expected_event_t[]) {
+		{ SPRITE_EVENT_FRAME, 0, 0 },
+		{ SPRITE_EVENT_FRAME, 3, 0 },
+		{ SPRITE_EVENT_FINISHED, 3, 0 },
+		{ SPRITE_EVENT_FRAME, 0, 0 },
+	}, 4 );
+	check_position( player, sprite_state( sprite, "attack" ), 0, 10 );
+
+	/* playing another state discards the queue */
+	check( sprite_player_enqueue( player, "blink" ) );
+	sprite_player_play( player, "walk" );
+	sprite_player_advance( player, sprite_time_from_ms( 1000 ) );
+	check( sprite_player_is_playing( player, "walk" ) );
+	check_position( player, sprite_state( sprite, "walk" ), 3, 1000 % 60 );
+	sprite_events_clear( events );
+
+	/* the queue holds SPRITE_ANIMATION_STACK_DEPTH states */
+	for( int i = 0; i < SPRITE_ANIMATION_STACK_DEPTH; i++ )
+	{
+		check( sprite_player_enqueue( player, "blink" ) );
+	}
+	check( !sprite_player_enqueue( player, "blink" ) );
+	sprite_player_clear_queue( player );
+	check( sprite_player_enqueue( player, "blink" ) );
+
+	sprite_events_destroy( &events );
+	sprite_player_destroy( &player );
+}
+
+/*
+ * A pushed state plays once and returns to the state below it at the
+ * frame and time where it was interrupted.
+ */
+static void test_stack( sprite_t* sprite )
+{
+	sprite_events_t* events = sprite_events_create( 64 );
+	sprite_player_t* player = create_player( sprite, events );
+
+	sprite_player_play( player, "walk" );
+	sprite_player_advance( player, sprite_time_from_ms( 15 ) );
+	check( sprite_player_push( player, "attack" ) );
+
+	for( int step = 0; step < 44; step++ )
+	{
+		sprite_player_advance( player, sprite_time_from_ms( 5 ) );
+	}
+
+	check_events( events, (expected_event_t[]) {
+		{ SPRITE_EVENT_FRAME, 0, 0 },    /* walk at 0 */
+		{ SPRITE_EVENT_FRAME, 2, 0 },    /* 10 */
+		{ SPRITE_EVENT_FRAME, 0, 0 },    /* attack pushed at 15 */
+		{ SPRITE_EVENT_FRAME, 1, 0 },    /* 55 */
+		{ SPRITE_EVENT_LOOP, 0, 1 },     /* 115 */
+		{ SPRITE_EVENT_FRAME, 0, 0 },
+		{ SPRITE_EVENT_FRAME, 1, 0 },    /* 155 */
+		{ SPRITE_EVENT_FINISHED, 1, 0 }, /* 215, walk resumes at 15 */
+		{ SPRITE_EVENT_FRAME, 3, 0 },    /* 230, walk at 30 */
+	}, 9 );
+	check_position( player, sprite_state( sprite, "walk" ), 3, 35 );
+
+	/* a pushed state that loops forever returns after one loop */
+	check( sprite_player_push( player, "blink" ) );
+	sprite_player_advance( player, sprite_time_from_ms( 75 + 5 ) );
+	check_position( player, sprite_state( sprite, "walk" ), 3, 40 );
+	sprite_events_clear( events );
+
+	/* pushes nest up to SPRITE_ANIMATION_STACK_DEPTH deep */
+	for( int i = 0; i < SPRITE_ANIMATION_STACK_DEPTH; i++ )
+	{
+		check( sprite_player_push( player, "attack" ) );
+	}
+	check( !sprite_player_push( player, "attack" ) );
+
+	/* each one plays to the end before the one below resumes */
+	sprite_player_advance( player, sprite_time_from_ms( 200 * SPRITE_ANIMATION_STACK_DEPTH ) );
+	check_position( player, sprite_state( sprite, "walk" ), 3, 40 );
+	check( sprite_player_is_playing( player, "walk" ) );
+
+	/* playing another state discards the stack */
+	check( sprite_player_push( player, "attack" ) );
+	sprite_player_play( player, "blink" );
+	sprite_player_advance( player, sprite_time_from_ms( 1000 ) );
+	check( sprite_player_is_playing( player, "blink" ) );
+
+	sprite_events_destroy( &events );
+	sprite_player_destroy( &player );
+}
+
+int main( int argc, char* argv[] )
+{
+	srand( argc > 1 ? (unsigned) atoi( argv[ 1 ] ) : 1 );
+
+	sprite_t* sprite = create_sprite( );
+
+	test_frame_at( sprite );
+	test_catch_up( sprite );
+	test_const_time_and_still( sprite );
+	test_loop_count( sprite );
+	test_queue( sprite );
+	test_stack( sprite );
+
+	sprite_destroy( &sprite );
+
+	if( failures == 0 )
+	{
+		printf( "All player tests passed.\n" );
+	}
+
+	return failures ? EXIT_FAILURE : 0;
+}
@@ -0,0 +1,259 @@
+/*
+ * Copyright (C) 2012 by Joseph A. Marrero.  http://www.manvscode.com/
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sprite.h>
+
+/*
+ * Saves sprites and checks that they load back the same: metadata
+ * channels, also after frames have been removed, and the state
+ * machine's conditions and transitions, including after a state that
+ * transitions refer to has been renamed.
+ */
+#define FILENAME    "test-sprite-file.spr"
+
+static int failures = 0;
+
+#define check( condition ) \
+	do { \
+		if( !(condition) ) \
+		{ \
+			fprintf( stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition ); \
+			failures++; \
+		} \
+	} while( 0 )
+
+static sprite_t* save_and_load( sprite_t* sprite )
+{
+	bool saved = sprite_save( sprite, FILENAME );
+	check( saved );
+
+	sprite_t* loaded = saved ? sprite_from_file( FILENAME ) : NULL;
+	check( loaded );
+	remove( FILENAME );
+	return loaded;
+}
+
+static sprite_box_t frame_box( uint16_t frame, uint8_t channel )
+{
+	sprite_box_t box = { (int16_t) (frame * 10 + channel), (int16_t) -frame, (uint16_t) (channel + 1), (uint16_t) (frame + 1) };
+	return box;
+}
+
+/* frames[ i ] is the frame the boxes of frame i were set for */
+static void check_channels( const sprite_t* sprite, const uint16_t* frames, uint16_t count )
+{
+	const sprite_state_t* state = sprite_state( sprite, "punch" );
+	check( state );
+
+	if( !state )
+	{
+		return;
+	}
+
+	check( sprite_state_frame_count( state ) == count );
+	check( sprite_state_channel_count( state ) == 2 );
+	check( sprite_state_channel( state, "hitbox" ) == 0 );
+	check( sprite_state_channel( state, "hurtbox" ) == 1 );
+	check( strcmp( sprite_state_channel_name( state, 1 ), "hurtbox" ) == 0 );
+
+	for( uint16_t i = 0; i < count && i < sprite_state_frame_count( state ); i++ )
+	{
+		for( uint8_t channel = 0; channel < 2; channel++ )
+		{
+			sprite_box_t expected = frame_box( frames[ i ], channel );
+			const sprite_box_t* box = sprite_state_frame_box( state, channel, i );
+			check( memcmp( box, &expected, sizeof(expected) ) == 0 );
+		}
+
+		check( sprite_state_frame( state, i )->x == frames[ i ] * 8 );
+	}
+}
+
+static void test_channels( void )
+{
+	sprite_t* sprite = sprite_create( "channels", true );
+
+	if( !sprite )
+	{
+		fprintf( stderr, "out of memory\n" );
+		exit( EXIT_FAILURE );
+	}
+
+	check( sprite_add_state( sprite, "punch" ) );
+	sprite_state_t* state = sprite_state( sprite, "punch" );
+
+	/* one channel is added before the frames and one after them */
+	check( sprite_state_add_channel( state, "hitbox" ) == 0 );
+
+	for( uint16_t frame = 0; frame < 5; frame++ )
+	{
+		check( sprite_add_frame( sprite, "punch", frame * 8, 0, 8, 8, 10 ) );
+	}
+
+	check( sprite_state_add_channel( state, "hurtbox" ) == 1 );
+
+	for( uint16_t frame = 0; frame < 5; frame++ )
+	{
+		for( uint8_t channel = 0; channel < 2; channel++ )
+		{
+			sprite_box_t box = frame_box( frame, channel );
+			check( sprite_state_set_frame_box( state, channel, frame, &box ) );
+		}
+	}
+
+	check_channels( sprite, (uint16_t[]) { 0, 1, 2, 3, 4 }, 5 );
+
+	/* the boxes of later frames move down with their frames */
+	check( sprite_remove_frame( sprite, "punch", 1 ) );
+	check_channels( sprite, (uint16_t[]) { 0, 2, 3, 4 }, 4 );
+
+	sprite_t* loaded = save_and_load( sprite );
+	sprite_destroy( &sprite );
+
+	if( loaded )
+	{
+		check_channels( loaded, (uint16_t[]) { 0, 2, 3, 4 }, 4 );
+
+		check( sprite_remove_frame( loaded, "punch", 0 ) );
+		check( sprite_remove_frame( loaded, "punch", 2 ) );
+		check_channels( loaded, (uint16_t[]) { 2, 3 }, 2 );
+
+		sprite = save_and_load( loaded );
+		sprite_destroy( &loaded );
+
+		if( sprite )
+		{
+			check_channels( sprite, (uint16_t[]) { 2, 3 }, 2 );
+			sprite_destroy( &sprite );
+		}
+	}
+}
+
+static uint32_t condition_mask( const sprite_t* sprite, const char* name )
+{
+	int8_t condition = sprite_condition( sprite, name );
+	check( condition >= 0 );
+	return condition >= 0 ? 1u << condition : 0;
+}
+
+static const sprite_state_t* transition( const sprite_t* sprite, const char* from, uint32_t conditions, bool* on_exit )
+{
+	const sprite_state_t* state = sprite_state( sprite, from );
+	check( state );
+	return state ? sprite_state_transition( state, conditions, on_exit ) : NULL;
+}
+
+static void check_state_machine( const sprite_t* sprite, const char* walk )
+{
+	uint32_t grounded = condition_mask( sprite, "grounded" );
+	uint32_t airborne = condition_mask( sprite, "airborne" );
+	uint32_t stopped  = condition_mask( sprite, "stopped" );
+	uint32_t moving   = condition_mask( sprite, "moving" );
+	bool on_exit      = false;
+
+	check( sprite_condition_count( sprite ) == 4 );
+	check( strcmp( sprite_condition_name( sprite, 0 ), "grounded" ) == 0 );
+	check( strcmp( sprite_condition_name( sprite, 3 ), "moving" ) == 0 );
+	check( sprite_condition( sprite, "missing" ) < 0 );
+	check( sprite_transition_count( sprite ) == 3 );
+
+	check( transition( sprite, walk, stopped, &on_exit ) == sprite_state( sprite, "idle" ) && on_exit );
+	check( transition( sprite, "idle", moving, &on_exit ) == sprite_state( sprite, walk ) && !on_exit );
+	check( transition( sprite, walk, airborne, &on_exit ) == sprite_state( sprite, "fall" ) && !on_exit );
+
+	/* the condition added first wins */
+	check( transition( sprite, "idle", moving | airborne, NULL ) == sprite_state( sprite, "fall" ) );
+
+	/* no transitions to the same state, nor for conditions nothing uses */
+	check( transition( sprite, "fall", airborne, NULL ) == NULL );
+	check( transition( sprite, "idle", grounded | stopped, NULL ) == NULL );
+	check( transition( sprite, walk, 0, NULL ) == NULL );
+}
+
+static void test_state_machine( void )
+{
+	sprite_t* sprite = sprite_create( "machine", true );
+
+	if( !sprite )
+	{
+		fprintf( stderr, "out of memory\n" );
+		exit( EXIT_FAILURE );
+	}
+
+	check( sprite_add_state( sprite, "idle" ) );
+	check( sprite_add_state( sprite, "walk" ) );
+	check( sprite_add_state( sprite, "fall" ) );
+	check( sprite_add_frame( sprite, "walk", 0, 0, 8, 8, 10 ) );
+	check( sprite_add_frame( sprite, "walk", 8, 0, 8, 8, 20 ) );
+
+	check( sprite_add_condition( sprite, "grounded" ) == 0 );
+	check( sprite_add_transition( sprite, NULL, "fall", "airborne", false ) );
+	check( sprite_add_transition( sprite, "walk", "idle", "stopped", true ) );
+	check( sprite_add_transition( sprite, "idle", "walk", "moving", false ) );
+	check( !sprite_add_transition( sprite, "idle", "missing", "moving", false ) );
+	check_state_machine( sprite, "walk" );
+
+	sprite_t* loaded = save_and_load( sprite );
+	sprite_destroy( &sprite );
+
+	if( loaded )
+	{
+		check_state_machine( loaded, "walk" );
+
+		/* transitions follow a renamed state, also through a save */
+		check( sprite_rename_state( loaded, "walk", "run" ) );
+		check( sprite_state( loaded, "walk" ) == NULL );
+		check( sprite_state_count( loaded ) == 3 );
+		check( sprite_state_id( sprite_state( loaded, "run" ) ) == sprite_tag( "run" ) );
+		check( sprite_state_frame_count( sprite_state( loaded, "run" ) ) == 2 );
+		check( sprite_state_duration( sprite_state( loaded, "run" ) ) == 30 );
+		check_state_machine( loaded, "run" );
+
+		check( !sprite_rename_state( loaded, "run", "idle" ) );
+		check( !sprite_rename_state( loaded, "walk", "stroll" ) );
+		check_state_machine( loaded, "run" );
+
+		sprite = save_and_load( loaded );
+		sprite_destroy( &loaded );
+
+		if( sprite )
+		{
+			check_state_machine( sprite, "run" );
+			sprite_destroy( &sprite );
+		}
+	}
+}
+
+int main( int argc, char* argv[] )
+{
+	test_channels( );
+	test_state_machine( );
+
+	if( failures == 0 )
+	{
+		printf( "All sprite file tests passed.\n" );
+	}
+
+	return failures ? EXIT_FAILURE : 0;
+}